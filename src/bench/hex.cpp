@@ -0,0 +1,48 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <random.h>
+#include <utilstrencodings.h>
+
+#include <string>
+#include <vector>
+
+// Roughly the size of a large raw transaction passed over RPC
+static const size_t HEX_BENCH_BYTES = 1000 * 1000;
+
+static void HexStrBench(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    const std::vector<unsigned char> data = rng.randbytes(HEX_BENCH_BYTES);
+    while (state.KeepRunning()) {
+        std::string hex = HexStr(data.begin(), data.end());
+        assert(hex.size() == 2 * data.size());
+    }
+}
+
+static void ParseHexBench(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    const std::string hex = HexStr(rng.randbytes(HEX_BENCH_BYTES));
+    while (state.KeepRunning()) {
+        std::vector<unsigned char> data = ParseHex(hex);
+        assert(data.size() == HEX_BENCH_BYTES);
+    }
+}
+
+static void IsHexBench(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    const std::string hex = HexStr(rng.randbytes(HEX_BENCH_BYTES));
+    while (state.KeepRunning()) {
+        bool fHex = IsHex(hex);
+        assert(fHex);
+    }
+}
+
+BENCHMARK(HexStrBench, 2000);
+BENCHMARK(ParseHexBench, 1000);
+BENCHMARK(IsHexBench, 4000);
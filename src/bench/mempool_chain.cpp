@@ -0,0 +1,47 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/policy.h>
+#include <txmempool.h>
+
+#include <vector>
+
+// Build a chain of transactions each spending the previous one, like a run
+// of deposits spending a sidechain's CTIP
+static std::vector<CTransactionRef> CreateChain(size_t nLength)
+{
+    std::vector<CTransactionRef> chain;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = 10 * COIN;
+    for (size_t i = 0; i < nLength; i++) {
+        chain.push_back(MakeTransactionRef(tx));
+        tx.vin[0].prevout = COutPoint(chain.back()->GetHash(), 0);
+        tx.vout[0].nValue -= 1000;
+    }
+    return chain;
+}
+
+// Add a long chain to the mempool, then confirm it transaction by transaction
+static void MempoolLongChain(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> chain = CreateChain(500);
+    CTxMemPool pool;
+    LockPoints lp;
+    while (state.KeepRunning()) {
+        LOCK(pool.cs);
+        for (const CTransactionRef& tx : chain) {
+            pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000, 0, 1, false, false, 4, lp));
+        }
+        for (const CTransactionRef& tx : chain) {
+            pool.removeForBlock({tx}, 2);
+        }
+    }
+}
+
+BENCHMARK(MempoolLongChain, 10);
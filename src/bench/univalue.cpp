@@ -0,0 +1,53 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <random.h>
+#include <utilstrencodings.h>
+
+#include <string>
+
+#include <univalue.h>
+
+/** A sendrawtransaction style request carrying a 1MB transaction */
+static void JSONReadLargeString(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    const std::string strRequest = "{\"method\":\"sendrawtransaction\",\"params\":[\"" +
+        HexStr(rng.randbytes(1000 * 1000)) + "\"],\"id\":1}";
+    while (state.KeepRunning()) {
+        UniValue request;
+        bool fRead = request.read(strRequest);
+        assert(fRead);
+    }
+}
+
+/** Pretty printed output of a verbose getblock, as relayed by services */
+static void JSONReadPrettyBlock(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    UniValue txs(UniValue::VARR);
+    for (int i = 0; i < 2000; i++) {
+        UniValue tx(UniValue::VOBJ);
+        tx.pushKV("txid", rng.rand256().GetHex());
+        tx.pushKV("size", 250);
+        tx.pushKV("hex", HexStr(rng.randbytes(250)));
+        UniValue vout(UniValue::VARR);
+        vout.push_back(UniValue(UniValue::VNUM, "0.50000000"));
+        tx.pushKV("vout", vout);
+        txs.push_back(tx);
+    }
+    UniValue block(UniValue::VOBJ);
+    block.pushKV("tx", txs);
+    const std::string strBlock = block.write(2);
+    while (state.KeepRunning()) {
+        UniValue result;
+        bool fRead = result.read(strBlock);
+        assert(fRead);
+    }
+}
+
+BENCHMARK(JSONReadLargeString, 500);
+BENCHMARK(JSONReadPrettyBlock, 200);
@@ -0,0 +1,142 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemap.h>
+
+#include <compat.h>
+#include <util.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <sys/stat.h>
+#endif
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(pdata), nSize);
+#endif
+}
+
+void CMappedBlockFile::Advise(bool fSequential) const
+{
+#ifndef WIN32
+    posix_madvise(const_cast<unsigned char*>(pdata), nSize, fSequential ? POSIX_MADV_SEQUENTIAL : POSIX_MADV_NORMAL);
+#endif
+}
+
+/** Map a whole file read-only. Returns nullptr on failure. */
+static std::shared_ptr<const CMappedBlockFile> MapFile(const fs::path& path)
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    FILE* file = fsbridge::fopen(path, "rb");
+    if (!file) {
+        return nullptr;
+    }
+    int fd = fileno(file);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        fclose(file);
+        return nullptr;
+    }
+    size_t nSize = st.st_size;
+    void* pdata = mmap(nullptr, nSize, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    fclose(file);
+    if (pdata == MAP_FAILED) {
+        LogPrintf("Unable to mmap %s: %s\n", path.string(), strerror(errno));
+        return nullptr;
+    }
+    return std::make_shared<const CMappedBlockFile>(static_cast<const unsigned char*>(pdata), nSize);
+#endif
+}
+
+std::shared_ptr<const CMappedBlockFile> CBlockFileMapCache::Get(const fs::path& path, size_t nMinSize)
+{
+    LOCK(cs);
+    if (nMaxFiles == 0) {
+        return nullptr;
+    }
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->path != path) {
+            continue;
+        }
+        if (it->mapped->size() >= nMinSize) {
+            entries.splice(entries.begin(), entries, it);
+            return it->mapped;
+        }
+        // The file has been appended to since it was mapped
+        entries.erase(it);
+        break;
+    }
+
+    std::shared_ptr<const CMappedBlockFile> mapped = MapFile(path);
+    if (!mapped || mapped->size() < nMinSize) {
+        return nullptr;
+    }
+    mapped->Advise(nSequentialScans > 0);
+    entries.push_front(Entry{path, mapped});
+    while (entries.size() > nMaxFiles) {
+        entries.pop_back();
+    }
+    return mapped;
+}
+
+void CBlockFileMapCache::Invalidate(const fs::path& path)
+{
+    LOCK(cs);
+    entries.remove_if([&path](const Entry& entry) { return entry.path == path; });
+}
+
+void CBlockFileMapCache::Clear()
+{
+    LOCK(cs);
+    entries.clear();
+}
+
+void CBlockFileMapCache::SetMaxFiles(size_t nMaxFilesIn)
+{
+    LOCK(cs);
+    nMaxFiles = nMaxFilesIn;
+    while (entries.size() > nMaxFiles) {
+        entries.pop_back();
+    }
+}
+
+bool CBlockFileMapCache::IsEnabled() const
+{
+#ifdef WIN32
+    return false;
+#else
+    LOCK(cs);
+    return nMaxFiles > 0;
+#endif
+}
+
+void CBlockFileMapCache::BeginSequentialScan()
+{
+    LOCK(cs);
+    if (nSequentialScans++ == 0) {
+        for (const Entry& entry : entries) {
+            entry.mapped->Advise(true);
+        }
+    }
+}
+
+void CBlockFileMapCache::EndSequentialScan()
+{
+    LOCK(cs);
+    assert(nSequentialScans > 0);
+    if (--nSequentialScans == 0) {
+        for (const Entry& entry : entries) {
+            entry.mapped->Advise(false);
+        }
+    }
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include <fs.h>
+#include <sync.h>
+
+#include <list>
+#include <memory>
+
+/** Default for -blockfilemmap, the number of blk/rev files kept mapped.
+ *  Mapping whole block files needs a 64-bit address space. */
+static const unsigned int DEFAULT_BLOCKFILE_MMAP = sizeof(void*) >= 8 ? 8 : 0;
+
+/** A read-only memory mapping of an entire blk?????.dat or rev?????.dat file */
+class CMappedBlockFile
+{
+public:
+    CMappedBlockFile(const unsigned char* dataIn, size_t nSizeIn) : pdata(dataIn), nSize(nSizeIn) {}
+    ~CMappedBlockFile();
+
+    CMappedBlockFile(const CMappedBlockFile&) = delete;
+    CMappedBlockFile& operator=(const CMappedBlockFile&) = delete;
+
+    const unsigned char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+
+    /** Hint the kernel about the expected access pattern of the mapping */
+    void Advise(bool fSequential) const;
+
+private:
+    const unsigned char* const pdata;
+    const size_t nSize;
+};
+
+/**
+ * Keeps the most recently used block and undo files memory-mapped so that
+ * records can be deserialized straight out of the page cache.
+ *
+ * Mappings are reference counted: evicting or invalidating a file only drops
+ * the cache's reference, readers holding a mapping can keep using it.
+ */
+class CBlockFileMapCache
+{
+public:
+    explicit CBlockFileMapCache(size_t nMaxFilesIn = DEFAULT_BLOCKFILE_MMAP) : nMaxFiles(nMaxFilesIn), nSequentialScans(0) {}
+
+    /** Return a mapping of the file at path covering at least nMinSize
+     *  bytes, remapping it if the file has grown. Returns nullptr if mapping
+     *  is disabled or fails. */
+    std::shared_ptr<const CMappedBlockFile> Get(const fs::path& path, size_t nMinSize);
+
+    /** Drop any mapping of the file at path, e.g. because it is truncated or pruned */
+    void Invalidate(const fs::path& path);
+    void Clear();
+
+    void SetMaxFiles(size_t nMaxFilesIn);
+    bool IsEnabled() const;
+
+    /** Sequential scans (such as wallet rescans) switch all mappings to
+     *  MADV_SEQUENTIAL readahead until the last scan ends. */
+    void BeginSequentialScan();
+    void EndSequentialScan();
+
+private:
+    struct Entry {
+        fs::path path;
+        std::shared_ptr<const CMappedBlockFile> mapped;
+    };
+
+    mutable CCriticalSection cs;
+    //! Most recently used first
+    std::list<Entry> entries;
+    size_t nMaxFiles;
+    int nSequentialScans;
+};
+
+/** RAII helper marking a sequential scan over block files */
+class CBlockFileSequentialScan
+{
+public:
+    explicit CBlockFileSequentialScan(CBlockFileMapCache& cacheIn) : cache(cacheIn) { cache.BeginSequentialScan(); }
+    ~CBlockFileSequentialScan() { cache.EndSequentialScan(); }
+
+private:
+    CBlockFileMapCache& cache;
+};
+
+#endif // BITCOIN_BLOCKFILEMAP_H
@@ -0,0 +1,304 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilterindex.h>
+
+#include <chainparams.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <init.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+static const char DB_FILTER = 'f';
+static const char DB_BEST_BLOCK = 'B';
+static const char DB_LAST_FILE = 'F';
+
+std::unique_ptr<CBlockFilterIndex> g_blockfilterindex;
+
+CBlockFilterIndex::CBlockFilterIndex(size_t nCacheSize, bool fMemory, bool fWipe)
+    : db(GetDataDir() / "blocks" / "filter" / "db", nCacheSize, fMemory, fWipe),
+      pathFiles(GetDataDir() / "blocks" / "filter"),
+      nLastFile(0),
+      fileLast(nullptr),
+      nLastFileSize(0),
+      fDirty(false)
+{
+    TryCreateDirectories(pathFiles);
+    db.Read(DB_BEST_BLOCK, hashBest);
+    db.Read(DB_LAST_FILE, nLastFile);
+}
+
+CBlockFilterIndex::~CBlockFilterIndex()
+{
+    LOCK(cs_main);
+    Flush();
+    CloseLastFile();
+}
+
+fs::path CBlockFilterIndex::GetFilePath(int nFile) const
+{
+    return pathFiles / strprintf("fltr%05u.dat", nFile);
+}
+
+bool CBlockFilterIndex::OpenLastFile()
+{
+    fs::path path = GetFilePath(nLastFile);
+    FILE* file = fsbridge::fopen(path, "rb+");
+    if (!file)
+        file = fsbridge::fopen(path, "wb+");
+    if (!file)
+        return error("%s: failed to open %s", __func__, path.string());
+    if (fseek(file, 0, SEEK_END)) {
+        fclose(file);
+        return error("%s: failed to seek to end of %s", __func__, path.string());
+    }
+    long nEnd = ftell(file);
+    if (nEnd < 0) {
+        fclose(file);
+        return error("%s: failed to get size of %s", __func__, path.string());
+    }
+    fileLast = file;
+    nLastFileSize = nEnd;
+    return true;
+}
+
+void CBlockFilterIndex::CloseLastFile()
+{
+    if (fileLast) {
+        FileCommit(fileLast);
+        fclose(fileLast);
+        fileLast = nullptr;
+    }
+}
+
+bool CBlockFilterIndex::WriteFilterToDisk(const BlockFilter& filter, CDiskBlockPos& pos)
+{
+    unsigned int nSize = ::GetSerializeSize(filter, SER_DISK, CLIENT_VERSION);
+    for (;;) {
+        if (!fileLast && !OpenLastFile())
+            return false;
+        if (nLastFileSize == 0 || nLastFileSize + nSize <= MAX_FILTER_FILE_SIZE)
+            break;
+        CloseLastFile();
+        nLastFile++;
+    }
+
+    CAutoFile fileout(fileLast, SER_DISK, CLIENT_VERSION);
+    try {
+        fileout << filter;
+    } catch (const std::exception& e) {
+        // Closed by fileout, the size is read again on the next write
+        fileLast = nullptr;
+        return error("%s: failed to write to %s: %s", __func__, GetFilePath(nLastFile).string(), e.what());
+    }
+    fileout.release();
+    // Lookups read the file through their own handle
+    if (fflush(fileLast) != 0)
+        return error("%s: failed to flush %s", __func__, GetFilePath(nLastFile).string());
+    pos = CDiskBlockPos(nLastFile, nLastFileSize);
+    nLastFileSize += nSize;
+    return true;
+}
+
+bool CBlockFilterIndex::ReadFilterFromDisk(const CFilterEntry& entry, BlockFilter& filter) const
+{
+    CAutoFile filein(fsbridge::fopen(GetFilePath(entry.pos.nFile), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: failed to open filter file %d", __func__, entry.pos.nFile);
+    if (fseek(filein.Get(), entry.pos.nPos, SEEK_SET))
+        return error("%s: failed to seek to %s", __func__, entry.pos.ToString());
+
+    try {
+        filein >> filter;
+    } catch (const std::exception& e) {
+        return error("%s: deserialize error at %s: %s", __func__, entry.pos.ToString(), e.what());
+    }
+    if (filter.GetHash() != entry.hash)
+        return error("%s: checksum mismatch at %s", __func__, entry.pos.ToString());
+    return true;
+}
+
+bool CBlockFilterIndex::ReadEntry(const uint256& hash, CFilterEntry& entry) const
+{
+    {
+        LOCK(cs_pending);
+        std::map<uint256, CFilterEntry>::const_iterator it = mapPending.find(hash);
+        if (it != mapPending.end()) {
+            entry = it->second;
+            return true;
+        }
+    }
+    return db.Read(std::make_pair(DB_FILTER, hash), entry);
+}
+
+void CBlockFilterIndex::SetBest(const CBlockIndex* pindex)
+{
+    hashBest = pindex ? pindex->GetBlockHash() : uint256();
+    fDirty = true;
+}
+
+bool CBlockFilterIndex::Flush()
+{
+    AssertLockHeld(cs_main);
+    if (!fDirty)
+        return true;
+
+    // The index entries must not reach disk before the filters they point to
+    if (fileLast)
+        FileCommit(fileLast);
+
+    CDBBatch batch(db);
+    {
+        LOCK(cs_pending);
+        for (const std::pair<const uint256, CFilterEntry>& pending : mapPending)
+            batch.Write(std::make_pair(DB_FILTER, pending.first), pending.second);
+    }
+    batch.Write(DB_BEST_BLOCK, hashBest);
+    batch.Write(DB_LAST_FILE, nLastFile);
+    if (!db.WriteBatch(batch, true))
+        return error("%s: failed to write filter index entries", __func__);
+
+    LOCK(cs_pending);
+    mapPending.clear();
+    fDirty = false;
+    return true;
+}
+
+bool CBlockFilterIndex::WriteBlock(const BlockFilter& filter, const CBlockIndex* pindex)
+{
+    CFilterEntry entry;
+    if (ReadEntry(pindex->GetBlockHash(), entry)) {
+        // Reconnected after a reorg, the stored filter is still valid.
+        SetBest(pindex);
+        return true;
+    }
+
+    uint256 hashPrevHeader;
+    if (pindex->pprev) {
+        CFilterEntry prev;
+        if (!ReadEntry(pindex->pprev->GetBlockHash(), prev))
+            return error("%s: missing filter for %s", __func__, pindex->pprev->GetBlockHash().ToString());
+        hashPrevHeader = prev.header;
+    }
+
+    if (!WriteFilterToDisk(filter, entry.pos))
+        return false;
+    entry.hash = filter.GetHash();
+    entry.header = filter.ComputeHeader(hashPrevHeader);
+
+    size_t nPending;
+    {
+        LOCK(cs_pending);
+        mapPending[pindex->GetBlockHash()] = entry;
+        nPending = mapPending.size();
+    }
+    SetBest(pindex);
+    // Don't let a long catch up pile up entries until the next chainstate flush
+    if (nPending >= MAX_PENDING_FILTER_ENTRIES)
+        return Flush();
+    return true;
+}
+
+bool CBlockFilterIndex::BlockConnected(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!pindex->pprev || pindex->pprev->GetBlockHash() != hashBest)
+        return true;
+
+    return WriteBlock(BlockFilter(BlockFilterType::BASIC, block, blockundo), pindex);
+}
+
+bool CBlockFilterIndex::BlockDisconnected(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (pindex->GetBlockHash() != hashBest)
+        return true;
+
+    SetBest(pindex->pprev);
+    return true;
+}
+
+bool CBlockFilterIndex::Sync()
+{
+    const CChainParams& chainparams = Params();
+    int nIndexed = 0;
+
+    while (!ShutdownRequested()) {
+        const CBlockIndex* pindexNext;
+        {
+            LOCK(cs_main);
+            const CBlockIndex* pindexBest = nullptr;
+            if (!hashBest.IsNull()) {
+                BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+                if (it == mapBlockIndex.end())
+                    return error("%s: best block %s of the filter index not found", __func__, hashBest.ToString());
+                pindexBest = it->second;
+            }
+            if (pindexBest && !chainActive.Contains(pindexBest)) {
+                // All ancestors of the index tip are indexed, continue from the fork.
+                SetBest(chainActive.FindFork(pindexBest));
+                continue;
+            }
+            pindexNext = pindexBest ? chainActive.Next(pindexBest) : chainActive.Genesis();
+            if (!pindexNext) {
+                if (!Flush())
+                    return false;
+                if (nIndexed > 0)
+                    LogPrintf("%s: block filter index synced to height %d after %d blocks\n", __func__, chainActive.Height(), nIndexed);
+                return true;
+            }
+        }
+
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockFromDisk(block, pindexNext, chainparams.GetConsensus()))
+            return error("%s: failed to read block %s", __func__, pindexNext->GetBlockHash().ToString());
+        if (pindexNext->pprev && !UndoReadFromDisk(blockundo, pindexNext))
+            return error("%s: failed to read undo data of %s", __func__, pindexNext->GetBlockHash().ToString());
+        BlockFilter filter(BlockFilterType::BASIC, block, blockundo);
+
+        {
+            LOCK(cs_main);
+            // The tip may have moved while the block was being read.
+            uint256 hashPrev = pindexNext->pprev ? pindexNext->pprev->GetBlockHash() : uint256();
+            if (hashPrev != hashBest || !chainActive.Contains(pindexNext))
+                continue;
+            if (!WriteBlock(filter, pindexNext))
+                return false;
+        }
+
+        if (++nIndexed % 10000 == 0)
+            LogPrintf("%s: block filter index at height %d\n", __func__, pindexNext->nHeight);
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex* pindex, BlockFilter& filter) const
+{
+    CFilterEntry entry;
+    if (!ReadEntry(pindex->GetBlockHash(), entry))
+        return false;
+
+    return ReadFilterFromDisk(entry, filter);
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex* pindex, uint256& header) const
+{
+    CFilterEntry entry;
+    if (!ReadEntry(pindex->GetBlockHash(), entry))
+        return false;
+
+    header = entry.header;
+    return true;
+}
+
+uint256 CBlockFilterIndex::GetBestBlockHash() const
+{
+    AssertLockHeld(cs_main);
+    return hashBest;
+}
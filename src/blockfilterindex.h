@@ -0,0 +1,117 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTERINDEX_H
+#define BITCOIN_BLOCKFILTERINDEX_H
+
+#include <blockfilter.h>
+#include <chain.h>
+#include <dbwrapper.h>
+#include <fs.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <map>
+#include <memory>
+
+class CBlock;
+class CBlockUndo;
+
+/** Default for -blockfilterindex */
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+//! Max memory allocated to the block filter index database (MiB)
+static const int64_t nMaxBlockFilterIndexCache = 8;
+/** The maximum size of a fltr?????.dat file */
+static const unsigned int MAX_FILTER_FILE_SIZE = 0x1000000; // 16 MiB
+/** Number of index entries kept in memory before the filter index flushes by itself */
+static const size_t MAX_PENDING_FILTER_ENTRIES = 10000;
+
+/**
+ * Index of BIP 158 basic block filters. Encoded filters are appended to flat
+ * files in blocks/filter/, a LevelDB database maps each block hash to the
+ * position, hash and header of its filter.
+ *
+ * Filters are written as blocks are connected to the active chain; on
+ * disconnect only the index tip steps back, since a block's filter does not
+ * depend on the chain it is part of. Sync() fills in blocks connected while
+ * the index was disabled. Updates happen under cs_main, lookups need no lock.
+ * The file being appended to is kept open. New index entries and the index
+ * tip are kept in memory until Flush(), which syncs the filter files first,
+ * so entries never reach the database ahead of the filters they point to.
+ */
+class CBlockFilterIndex
+{
+public:
+    explicit CBlockFilterIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CBlockFilterIndex();
+
+    CBlockFilterIndex(const CBlockFilterIndex&) = delete;
+    CBlockFilterIndex& operator=(const CBlockFilterIndex&) = delete;
+
+    /** Add the filter of a block connected on top of the index tip. Blocks
+     *  that do not extend the tip are ignored. Returns false on I/O errors. */
+    bool BlockConnected(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+
+    /** Step the index tip back if pindex was it */
+    bool BlockDisconnected(const CBlockIndex* pindex);
+
+    /** Sync the filter files, then write the pending index entries and tip.
+     *  Called with the chainstate flush. Returns false on I/O errors. */
+    bool Flush();
+
+    /** Index active chain blocks up to the tip. Returns false on errors,
+     *  true when in sync or when shutdown was requested. */
+    bool Sync();
+
+    bool LookupFilter(const CBlockIndex* pindex, BlockFilter& filter) const;
+    bool LookupFilterHeader(const CBlockIndex* pindex, uint256& header) const;
+
+    /** Hash of the last block whose ancestors are all indexed */
+    uint256 GetBestBlockHash() const;
+
+private:
+    struct CFilterEntry
+    {
+        CDiskBlockPos pos;
+        uint256 hash;
+        uint256 header;
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(pos);
+            READWRITE(hash);
+            READWRITE(header);
+        }
+    };
+
+    CDBWrapper db;
+    const fs::path pathFiles;
+    //! Index tip and file being appended to, guarded by cs_main
+    uint256 hashBest;
+    int nLastFile;
+    //! Open handle and size of file nLastFile, guarded by cs_main
+    FILE* fileLast;
+    uint64_t nLastFileSize;
+    //! Whether the tip or entries changed since the last Flush, guarded by cs_main
+    bool fDirty;
+    //! Index entries not written to the database yet, by block hash
+    mutable CCriticalSection cs_pending;
+    std::map<uint256, CFilterEntry> mapPending;
+
+    fs::path GetFilePath(int nFile) const;
+    bool OpenLastFile();
+    void CloseLastFile();
+    bool WriteFilterToDisk(const BlockFilter& filter, CDiskBlockPos& pos);
+    bool ReadFilterFromDisk(const CFilterEntry& entry, BlockFilter& filter) const;
+    bool ReadEntry(const uint256& hash, CFilterEntry& entry) const;
+    bool WriteBlock(const BlockFilter& filter, const CBlockIndex* pindex);
+    void SetBest(const CBlockIndex* pindex);
+};
+
+/** The global block filter index, nullptr if -blockfilterindex is off */
+extern std::unique_ptr<CBlockFilterIndex> g_blockfilterindex;
+
+#endif // BITCOIN_BLOCKFILTERINDEX_H
@@ -49,7 +49,10 @@ size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) :
+    CCoinsViewBacked(baseIn),
+    cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &m_cache_coins_memory_resource),
+    cachedCoinsUsage(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -263,7 +266,9 @@ CCoinsViewLoadedCursor* CCoinsViewCache::LoadedCursor() const
 
 bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
+    // The base may leave entries (such as loaded coins) behind
     cacheCoins.clear();
+    ReallocateCache();
     cachedCoinsUsage = 0;
     return fOk;
 }
@@ -277,6 +282,98 @@ void CCoinsViewCache::Uncache(const COutPoint& hash)
     }
 }
 
+static bool SameCoin(const Coin& a, const Coin& b)
+{
+    return a.out == b.out && a.nHeight == b.nHeight && a.fCoinBase == b.fCoinBase && a.fCriticalData == b.fCriticalData;
+}
+
+bool CCoinsViewCache::CopyDirty(CCoinsMap &batch, size_t nMaxEntries)
+{
+    for (auto& entry : cacheCoins) {
+        // Loaded coins are never written to the base
+        if (!(entry.second.flags & CCoinsCacheEntry::DIRTY) || entry.second.coin.fLoaded) {
+            continue;
+        }
+        if (batch.size() >= nMaxEntries) {
+            return false;
+        }
+        if (!entry.second.coin.IsSpent()) {
+            entry.second.flags &= ~CCoinsCacheEntry::FRESH;
+        }
+        CCoinsCacheEntry& copy = batch[entry.first];
+        copy.coin = entry.second.coin;
+        copy.flags = CCoinsCacheEntry::DIRTY;
+    }
+    return true;
+}
+
+void CCoinsViewCache::MarkWritten(const CCoinsMap &batch)
+{
+    for (const auto& written : batch) {
+        CCoinsMap::iterator it = cacheCoins.find(written.first);
+        if (it == cacheCoins.end() || !(it->second.flags & CCoinsCacheEntry::DIRTY)) {
+            continue;
+        }
+        if (!SameCoin(it->second.coin, written.second.coin)) {
+            // Modified since it was copied, still needs writing
+            continue;
+        }
+        if (it->second.coin.IsSpent()) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            cacheCoins.erase(it);
+        } else {
+            it->second.flags = 0;
+        }
+    }
+}
+
+size_t CCoinsViewCache::EvictClean(size_t nTargetUsage)
+{
+    if (DynamicMemoryUsage() <= nTargetUsage) {
+        return 0;
+    }
+    // Erased nodes only go back to the pool's free lists, so the pool's usage
+    // doesn't drop while evicting. Count the live entries instead, leaving a
+    // chunk of slack for the partially used last chunk, and move the rest
+    // into a fresh pool afterwards so the chunks are handed back.
+    const size_t nNodeUsage = memusage::MallocUsage(sizeof(memusage::unordered_node<CCoinsMap::value_type>));
+    const size_t nFixedUsage = memusage::MallocUsage(sizeof(void*) * cacheCoins.bucket_count()) + memusage::MallocUsage(m_cache_coins_memory_resource.ChunkSizeBytes());
+    size_t nEvicted = 0;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end() && nFixedUsage + nNodeUsage * cacheCoins.size() + cachedCoinsUsage > nTargetUsage; ) {
+        if (it->second.flags != 0) {
+            ++it;
+            continue;
+        }
+        cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+        it = cacheCoins.erase(it);
+        nEvicted++;
+    }
+    if (nEvicted == 0) {
+        return 0;
+    }
+
+    std::vector<CCoinsMap::value_type> vKept(std::make_move_iterator(cacheCoins.begin()), std::make_move_iterator(cacheCoins.end()));
+    cacheCoins.clear();
+    ReallocateCache();
+    cacheCoins.reserve(vKept.size());
+    for (CCoinsMap::value_type& entry : vKept) {
+        cacheCoins.emplace(entry.first, std::move(entry.second));
+    }
+    return nEvicted;
+}
+
+void CCoinsViewCache::ReallocateCache()
+{
+    // Cache should be empty when we're calling this.
+    assert(cacheCoins.empty());
+    // Clearing the map keeps the pool's chunks around, so rebuild both to
+    // hand the memory back after a flush.
+    cacheCoins.~CCoinsMap();
+    m_cache_coins_memory_resource.~CCoinsMapMemoryResource();
+    ::new (&m_cache_coins_memory_resource) CCoinsMapMemoryResource{};
+    ::new (&cacheCoins) CCoinsMap{0, SaltedOutpointHasher{}, CCoinsMap::key_equal{}, &m_cache_coins_memory_resource};
+}
+
 unsigned int CCoinsViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
@@ -12,6 +12,7 @@
 #include <hash.h>
 #include <memusage.h>
 #include <serialize.h>
+#include <support/allocators/pool.h>
 #include <uint256.h>
 
 #include <assert.h>
@@ -191,7 +192,25 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * PoolAllocator's MAX_BLOCK_SIZE_BYTES parameter here uses sizeof the data,
+ * and adds the size of 4 pointers. We do not know the exact node size used in
+ * the std::unordered_node implementation because it is implementation
+ * defined. Most implementations have an overhead of 1 or 2 pointers, so
+ * nodes can be connected in a linked list, and in some cases the hash value
+ * is stored as well. Using an additional sizeof(void*)*4 for
+ * MAX_BLOCK_SIZE_BYTES should thus be sufficient so that all implementations
+ * can allocate the nodes from the PoolAllocator.
+ */
+typedef std::unordered_map<COutPoint,
+                           CCoinsCacheEntry,
+                           SaltedOutpointHasher,
+                           std::equal_to<COutPoint>,
+                           PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                                         sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4>>
+    CCoinsMap;
+
+typedef CCoinsMap::allocator_type::ResourceType CCoinsMapMemoryResource;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -310,6 +329,8 @@ protected:
      * declared as "const".
      */
     mutable uint256 hashBlock;
+    //! Node storage for cacheCoins, must be declared (and thus destroyed) before it
+    mutable CCoinsMapMemoryResource m_cache_coins_memory_resource;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
@@ -383,6 +404,30 @@ public:
      */
     void Uncache(const COutPoint &outpoint);
 
+    /**
+     * Copy up to nMaxEntries dirty entries into batch, so they can be written
+     * to the base view while this cache stays in use. Copied unspent entries
+     * lose their FRESH flag, as the base is about to learn about them.
+     * Returns whether every dirty entry was copied.
+     */
+    bool CopyDirty(CCoinsMap &batch, size_t nMaxEntries);
+
+    /**
+     * Mark the entries of a batch produced by CopyDirty as written. Entries
+     * modified in the meantime stay dirty, spent ones are dropped and the
+     * rest are kept as clean entries.
+     */
+    void MarkWritten(const CCoinsMap &batch);
+
+    /**
+     * Drop clean entries until the cache uses at most nTargetUsage bytes.
+     * Dirty and fresh entries are kept, so the cache may stay above it.
+     * The remaining entries are moved into a new pool, so like Flush() this
+     * invalidates references into the cache. Returns the number of entries
+     * dropped.
+     */
+    size_t EvictClean(size_t nTargetUsage);
+
     //! Calculate the size of the cache (in number of transaction outputs)
     unsigned int GetCacheSize() const;
 
@@ -404,6 +449,9 @@ public:
 
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
+
+    //! Destroy and recreate the (empty) cache so the pool memory is released.
+    void ReallocateCache();
 };
 
 //! Utility function to add all of a transaction's outputs to a cache.
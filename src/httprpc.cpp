@@ -64,6 +64,34 @@ static std::string strRPCUserColonPass;
 /* Stored RPC timer interface (for unregistration) */
 static std::unique_ptr<HTTPRPCTimerInterface> httpRPCTimerInterface;
 
+HTTPJSONWriter::HTTPJSONWriter(HTTPRequest* reqIn) : JSONStreamWriter([reqIn](const std::string& chunk) {
+        if (!reqIn->IsChunkedReplyStarted()) {
+            reqIn->WriteHeader("Content-Type", "application/json");
+            reqIn->StartChunkedReply(HTTP_OK);
+        }
+        reqIn->WriteReplyChunk(chunk);
+    }), req(reqIn)
+{
+}
+
+void HTTPJSONWriter::Finish()
+{
+    std::string strRest = Release() + "\n";
+    if (req->IsChunkedReplyStarted()) {
+        req->WriteReplyChunk(strRest);
+        req->EndChunkedReply();
+    } else {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strRest);
+    }
+}
+
+void HTTPJSONWriter::Abort()
+{
+    assert(req->IsChunkedReplyStarted());
+    req->EndChunkedReply();
+}
+
 static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const UniValue& id)
 {
     // Send error reply from json-rpc error object
@@ -185,6 +213,30 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            // Methods with large results stream them as they are produced
+            HTTPJSONWriter writer(req);
+            writer.BeginObject();
+            writer.Key("result");
+            bool fStreamed;
+            try {
+                fStreamed = tableRPC.executeStream(jreq, writer);
+            } catch (...) {
+                if (!writer.Flushed())
+                    throw;
+                LogPrintf("%s: %s failed after part of the reply was sent\n", __func__, jreq.strMethod);
+                writer.Abort();
+                return false;
+            }
+            if (fStreamed) {
+                writer.Key("error");
+                writer.Value(NullUniValue);
+                writer.Key("id");
+                writer.Value(jreq.id);
+                writer.EndObject();
+                writer.Finish();
+                return true;
+            }
+
             UniValue result = tableRPC.execute(jreq);
 
             // Send reply
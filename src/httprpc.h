@@ -5,9 +5,13 @@
 #ifndef BITCOIN_HTTPRPC_H
 #define BITCOIN_HTTPRPC_H
 
+#include <rpc/jsonstream.h>
+
 #include <string>
 #include <map>
 
+class HTTPRequest;
+
 /** Start HTTP RPC subsystem.
  * Precondition; HTTP and RPC has been started.
  */
@@ -20,6 +24,27 @@ void InterruptHTTPRPC();
  */
 void StopHTTPRPC();
 
+/**
+ * Streams a JSON reply to an HTTP request. Once more than the flush size has
+ * been produced the reply is sent with chunked transfer encoding as it is
+ * written; smaller documents go out in one piece from Finish.
+ */
+class HTTPJSONWriter : public JSONStreamWriter
+{
+public:
+    explicit HTTPJSONWriter(HTTPRequest* req);
+    /** Send the rest of the document, followed by a newline, and complete the reply. */
+    void Finish();
+    /**
+     * Close a reply that was started but can not be completed. The client
+     * sees truncated JSON.
+     */
+    void Abort();
+
+private:
+    HTTPRequest* req;
+};
+
 /** Start HTTP REST subsystem.
  * Precondition; HTTP and RPC has been started.
  */
@@ -40,6 +40,11 @@
 /** Maximum size of http request (request line + headers) */
 static const size_t MAX_HEADERS_SIZE = 8192;
 
+/** Maximum size of a chunked reply buffered for a slow client before the writer waits */
+static const size_t MAX_CHUNKED_REPLY_BUFFER = 4 * 1024 * 1024;
+/** Seconds a chunked reply waits for the client to read before the rest of it is dropped */
+static const int64_t CHUNKED_REPLY_TIMEOUT = 30;
+
 /** HTTP request work item */
 class HTTPWorkItem final : public HTTPClosure
 {
@@ -523,12 +528,19 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       chunkedReplyStarted(false),
+                                                       chunkedReplyDropped(false),
+                                                       nChunkBytesSinceCheck(0)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (chunkedReplyStarted && !replySent) {
+        // Headers are already out, so all we can do is close the body
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        EndChunkedReply();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -574,6 +586,22 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
     evhttp_add_header(headers, hdr.c_str(), value.c_str());
 }
 
+/** Re-enable reading from the socket after a reply was sent. This is the
+ * second part of the libevent workaround above.
+ */
+static void ReenableRead(struct evhttp_request* req)
+{
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 /** Closure sent to main thread to request a reply to be sent to
  * a HTTP request.
  * Replies must be sent in the main loop in the main http thread,
@@ -581,7 +609,7 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  */
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && !chunkedReplyStarted && req);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
@@ -589,17 +617,101 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
+        ReenableRead(req_copy);
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
+void HTTPRequest::StartChunkedReply(int nStatus)
+{
+    assert(!replySent && !chunkedReplyStarted && req);
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+        evhttp_send_reply_start(req_copy, nStatus, nullptr);
+    });
+    ev->trigger(nullptr);
+    chunkedReplyStarted = true;
+}
+
+/** Get how many bytes of the reply are waiting to be sent to the client.
+ * Runs on the main http thread, after all previously triggered chunks were
+ * handed to evhttp. Returns false if the client has disconnected. Gives up
+ * (reporting nothing buffered) if the event loop does not answer.
+ */
+static bool GetBufferedReplySize(struct evhttp_request* req, size_t& nBuffered)
+{
+    auto probe = std::make_shared<std::promise<int64_t>>();
+    std::future<int64_t> result = probe->get_future();
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req, probe]{
+        // evhttp detaches the request from a connection that failed
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        bufferevent* bev = conn ? evhttp_connection_get_bufferevent(conn) : nullptr;
+        probe->set_value(bev ? (int64_t)evbuffer_get_length(bufferevent_get_output(bev)) : -1);
+    });
+    ev->trigger(nullptr);
+    nBuffered = 0;
+    if (result.wait_for(std::chrono::seconds(1)) != std::future_status::ready) {
+        return true;
+    }
+    int64_t nResult = result.get();
+    if (nResult < 0) {
+        return false;
+    }
+    nBuffered = nResult;
+    return true;
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(chunkedReplyStarted && req);
+    if (strChunk.empty() || chunkedReplyDropped)
+        return; // an empty chunk would terminate the reply
+    // Don't run ahead of a slow client: once enough has been written, wait
+    // for the connection to send most of it before queueing more. Give up on
+    // clients that went away or stopped reading.
+    nChunkBytesSinceCheck += strChunk.size();
+    if (nChunkBytesSinceCheck > MAX_CHUNKED_REPLY_BUFFER / 2) {
+        const int64_t nDeadline = GetTimeMillis() + CHUNKED_REPLY_TIMEOUT * 1000;
+        size_t nBuffered;
+        while (true) {
+            if (!GetBufferedReplySize(req, nBuffered)) {
+                LogPrint(BCLog::HTTP, "Client disconnected, dropping the rest of the reply to %s\n", GetURI());
+                chunkedReplyDropped = true;
+                return;
+            }
+            if (nBuffered <= MAX_CHUNKED_REPLY_BUFFER / 2)
+                break;
+            if (GetTimeMillis() > nDeadline) {
+                LogPrint(BCLog::HTTP, "Client stopped reading, dropping the rest of the reply to %s\n", GetURI());
+                chunkedReplyDropped = true;
+                return;
             }
+            MilliSleep(10);
         }
+        nChunkBytesSinceCheck = 0;
+    }
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    auto req_copy = req;
+    // Events are handled in the order they were triggered, so chunks go out
+    // in sequence. If the client went away, libevent drops the chunk.
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, evb]{
+        evhttp_send_reply_chunk(req_copy, evb);
+        evbuffer_free(evb);
+    });
+    ev->trigger(nullptr);
+}
+
+void HTTPRequest::EndChunkedReply()
+{
+    assert(chunkedReplyStarted && req);
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy]{
+        evhttp_send_reply_end(req_copy);
+        ReenableRead(req_copy);
     });
     ev->trigger(nullptr);
     replySent = true;
@@ -59,6 +59,11 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    bool chunkedReplyStarted;
+    //! Whether the client stopped reading, so the rest of the chunked reply is dropped
+    bool chunkedReplyDropped;
+    //! Bytes of the chunked reply written since its buffer was last checked
+    size_t nChunkBytesSinceCheck;
 
 public:
     explicit HTTPRequest(struct evhttp_request* req);
@@ -114,6 +119,32 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a reply with chunked transfer encoding, sending the status line
+     * and headers. Follow with any number of WriteReplyChunk calls and
+     * finish with EndChunkedReply.
+     *
+     * @note Use this instead of WriteReply, not in addition to it.
+     */
+    void StartChunkedReply(int nStatus);
+
+    /**
+     * Send the next part of a chunked reply body. Blocks while a few MB of
+     * the reply are still waiting to be sent to the client, for at most
+     * CHUNKED_REPLY_TIMEOUT seconds. If the client disconnects or does not
+     * read in that time, this and all further chunks are dropped. Never call
+     * this while holding cs_main or mempool.cs.
+     */
+    void WriteReplyChunk(const std::string& strChunk);
+
+    /**
+     * Finish a chunked reply. The same rules as after WriteReply apply.
+     */
+    void EndChunkedReply();
+
+    /** Whether StartChunkedReply has been called. */
+    bool IsChunkedReplyStarted() const { return chunkedReplyStarted; }
 };
 
 /** Event handler closure.
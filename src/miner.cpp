@@ -119,7 +119,7 @@ void BlockAssembler::resetBlock()
     nFees = 0;
 }
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx, const CBlockTemplate* pprevTemplate)
 {
     int64_t nTimeStart = GetTimeMicros();
 
@@ -174,7 +174,11 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
+    int nTemplateTxs = 0;
     bool fNeedCriticalFeeTx = false;
+    const bool fExtendTemplate = pprevTemplate && pprevTemplate->block.hashPrevBlock == pindexPrev->GetBlockHash();
+    if (fExtendTemplate)
+        nTemplateTxs = addTemplateTxs(*pprevTemplate, fDrivechainEnabled, fNeedCriticalFeeTx);
     addPackageTxs(nPackagesSelected, nDescendantsUpdated, fDrivechainEnabled, fNeedCriticalFeeTx);
 
     int64_t nTime1 = GetTimeMicros();
@@ -344,7 +348,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
             // Test block validity after adding critical fee tx
             CValidationState state;
-            if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, true, true)) {
+            if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, true, true, true)) {
                 // TODO right now if the block is too big or invalid after this
                 // will result in giving up the BMM commitment fees...
 
@@ -368,13 +372,17 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
 
+    // Transactions came from the mempool, which already validated them on
+    // this tip; the coinbase, limits and drivechain rules are checked in full.
+    // Extended templates too, as their coinbase and critical data
+    // transactions are rebuilt.
     CValidationState state;
-    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false, true)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d reused txs, %d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nTemplateTxs, nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
@@ -617,6 +625,44 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, CTxMemP
     std::sort(sortedEntries.begin(), sortedEntries.end(), CompareTxIterByAncestorCount());
 }
 
+// Carry over the transactions of a template built on the same tip. A
+// transaction is kept only if it is still in the mempool (which also drops
+// the WT^ payouts and the critical fee tx, they are regenerated) and all of
+// its in-mempool parents have been kept before it, so the previous order
+// stays valid. addPackageTxs() then fills the block from the modified
+// ancestor state of what is already inBlock.
+int BlockAssembler::addTemplateTxs(const CBlockTemplate& prevTemplate, bool fDrivechainEnabled, bool& fNeedCriticalFeeTx)
+{
+    int nAdded = 0;
+    for (size_t i = 1; i < prevTemplate.block.vtx.size(); i++) {
+        CTxMemPool::txiter it = mempool.mapTx.find(prevTemplate.block.vtx[i]->GetHash());
+        if (it == mempool.mapTx.end() || inBlock.count(it))
+            continue;
+
+        bool fParentsInBlock = true;
+        for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(it)) {
+            if (!inBlock.count(parent)) {
+                fParentsInBlock = false;
+                break;
+            }
+        }
+        if (!fParentsInBlock)
+            continue;
+
+        if (!TestPackage(it->GetTxSize(), it->GetSigOpCost()))
+            continue;
+        if (!TestPackageTransactions(CTxMemPool::setEntries{it}))
+            continue;
+
+        AddToBlock(it);
+        ++nAdded;
+
+        if (fDrivechainEnabled && it->HasCriticalData())
+            fNeedCriticalFeeTx = true;
+    }
+    return nAdded;
+}
+
 // This transaction selection algorithm orders the mempool based
 // on feerate of a transaction including all unconfirmed ancestors.
 // Since we don't remove transactions from the mempool as we select them
@@ -155,8 +155,12 @@ public:
     explicit BlockAssembler(const CChainParams& params);
     BlockAssembler(const CChainParams& params, const Options& options);
 
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
-    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx=true);
+    /** Construct a new block template with coinbase to scriptPubKeyIn. If
+      * pprevTemplate was built on the current tip, its transactions that are
+      * still in the mempool are carried over before the remaining space is
+      * filled by feerate, instead of reselecting the whole block. Such an
+      * extension is only checked with CheckBlock, not TestBlockValidity. */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx=true, const CBlockTemplate* pprevTemplate=nullptr);
 
 private:
     // utility functions
@@ -166,6 +170,9 @@ private:
     void AddToBlock(CTxMemPool::txiter iter);
 
     // Methods for how to add transactions to a block.
+    /** Add the mempool transactions of a previous template on the same tip,
+      * in their previous order. Returns the number of transactions added. */
+    int addTemplateTxs(const CBlockTemplate& prevTemplate, bool fDrivechainEnabled, bool& fNeedCriticalFeeTx);
     /** Add transactions based on feerate including unconfirmed ancestors
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
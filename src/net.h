@@ -115,6 +115,20 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/** Reference-counted, immutable serialized buffer. The same buffer can be
+ *  queued for sending to any number of peers without being copied. */
+typedef std::shared_ptr<const std::vector<unsigned char>> CNetMsgBufferRef;
+
+/** A framed network message (header and payload) which is shared between
+ *  peers. Build it once with CConnman::MakeSharedMessage and push it to each
+ *  peer to relay the same data to many nodes. */
+struct CSharedNetMsg
+{
+    std::string command;
+    CNetMsgBufferRef header;
+    CNetMsgBufferRef data; //!< null for messages without payload
+};
+
 class NetEventsInterface;
 class CConnman
 {
@@ -185,6 +199,12 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
+
+    /** Frame a serialized message once so it can be pushed to many peers.
+     *  The header (including the payload checksum) does not depend on the
+     *  peer, so both buffers are shared by reference. */
+    static CSharedNetMsg MakeSharedMessage(CSerializedNetMsg&& msg);
 
     template<typename Callable>
     void ForEachNode(Callable&& func)
@@ -609,7 +629,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<CNetMsgBufferRef> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -14,6 +14,9 @@
 
 static constexpr double INF_FEERATE = 1e99;
 
+/** Fold the pending decay into the moving averages once it drops below this */
+static constexpr double MIN_PENDING_DECAY = 1e-9;
+
 std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon) {
     static const std::map<FeeEstimateHorizon, std::string> horizon_strings = {
         {FeeEstimateHorizon::SHORT_HALFLIFE, "short"},
@@ -76,6 +79,14 @@ private:
     const std::vector<double>& buckets;              // The upper-bound of the range for the bucket (inclusive)
     const std::map<double, unsigned int>& bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
 
+    // The moving averages below are stored divided by pendingDecay, the
+    // product of the decays applied since they were last normalized, so that
+    // decaying them for a new block is a single multiplication. New data
+    // points are added scaled up by 1 / pendingDecay.
+    size_t nBuckets;
+    unsigned int maxPeriods;
+    double pendingDecay;
+
     // For each bucket X:
     // Count the total # of txs in each bucket
     // Track the historical moving average of this total over blocks
@@ -83,11 +94,11 @@ private:
 
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of theses totals over blocks
-    std::vector<std::vector<double>> confAvg; // confAvg[Y][X]
+    std::vector<double> confAvg; // confAvg[Y * nBuckets + X]
 
     // Track moving avg of txs which have been evicted from the mempool
     // after failing to be confirmed within Y blocks
-    std::vector<std::vector<double>> failAvg; // failAvg[Y][X]
+    std::vector<double> failAvg; // failAvg[Y * nBuckets + X]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
@@ -110,6 +121,9 @@ private:
 
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Apply pendingDecay to the stored moving averages and reset it */
+    void Normalize();
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -159,7 +173,7 @@ public:
                              EstimationResult *result = nullptr) const;
 
     /** Return the max number of confirms we're tracking */
-    unsigned int GetMaxConfirms() const { return scale * confAvg.size(); }
+    unsigned int GetMaxConfirms() const { return scale * maxPeriods; }
 
     /** Write state of estimation data to a file*/
     void Write(CAutoFile& fileout) const;
@@ -174,20 +188,14 @@ public:
 
 TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
                                 const std::map<double, unsigned int>& defaultBucketMap,
-                               unsigned int maxPeriods, double _decay, unsigned int _scale)
-    : buckets(defaultBuckets), bucketMap(defaultBucketMap)
+                               unsigned int _maxPeriods, double _decay, unsigned int _scale)
+    : buckets(defaultBuckets), bucketMap(defaultBucketMap), nBuckets(defaultBuckets.size()), maxPeriods(_maxPeriods), pendingDecay(1)
 {
     decay = _decay;
     assert(_scale != 0 && "_scale must be non-zero");
     scale = _scale;
-    confAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        confAvg[i].resize(buckets.size());
-    }
-    failAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        failAvg[i].resize(buckets.size());
-    }
+    confAvg.resize(maxPeriods * nBuckets);
+    failAvg.resize(maxPeriods * nBuckets);
 
     txCtAvg.resize(buckets.size());
     avg.resize(buckets.size());
@@ -221,23 +229,32 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
         return;
     int periodsToConfirm = (blocksToConfirm + scale - 1)/scale;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+    double weight = 1 / pendingDecay;
+    for (size_t i = periodsToConfirm; i <= maxPeriods; i++) {
+        confAvg[(i - 1) * nBuckets + bucketindex] += weight;
     }
-    txCtAvg[bucketindex]++;
-    avg[bucketindex] += val;
+    txCtAvg[bucketindex] += weight;
+    avg[bucketindex] += val * weight;
 }
 
 void TxConfirmStats::UpdateMovingAverages()
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay;
-        for (unsigned int i = 0; i < failAvg.size(); i++)
-            failAvg[i][j] = failAvg[i][j] * decay;
-        avg[j] = avg[j] * decay;
-        txCtAvg[j] = txCtAvg[j] * decay;
-    }
+    pendingDecay *= decay;
+    if (pendingDecay < MIN_PENDING_DECAY)
+        Normalize();
+}
+
+void TxConfirmStats::Normalize()
+{
+    for (double& v : confAvg)
+        v *= pendingDecay;
+    for (double& v : failAvg)
+        v *= pendingDecay;
+    for (double& v : avg)
+        v *= pendingDecay;
+    for (double& v : txCtAvg)
+        v *= pendingDecay;
+    pendingDecay = 1;
 }
 
 // returns -1 on error conditions
@@ -285,9 +302,9 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
-        totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
+        nConf += confAvg[(periodTarget - 1) * nBuckets + bucket] * pendingDecay;
+        totalNum += txCtAvg[bucket] * pendingDecay;
+        failNum += failAvg[(periodTarget - 1) * nBuckets + bucket] * pendingDecay;
         for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
             extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
         extraNum += oldUnconfTxs[bucket];
@@ -345,13 +362,13 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int minBucket = std::min(bestNearBucket, bestFarBucket);
     unsigned int maxBucket = std::max(bestNearBucket, bestFarBucket);
     for (unsigned int j = minBucket; j <= maxBucket; j++) {
-        txSum += txCtAvg[j];
+        txSum += txCtAvg[j] * pendingDecay;
     }
     if (foundAnswer && txSum != 0) {
         txSum = txSum / 2;
         for (unsigned int j = minBucket; j <= maxBucket; j++) {
-            if (txCtAvg[j] < txSum)
-                txSum -= txCtAvg[j];
+            if (txCtAvg[j] * pendingDecay < txSum)
+                txSum -= txCtAvg[j] * pendingDecay;
             else { // we're in the right bucket
                 median = avg[j] / txCtAvg[j];
                 break;
@@ -395,12 +412,26 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
 
 void TxConfirmStats::Write(CAutoFile& fileout) const
 {
+    // The file stores the decayed averages, with per-period rows
+    auto decayed = [this](const std::vector<double>& v) {
+        std::vector<double> ret(v);
+        for (double& x : ret)
+            x *= pendingDecay;
+        return ret;
+    };
+    auto rows = [this, &decayed](const std::vector<double>& v) {
+        std::vector<std::vector<double>> ret(maxPeriods);
+        for (unsigned int i = 0; i < maxPeriods; i++) {
+            ret[i] = decayed(std::vector<double>(v.begin() + i * nBuckets, v.begin() + (i + 1) * nBuckets));
+        }
+        return ret;
+    };
     fileout << decay;
     fileout << scale;
-    fileout << avg;
-    fileout << txCtAvg;
-    fileout << confAvg;
-    fileout << failAvg;
+    fileout << decayed(avg);
+    fileout << decayed(txCtAvg);
+    fileout << rows(confAvg);
+    fileout << rows(failAvg);
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -408,7 +439,8 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     // Read data file and do some very basic sanity checking
     // buckets and bucketMap are not updated yet, so don't access them
     // If there is a read failure, we'll just discard this entire object anyway
-    size_t maxConfirms, maxPeriods;
+    size_t maxConfirms;
+    std::vector<std::vector<double>> fileConfAvg, fileFailAvg;
 
     // The current version will store the decay with each individual TxConfirmStats and also keep a scale factor
     filein >> decay;
@@ -428,29 +460,38 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     if (txCtAvg.size() != numBuckets) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
     }
-    filein >> confAvg;
-    maxPeriods = confAvg.size();
+    filein >> fileConfAvg;
+    maxPeriods = fileConfAvg.size();
     maxConfirms = scale * maxPeriods;
 
     if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) { // one week
         throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (confAvg[i].size() != numBuckets) {
+        if (fileConfAvg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
         }
     }
 
-    filein >> failAvg;
-    if (maxPeriods != failAvg.size()) {
+    filein >> fileFailAvg;
+    if (maxPeriods != fileFailAvg.size()) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in confirms tracked for failures");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (failAvg[i].size() != numBuckets) {
+        if (fileFailAvg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in one of failure average bucket counts");
         }
     }
 
+    nBuckets = numBuckets;
+    pendingDecay = 1;
+    confAvg.clear();
+    failAvg.clear();
+    for (unsigned int i = 0; i < maxPeriods; i++) {
+        confAvg.insert(confAvg.end(), fileConfAvg[i].begin(), fileConfAvg[i].end());
+        failAvg.insert(failAvg.end(), fileFailAvg[i].begin(), fileFailAvg[i].end());
+    }
+
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
     resizeInMemoryCounters(numBuckets);
@@ -498,8 +539,8 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         assert(scale != 0);
         unsigned int periodsAgo = blocksAgo / scale;
-        for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+        for (size_t i = 0; i < periodsAgo && i < maxPeriods; i++) {
+            failAvg[i * nBuckets + bucketindex] += 1 / pendingDecay;
         }
     }
 }
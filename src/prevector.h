@@ -51,6 +51,7 @@ public:
         typedef T* pointer;
         typedef T& reference;
         typedef std::random_access_iterator_tag iterator_category;
+        typedef std::true_type is_contiguous;
         iterator(T* ptr_) : ptr(ptr_) {}
         T& operator*() const { return *ptr; }
         T* operator->() const { return ptr; }
@@ -102,6 +103,7 @@ public:
         typedef const T* pointer;
         typedef const T& reference;
         typedef std::random_access_iterator_tag iterator_category;
+        typedef std::true_type is_contiguous;
         const_iterator(const T* ptr_) : ptr(ptr_) {}
         const_iterator(iterator x) : ptr(&(*x)) {}
         const T& operator*() const { return *ptr; }
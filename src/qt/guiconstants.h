@@ -8,6 +8,9 @@
 /* Milliseconds between model updates */
 static const int MODEL_UPDATE_DELAY = 250;
 
+/* Transaction list -- Wallet transactions decomposed per fetch */
+static const int TRANSACTION_FETCH_BATCH_SIZE = 500;
+
 /* AskPassphraseDialog -- Maximum passphrase length */
 static const int MAX_PASSPHRASE_SIZE = 1024;
 
@@ -22,6 +22,7 @@
 #include <QAction>
 #include <QApplication>
 #include <QCheckBox>
+#include <QDateTime>
 #include <QPushButton>
 #include <QTimer>
 #include <QVBoxLayout>
@@ -97,6 +98,55 @@ QModelIndex FindTx(const QAbstractItemModel& model, const uint256& txid)
     return {};
 }
 
+//! Count the rows of a transaction in the transaction table.
+int CountTxRows(const QAbstractItemModel& model, const uint256& txid)
+{
+    QString hash = QString::fromStdString(txid.ToString());
+    int count = 0;
+    for (int row = 0; row < model.rowCount({}); ++row) {
+        if (model.data(model.index(row, 0, {}), TransactionTableModel::TxHashRole) == hash) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+//! Check that a new transaction table is filled newest first, and that
+//! notifications for transactions not fetched yet are handled.
+void TestLazyTransactionTable(CWallet& wallet, WalletModel& walletModel, const PlatformStyle* platformStyle, const uint256& txidNotified, const uint256& txidDeleted)
+{
+    TransactionTableModel* fullModel = walletModel.getTransactionTableModel();
+    fullModel->fetchAll();
+    QVERIFY(!fullModel->canFetchMore({}));
+
+    TransactionTableModel model(platformStyle, &wallet, &walletModel);
+    QCOMPARE(model.rowCount({}), 0);
+    QVERIFY(model.canFetchMore({}));
+
+    // A notified transaction is added right away, and skipped when fetched
+    model.updateTransaction(QString::fromStdString(txidNotified.ToString()), CT_NEW, true);
+    QCOMPARE(CountTxRows(model, txidNotified), CountTxRows(*fullModel, txidNotified));
+    const int notifiedRows = model.rowCount({});
+    QVERIFY(notifiedRows > 0);
+
+    // Deleting a transaction that was not fetched leaves the rows alone
+    model.updateTransaction(QString::fromStdString(txidDeleted.ToString()), CT_DELETED, false);
+    QCOMPARE(model.rowCount({}), notifiedRows);
+
+    model.fetchAll();
+    QVERIFY(!model.canFetchMore({}));
+    QCOMPARE(model.rowCount({}), fullModel->rowCount({}));
+    QCOMPARE(CountTxRows(model, txidNotified), CountTxRows(*fullModel, txidNotified));
+    QCOMPARE(CountTxRows(model, txidDeleted), CountTxRows(*fullModel, txidDeleted));
+
+    // After the notified rows, transactions were fetched newest first
+    for (int row = notifiedRows + 1; row < model.rowCount({}); ++row) {
+        QDateTime previous = model.data(model.index(row - 1, 0, {}), TransactionTableModel::DateRole).toDateTime();
+        QDateTime current = model.data(model.index(row, 0, {}), TransactionTableModel::DateRole).toDateTime();
+        QVERIFY(current <= previous);
+    }
+}
+
 //! Request context menu (call method that is public in qt5, but protected in qt4).
 void RequestContextMenu(QWidget* widget)
 {
@@ -186,6 +236,8 @@ void TestGUI()
 
     // Send two transactions, and verify they are added to transaction list.
     TransactionTableModel* transactionTableModel = walletModel.getTransactionTableModel();
+    QCOMPARE(transactionTableModel->rowCount({}), 0);
+    transactionTableModel->fetchAll();
     QCOMPARE(transactionTableModel->rowCount({}), 105);
     uint256 txid1 = SendCoins(wallet, sendCoinsDialog, CKeyID(), 5 * COIN, false /* rbf */);
     uint256 txid2 = SendCoins(wallet, sendCoinsDialog, CKeyID(), 10 * COIN, true /* rbf */);
@@ -199,6 +251,8 @@ void TestGUI()
     BumpFee(transactionView, txid2, false /* expect disabled */, {} /* expected error */, false /* cancel */);
     BumpFee(transactionView, txid2, true /* expect disabled */, "already bumped" /* expected error */, false /* cancel */);
 
+    TestLazyTransactionTable(wallet, walletModel, platformStyle.get(), txid1, txid2);
+
     // Check current balance on OverviewPage
     OverviewPage overviewPage(platformStyle.get());
     overviewPage.setWalletModel(&walletModel);
@@ -115,3 +115,11 @@ int TransactionFilterProxy::rowCount(const QModelIndex &parent) const
         return QSortFilterProxyModel::rowCount(parent);
     }
 }
+
+bool TransactionFilterProxy::canFetchMore(const QModelIndex &parent) const
+{
+    // The source fetches newest first, so a limited list is complete once full
+    if(limitRows != -1 && QSortFilterProxyModel::rowCount(parent) >= limitRows)
+        return false;
+    return QSortFilterProxyModel::canFetchMore(parent);
+}
@@ -50,6 +50,7 @@ public:
     void setShowInactive(bool showInactive);
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    bool canFetchMore(const QModelIndex &parent) const;
 
 protected:
     bool filterAcceptsRow(int source_row, const QModelIndex & source_parent) const;
@@ -26,6 +26,8 @@
 #include <QIcon>
 #include <QList>
 
+#include <algorithm>
+
 // Amount column is right-aligned it contains numbers
 static int column_alignments[] = {
         Qt::AlignLeft|Qt::AlignVCenter, /* replay status */
@@ -37,23 +39,6 @@ static int column_alignments[] = {
         Qt::AlignRight|Qt::AlignVCenter /* amount */
     };
 
-// Comparison operator for sort/binary search of model tx list
-struct TxLessThan
-{
-    bool operator()(const TransactionRecord &a, const TransactionRecord &b) const
-    {
-        return a.hash < b.hash;
-    }
-    bool operator()(const TransactionRecord &a, const uint256 &b) const
-    {
-        return a.hash < b;
-    }
-    bool operator()(const uint256 &a, const TransactionRecord &b) const
-    {
-        return a < b.hash;
-    }
-};
-
 // Private implementation
 class TransactionTablePriv
 {
@@ -68,25 +53,89 @@ public:
     TransactionTableModel *parent;
 
     /* Local cache of wallet.
-     * As it is in the same order as the CWallet, by definition
-     * this is sorted by sha256.
+     * Rows are in the order they were fetched, all records of one
+     * transaction are adjacent.
      */
     QList<TransactionRecord> cachedWallet;
 
-    /* Query entire wallet anew from core.
+    /* First row and number of rows of each transaction in cachedWallet.
+     */
+    std::map<uint256, std::pair<int, int> > mapRows;
+
+    /* Wallet transactions that are not decomposed yet, sorted by time so
+     * that the newest one is at the back and gets fetched first.
+     */
+    std::vector<uint256> vPending;
+
+    /* Query the transaction index anew from core. Records are only
+       created when fetched.
      */
     void refreshWallet()
     {
         qDebug() << "TransactionTablePriv::refreshWallet";
         cachedWallet.clear();
+        mapRows.clear();
+        vPending.clear();
+
+        std::vector<std::pair<int64_t, uint256> > vKeys;
         {
-            LOCK2(cs_main, wallet->cs_wallet);
+            LOCK(wallet->cs_wallet);
+            vKeys.reserve(wallet->mapWallet.size());
             for (const auto& entry : wallet->mapWallet)
+                vKeys.emplace_back(entry.second.GetTxTime(), entry.first);
+        }
+        std::sort(vKeys.begin(), vKeys.end());
+
+        vPending.reserve(vKeys.size());
+        for (const auto& key : vKeys)
+            vPending.push_back(key.second);
+    }
+
+    bool canFetchMore() const
+    {
+        return !vPending.empty();
+    }
+
+    /* Decompose up to nMax pending transactions and append their records.
+     */
+    void fetchMore(int nMax)
+    {
+        QList<TransactionRecord> toInsert;
+        std::vector<std::pair<uint256, int> > vFetched;
+        {
+            LOCK2(cs_main, wallet->cs_wallet);
+            for (int i = 0; i < nMax && !vPending.empty(); i++)
             {
-                if (TransactionRecord::showTransaction(entry.second))
-                    cachedWallet.append(TransactionRecord::decomposeTransaction(wallet, entry.second));
+                uint256 hash = vPending.back();
+                vPending.pop_back();
+
+                // Already added by a notification
+                if (mapRows.count(hash))
+                    continue;
+
+                std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(hash);
+                if (mi == wallet->mapWallet.end() || !TransactionRecord::showTransaction(mi->second))
+                    continue;
+
+                QList<TransactionRecord> records = TransactionRecord::decomposeTransaction(wallet, mi->second);
+                if (records.isEmpty())
+                    continue;
+                vFetched.emplace_back(hash, records.size());
+                toInsert.append(records);
             }
         }
+        if (toInsert.isEmpty())
+            return;
+
+        int row = cachedWallet.size();
+        parent->beginInsertRows(QModelIndex(), row, row + toInsert.size() - 1);
+        for (const auto& fetched : vFetched)
+        {
+            mapRows[fetched.first] = std::make_pair(row, fetched.second);
+            row += fetched.second;
+        }
+        cachedWallet.append(toInsert);
+        parent->endInsertRows();
     }
 
     /* Update our model of the wallet incrementally, to synchronize our model of the wallet
@@ -98,14 +147,11 @@ public:
     {
         qDebug() << "TransactionTablePriv::updateWallet: " + QString::fromStdString(hash.ToString()) + " " + QString::number(status);
 
-        // Find bounds of this transaction in model
-        QList<TransactionRecord>::iterator lower = qLowerBound(
-            cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-        QList<TransactionRecord>::iterator upper = qUpperBound(
-            cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-        int lowerIndex = (lower - cachedWallet.begin());
-        int upperIndex = (upper - cachedWallet.begin());
-        bool inModel = (lower != upper);
+        // Find rows of this transaction in model
+        std::map<uint256, std::pair<int, int> >::iterator it = mapRows.find(hash);
+        bool inModel = (it != mapRows.end());
+        int lowerIndex = inModel ? it->second.first : cachedWallet.size();
+        int upperIndex = inModel ? it->second.first + it->second.second : cachedWallet.size();
 
         if(status == CT_UPDATED)
         {
@@ -137,18 +183,14 @@ public:
                     qWarning() << "TransactionTablePriv::updateWallet: Warning: Got CT_NEW, but transaction is not in wallet";
                     break;
                 }
-                // Added -- insert at the right position
+                // Added -- append, the views sort on their own
                 QList<TransactionRecord> toInsert =
                         TransactionRecord::decomposeTransaction(wallet, mi->second);
                 if(!toInsert.isEmpty()) /* only if something to insert */
                 {
                     parent->beginInsertRows(QModelIndex(), lowerIndex, lowerIndex+toInsert.size()-1);
-                    int insert_idx = lowerIndex;
-                    for (const TransactionRecord &rec : toInsert)
-                    {
-                        cachedWallet.insert(insert_idx, rec);
-                        insert_idx += 1;
-                    }
+                    mapRows[hash] = std::make_pair(lowerIndex, toInsert.size());
+                    cachedWallet.append(toInsert);
                     parent->endInsertRows();
                 }
             }
@@ -156,12 +198,18 @@ public:
         case CT_DELETED:
             if(!inModel)
             {
-                qWarning() << "TransactionTablePriv::updateWallet: Warning: Got CT_DELETED, but transaction is not in model";
+                // Not fetched yet, it is skipped when it is.
                 break;
             }
             // Removed -- remove entire transaction from table
             parent->beginRemoveRows(QModelIndex(), lowerIndex, upperIndex-1);
-            cachedWallet.erase(lower, upper);
+            cachedWallet.erase(cachedWallet.begin() + lowerIndex, cachedWallet.begin() + upperIndex);
+            mapRows.erase(it);
+            for (auto& rows : mapRows)
+            {
+                if (rows.second.first > lowerIndex)
+                    rows.second.first -= upperIndex - lowerIndex;
+            }
             parent->endRemoveRows();
             break;
         case CT_UPDATED:
@@ -178,17 +226,11 @@ public:
     void updateWalletReplayStatus(const uint256 &hash, int replayStatus)
     {
         qDebug() << "TransactionTablePriv::updateWalletReplayStatus: " + QString::fromStdString(hash.ToString()) + " " + QString::number(replayStatus);
-        // Find bounds of this transaction in model
-        QList<TransactionRecord>::iterator lower = qLowerBound(
-            cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-        QList<TransactionRecord>::iterator upper = qUpperBound(
-            cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-        int lowerIndex = (lower - cachedWallet.begin());
-        int upperIndex = (upper - cachedWallet.begin());
-        bool inModel = (lower != upper);
-        if (!inModel)
+        // Find rows of this transaction in model
+        std::map<uint256, std::pair<int, int> >::iterator it = mapRows.find(hash);
+        if (it == mapRows.end())
             return;
-        for (int i = lowerIndex; i < upperIndex; i++) {
+        for (int i = it->second.first; i < it->second.first + it->second.second; i++) {
             TransactionRecord *rec = &cachedWallet[i];
             rec->status.needsUpdate = true;
             rec->status.replay_status = (TransactionStatus::ReplayStatus)replayStatus;
@@ -320,6 +362,30 @@ void TransactionTableModel::updateConfirmations()
     Q_EMIT dataChanged(index(0, ToAddress), index(priv->size()-1, ToAddress));
 }
 
+bool TransactionTableModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return false;
+    return priv->canFetchMore();
+}
+
+void TransactionTableModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid())
+        return;
+    // Older transactions coming into view are not new to the user
+    bool fWasProcessingQueued = fProcessingQueuedTransactions;
+    fProcessingQueuedTransactions = true;
+    priv->fetchMore(TRANSACTION_FETCH_BATCH_SIZE);
+    fProcessingQueuedTransactions = fWasProcessingQueued;
+}
+
+void TransactionTableModel::fetchAll()
+{
+    while (canFetchMore(QModelIndex()))
+        fetchMore(QModelIndex());
+}
+
 int TransactionTableModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
@@ -84,6 +84,11 @@ public:
     QVariant data(const QModelIndex &index, int role) const;
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
     QModelIndex index(int row, int column, const QModelIndex & parent = QModelIndex()) const;
+    /** Rows are decomposed from the wallet on demand, newest transactions first */
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+    /** Decompose all remaining transactions, e.g. before an export */
+    void fetchAll();
     bool processingQueuedTransactions() const { return fProcessingQueuedTransactions; }
 
 private:
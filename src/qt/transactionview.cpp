@@ -428,6 +428,9 @@ void TransactionView::exportClicked()
     if (filename.isNull())
         return;
 
+    // Rows are loaded on demand, export them all
+    model->getTransactionTableModel()->fetchAll();
+
     CSVModelWriter writer(filename);
 
     // name, column, role
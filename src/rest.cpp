@@ -9,6 +9,7 @@
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <validation.h>
+#include <httprpc.h>
 #include <httpserver.h>
 #include <rpc/blockchain.h>
 #include <rpc/server.h>
@@ -242,14 +243,9 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_JSON: {
-        UniValue objBlock;
-        {
-            LOCK(cs_main);
-            objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        }
-        std::string strJSON = objBlock.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        HTTPJSONWriter writer(req);
+        blockToJSON(block, pblockindex, showTxDetails, writer);
+        writer.Finish();
         return true;
     }
 
@@ -326,11 +322,9 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
 
     switch (rf) {
     case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        std::string strJSON = mempoolObject.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        HTTPJSONWriter writer(req);
+        mempoolToJSON(true, writer);
+        writer.Finish();
         return true;
     }
     default: {
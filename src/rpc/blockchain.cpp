@@ -16,6 +16,7 @@
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
+#include <rpc/jsonstream.h>
 #include <rpc/server.h>
 #include <streams.h>
 #include <sync.h>
@@ -113,51 +114,80 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
+/** The fields of blockToJSON that come before and after the "tx" array */
+static void blockFieldsToJSON(const CBlock& block, const CBlockIndex* blockindex, UniValue& before, UniValue& after)
 {
     AssertLockHeld(cs_main);
-    UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
+    before.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
     if (chainActive.Contains(blockindex))
         confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("strippedsize", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("weight", (int)::GetBlockWeight(block)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    UniValue txs(UniValue::VARR);
-    for(const auto& tx : block.vtx)
-    {
-        if(txDetails)
-        {
-            UniValue objTx(UniValue::VOBJ);
-            TxToUniv(*tx, uint256(), objTx, true, RPCSerializationFlags());
-            txs.push_back(objTx);
-        }
-        else
-            txs.push_back(tx->GetHash().GetHex());
-    }
-    result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    before.push_back(Pair("confirmations", confirmations));
+    before.push_back(Pair("strippedsize", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)));
+    before.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
+    before.push_back(Pair("weight", (int)::GetBlockWeight(block)));
+    before.push_back(Pair("height", blockindex->nHeight));
+    before.push_back(Pair("version", block.nVersion));
+    before.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
+    before.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
+    after.push_back(Pair("time", block.GetBlockTime()));
+    after.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
+    after.push_back(Pair("nonce", (uint64_t)block.nNonce));
+    after.push_back(Pair("bits", strprintf("%08x", block.nBits)));
+    after.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    after.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+        after.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
     CBlockIndex *pnext = chainActive.Next(blockindex);
     if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+        after.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+}
+
+static UniValue blockTxToJSON(const CTransaction& tx, bool txDetails)
+{
+    if (!txDetails)
+        return tx.GetHash().GetHex();
+    UniValue objTx(UniValue::VOBJ);
+    TxToUniv(tx, uint256(), objTx, true, RPCSerializationFlags());
+    return objTx;
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
+{
+    UniValue result(UniValue::VOBJ);
+    UniValue after(UniValue::VOBJ);
+    blockFieldsToJSON(block, blockindex, result, after);
+    UniValue txs(UniValue::VARR);
+    for(const auto& tx : block.vtx)
+        txs.push_back(blockTxToJSON(*tx, txDetails));
+    result.push_back(Pair("tx", txs));
+    result.pushKVs(after);
     return result;
 }
 
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, JSONStreamWriter& writer)
+{
+    // Writing may wait for the client, so only hold cs_main for the fields
+    // that read the chain
+    UniValue before(UniValue::VOBJ);
+    UniValue after(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        blockFieldsToJSON(block, blockindex, before, after);
+    }
+    writer.BeginObject();
+    writer.Pairs(before);
+    writer.Key("tx");
+    writer.BeginArray();
+    for (const auto& tx : block.vtx)
+        writer.Value(blockTxToJSON(*tx, txDetails));
+    writer.EndArray();
+    writer.Pairs(after);
+    writer.EndObject();
+}
+
 UniValue getblockcount(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -436,6 +466,47 @@ UniValue mempoolToJSON(bool fVerbose)
     }
 }
 
+void mempoolToJSON(bool fVerbose, JSONStreamWriter& writer)
+{
+    if (fVerbose)
+    {
+        // Writing may wait for the client, so don't hold mempool.cs across
+        // it. Entries removed after the snapshot are left out.
+        std::vector<uint256> vtxid;
+        {
+            LOCK(mempool.cs);
+            vtxid.reserve(mempool.mapTx.size());
+            for (const CTxMemPoolEntry& e : mempool.mapTx)
+                vtxid.push_back(e.GetTx().GetHash());
+        }
+        writer.BeginObject();
+        for (const uint256& hash : vtxid)
+        {
+            UniValue info(UniValue::VOBJ);
+            {
+                LOCK(mempool.cs);
+                CTxMemPool::txiter it = mempool.mapTx.find(hash);
+                if (it == mempool.mapTx.end())
+                    continue;
+                entryToJSON(info, *it);
+            }
+            writer.Key(hash.ToString());
+            writer.Value(info);
+        }
+        writer.EndObject();
+    }
+    else
+    {
+        std::vector<uint256> vtxid;
+        mempool.queryHashes(vtxid);
+
+        writer.BeginArray();
+        for (const uint256& hash : vtxid)
+            writer.Value(hash.ToString());
+        writer.EndArray();
+    }
+}
+
 UniValue getrawmempool(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -468,6 +539,20 @@ UniValue getrawmempool(const JSONRPCRequest& request)
     return mempoolToJSON(fVerbose);
 }
 
+static void getrawmempool_stream(const JSONRPCRequest& request, JSONStreamWriter& writer)
+{
+    if (request.params.size() > 1) {
+        getrawmempool(request); // throws the usage message
+        return;
+    }
+
+    bool fVerbose = false;
+    if (!request.params[0].isNull())
+        fVerbose = request.params[0].get_bool();
+
+    mempoolToJSON(fVerbose, writer);
+}
+
 UniValue getmempoolancestors(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2) {
@@ -713,6 +798,41 @@ UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(pblockindex);
 }
 
+/** Parse the arguments of getblock and read the requested block */
+static const CBlockIndex* ReadBlockForRequest(const JSONRPCRequest& request, CBlock& block, int& verbosity)
+{
+    AssertLockHeld(cs_main);
+
+    std::string strHash = request.params[0].get_str();
+    uint256 hash(uint256S(strHash));
+
+    verbosity = 1;
+    if (!request.params[1].isNull()) {
+        if(request.params[1].isNum())
+            verbosity = request.params[1].get_int();
+        else
+            verbosity = request.params[1].get_bool() ? 1 : 0;
+    }
+
+    if (mapBlockIndex.count(hash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    CBlockIndex* pblockindex = mapBlockIndex[hash];
+
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+
+    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        // Block not found on disk. This could be because we have the block
+        // header in our index but don't have the block (for example if a
+        // non-whitelisted node sends us an unrequested long chain of valid
+        // blocks, we add the headers to our index, but don't accept the
+        // block).
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+
+    return pblockindex;
+}
+
 UniValue getblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
@@ -765,43 +885,45 @@ UniValue getblock(const JSONRPCRequest& request)
 
     LOCK(cs_main);
 
-    std::string strHash = request.params[0].get_str();
-    uint256 hash(uint256S(strHash));
+    CBlock block;
+    int verbosity;
+    const CBlockIndex* pblockindex = ReadBlockForRequest(request, block, verbosity);
 
-    int verbosity = 1;
-    if (!request.params[1].isNull()) {
-        if(request.params[1].isNum())
-            verbosity = request.params[1].get_int();
-        else
-            verbosity = request.params[1].get_bool() ? 1 : 0;
+    if (verbosity <= 0)
+    {
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+        ssBlock << block;
+        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        return strHex;
     }
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    return blockToJSON(block, pblockindex, verbosity >= 2);
+}
 
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+static void getblock_stream(const JSONRPCRequest& request, JSONStreamWriter& writer)
+{
+    if (request.params.size() < 1 || request.params.size() > 2) {
+        getblock(request); // throws the usage message
+        return;
+    }
 
-    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-        // Block not found on disk. This could be because we have the block
-        // header in our index but don't have the block (for example if a
-        // non-whitelisted node sends us an unrequested long chain of valid
-        // blocks, we add the headers to our index, but don't accept the
-        // block).
-        throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+    CBlock block;
+    int verbosity;
+    const CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        pblockindex = ReadBlockForRequest(request, block, verbosity);
+    }
 
     if (verbosity <= 0)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
         ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        writer.Value(HexStr(ssBlock.begin(), ssBlock.end()));
+        return;
     }
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
+    blockToJSON(block, pblockindex, verbosity >= 2, writer);
 }
 
 struct CCoinsStats
@@ -1616,23 +1738,23 @@ UniValue savemempool(const JSONRPCRequest& request)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         argNames
+{ //  category              name                      actor (function)         argNames, concurrent, streamActor
   //  --------------------- ------------------------  -----------------------  ----------
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
-    { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
-    { "blockchain",         "getblockcount",          &getblockcount,          {} },
-    { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
-    { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
-    { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
-    { "blockchain",         "getchaintips",           &getchaintips,           {} },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
-    { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
-    { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
-    { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
-    { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {}, true },
+    { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"}, true },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       {}, true },
+    { "blockchain",         "getblockcount",          &getblockcount,          {}, true },
+    { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"}, true, &getblock_stream },
+    { "blockchain",         "getblockhash",           &getblockhash,           {"height"}, true },
+    { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"}, true },
+    { "blockchain",         "getchaintips",           &getchaintips,           {}, true },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          {}, true },
+    { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"}, true },
+    { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"}, true },
+    { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"}, true },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {}, true },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"}, true, &getrawmempool_stream },
+    { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"}, true },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
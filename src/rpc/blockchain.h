@@ -7,6 +7,7 @@
 
 class CBlock;
 class CBlockIndex;
+class JSONStreamWriter;
 class UniValue;
 
 /**
@@ -24,12 +25,19 @@ void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 /** Block description to JSON */
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
 
+/** Block description to JSON, streamed into writer. Takes cs_main itself, so
+ *  that it is not held while writing. */
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, JSONStreamWriter& writer);
+
 /** Mempool information to JSON */
 UniValue mempoolInfoToJSON();
 
 /** Mempool to JSON */
 UniValue mempoolToJSON(bool fVerbose = false);
 
+/** Mempool to JSON, streamed into writer without holding mempool.cs */
+void mempoolToJSON(bool fVerbose, JSONStreamWriter& writer);
+
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 
@@ -0,0 +1,105 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/jsonstream.h>
+
+#include <univalue.h>
+
+#include <assert.h>
+
+JSONStreamWriter::JSONStreamWriter(Sink sinkIn, size_t nFlushSizeIn)
+    : sink(std::move(sinkIn)), nFlushSize(nFlushSizeIn), fAfterKey(false), fFlushed(false)
+{
+}
+
+void JSONStreamWriter::Separate()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (vEmpty.empty())
+        return;
+    if (!vEmpty.back())
+        buffer += ',';
+    vEmpty.back() = false;
+}
+
+void JSONStreamWriter::Wrote()
+{
+    if (buffer.size() >= nFlushSize)
+        Flush();
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    Separate();
+    buffer += '{';
+    vEmpty.push_back(true);
+}
+
+void JSONStreamWriter::EndObject()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    buffer += '}';
+    Wrote();
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    Separate();
+    buffer += '[';
+    vEmpty.push_back(true);
+}
+
+void JSONStreamWriter::EndArray()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    buffer += ']';
+    Wrote();
+}
+
+void JSONStreamWriter::Key(const std::string& key)
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    Separate();
+    buffer += UniValue(key).write();
+    buffer += ':';
+    fAfterKey = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& val)
+{
+    Separate();
+    buffer += val.write();
+    Wrote();
+}
+
+void JSONStreamWriter::Pairs(const UniValue& obj)
+{
+    const std::vector<std::string>& keys = obj.getKeys();
+    const std::vector<UniValue>& values = obj.getValues();
+    for (size_t i = 0; i < keys.size(); i++) {
+        Key(keys[i]);
+        Value(values[i]);
+    }
+}
+
+void JSONStreamWriter::Flush()
+{
+    if (buffer.empty())
+        return;
+    sink(buffer);
+    buffer.clear();
+    fFlushed = true;
+}
+
+std::string JSONStreamWriter::Release()
+{
+    std::string ret;
+    ret.swap(buffer);
+    return ret;
+}
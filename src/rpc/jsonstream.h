@@ -0,0 +1,66 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class UniValue;
+
+/** Bytes buffered by JSONStreamWriter before they are handed to the sink */
+static const size_t DEFAULT_JSON_STREAM_FLUSH_SIZE = 64 * 1024;
+
+/**
+ * Incremental JSON emitter for responses too large to build as a single
+ * UniValue. Containers are opened and closed explicitly while leaf values
+ * (and small subtrees) are passed as UniValue. Output is byte-for-byte what
+ * UniValue::write() would produce for the same document, and is passed to
+ * the sink in pieces of roughly nFlushSize bytes.
+ */
+class JSONStreamWriter
+{
+public:
+    typedef std::function<void(const std::string&)> Sink;
+
+    explicit JSONStreamWriter(Sink sink, size_t nFlushSize = DEFAULT_JSON_STREAM_FLUSH_SIZE);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    /** Write an object key. Must be followed by a value or container. */
+    void Key(const std::string& key);
+    /** Write a complete value into the current array or after a Key. */
+    void Value(const UniValue& val);
+    /** Write all key/value pairs of obj into the current object. */
+    void Pairs(const UniValue& obj);
+
+    /** Hand everything buffered so far to the sink. */
+    void Flush();
+    /**
+     * Take the output buffered since the last flush instead of handing it to
+     * the sink, e.g. to send a small document in one piece.
+     */
+    std::string Release();
+    /** Whether any output has been handed to the sink yet. */
+    bool Flushed() const { return fFlushed; }
+
+private:
+    Sink sink;
+    size_t nFlushSize;
+    std::string buffer;
+    //! One entry per open container: whether it is still empty
+    std::vector<bool> vEmpty;
+    bool fAfterKey;
+    bool fFlushed;
+
+    void Separate();
+    void Wrote();
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
@@ -26,9 +26,24 @@
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <deque>
 #include <memory>
 #include <stdint.h>
 
+/** Seconds after which a mempool change makes getblocktemplate build a new
+  * template. A templatedelta longpoll waiting for mempool changes is answered
+  * no earlier than this after the last build, as an earlier answer would
+  * carry no new transactions. */
+static const int64_t TEMPLATE_REBUILD_INTERVAL = 5;
+/** Seconds after which getblocktemplate reselects all transactions instead of
+  * extending its previous template */
+static const int64_t TEMPLATE_FULL_REBUILD_INTERVAL = 30;
+/** Number of mempool additions and removals seen by RPCNotifyMempoolChange.
+  * Protected by csBestBlock. */
+static uint64_t nMempoolChanges = 0;
+/** Number of recent templates remembered for templatedelta replies */
+static const size_t MAX_TEMPLATE_HISTORY = 10;
+
 unsigned int ParseConfirmTarget(const UniValue& value)
 {
     int target = value.get_int();
@@ -343,7 +358,7 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             "     {\n"
             "       \"mode\":\"template\"    (string, optional) This must be set to \"template\", \"proposal\" (see BIP 23), or omitted\n"
             "       \"capabilities\":[     (array, optional) A list of strings\n"
-            "           \"support\"          (string) client side supported feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', 'proposal', 'serverlist', 'workid'\n"
+            "           \"support\"          (string) client side supported feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', 'proposal', 'serverlist', 'workid', 'templatedelta'\n"
             "           ,...\n"
             "       ],\n"
             "       \"rules\":[            (array, optional) A list of strings\n"
@@ -379,6 +394,11 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             "      }\n"
             "      ,...\n"
             "  ],\n"
+            "  \"delta\" : {                       (json object) replaces \"transactions\" for 'templatedelta' clients whose longpollid is still known. Their longpolls also return on mempool changes, at most once every " + std::to_string(TEMPLATE_REBUILD_INTERVAL) + " seconds\n"
+            "      \"longpollid\" : \"xxxx\",        (string) the template this delta applies to\n"
+            "      \"removed\" : [ \"txid\", ... ],  (array of strings) transactions to drop from that template\n"
+            "      \"added\" : [ { ... }, ... ]      (array) new transactions in the format of \"transactions\", with an extra \"index\" (1-based position in the new list)\n"
+            "  },\n"
             "  \"coinbaseaux\" : {                 (json object) data that should be included in the coinbase's scriptSig content\n"
             "      \"flags\" : \"xx\"                  (string) key name is to be ignored, and value included in scriptSig\n"
             "  },\n"
@@ -409,6 +429,7 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     std::string strMode = "template";
     UniValue lpval = NullUniValue;
     std::set<std::string> setClientRules;
+    std::set<std::string> setClientCaps;
     int64_t nMaxVersionPreVB = -1;
     if (!request.params[0].isNull())
     {
@@ -454,6 +475,15 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             return BIP22ValidationResult(state);
         }
 
+        const UniValue& aClientCaps = find_value(oparam, "capabilities");
+        if (aClientCaps.isArray()) {
+            for (unsigned int i = 0; i < aClientCaps.size(); ++i) {
+                const UniValue& v = aClientCaps[i];
+                if (v.isStr())
+                    setClientCaps.insert(v.get_str());
+            }
+        }
+
         const UniValue& aClientRules = find_value(oparam, "rules");
         if (aClientRules.isArray()) {
             for (unsigned int i = 0; i < aClientRules.size(); ++i) {
@@ -482,10 +512,14 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, "Bitcoin is downloading blocks...");
 
     static unsigned int nTransactionsUpdatedLast;
+    // Time the current template was built
+    static int64_t nLastTemplateBuild;
+    const bool fTemplateDelta = setClientCaps.count("templatedelta") > 0;
 
     if (!lpval.isNull())
     {
-        // Wait to respond until either the best block changes, OR a minute has passed and there are more transactions
+        // Wait to respond until either the best block changes, OR a minute has passed and there are more transactions.
+        // Clients taking deltas are answered as soon as the mempool changes and a new template may be built.
         uint256 hashWatchedChain;
         std::chrono::steady_clock::time_point checktxtime;
         unsigned int nTransactionsUpdatedLastLP;
@@ -505,18 +539,44 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
         }
 
+        // A delta is sent once the mempool changed and a new template may be built
+        const std::chrono::steady_clock::time_point rebuildtime = std::chrono::steady_clock::now() +
+            std::chrono::seconds(std::max<int64_t>(nLastTemplateBuild + TEMPLATE_REBUILD_INTERVAL + 1 - GetTime(), 0));
+
         // Release the wallet and main lock while waiting
         LEAVE_CRITICAL_SECTION(cs_main);
         {
             checktxtime = std::chrono::steady_clock::now() + std::chrono::minutes(1);
 
+            // Changes counted from here on wake the wait below. Earlier ones
+            // are seen in the mempool's counter, which must not be read
+            // under csBestBlock: RPCNotifyMempoolChange takes it with
+            // mempool.cs held.
+            uint64_t nMempoolChangesLP;
+            {
+                WaitableLock lock(csBestBlock);
+                nMempoolChangesLP = nMempoolChanges;
+            }
+            bool fMempoolChanged = mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP;
+
             WaitableLock lock(csBestBlock);
             while (chainActive.Tip()->GetBlockHash() == hashWatchedChain && IsRPCRunning())
             {
+                if (fTemplateDelta) {
+                    fMempoolChanged |= nMempoolChanges != nMempoolChangesLP;
+                    if (fMempoolChanged && std::chrono::steady_clock::now() >= rebuildtime)
+                        break;
+                    if (cvBlockChange.wait_until(lock, fMempoolChanged ? rebuildtime : checktxtime) == std::cv_status::timeout && !fMempoolChanged)
+                        checktxtime += std::chrono::seconds(10);
+                    continue;
+                }
                 if (cvBlockChange.wait_until(lock, checktxtime) == std::cv_status::timeout)
                 {
                     // Timeout: Check transactions for update
-                    if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP)
+                    lock.unlock();
+                    bool fUpdated = mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP;
+                    lock.lock();
+                    if (fUpdated)
                         break;
                     checktxtime += std::chrono::seconds(10);
                 }
@@ -537,32 +597,51 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
 
     // Update block
     static CBlockIndex* pindexPrev;
-    static int64_t nStart;
+    static int64_t nStart; // Time of the last full transaction selection
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
     // Cache whether the last invocation was with segwit support, to avoid returning
     // a segwit-block to a non-segwit caller.
     static bool fLastTemplateSupportsSegwit = true;
+    // Non-coinbase txids of recent templates on this tip, by longpollid
+    static std::deque<std::pair<std::string, std::vector<uint256>>> templateHistory;
     if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5) ||
+        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nLastTemplateBuild > TEMPLATE_REBUILD_INTERVAL) ||
         fLastTemplateSupportsSegwit != fSupportsSegwit)
     {
+        // Mempool changes on the same tip extend the previous template, with
+        // a full reselection at most every TEMPLATE_FULL_REBUILD_INTERVAL
+        const bool fIncremental = pblocktemplate && pindexPrev == chainActive.Tip() &&
+            fLastTemplateSupportsSegwit == fSupportsSegwit &&
+            GetTime() - nStart <= TEMPLATE_FULL_REBUILD_INTERVAL;
+        if (!fIncremental)
+            nStart = GetTime();
+        if (pindexPrev != chainActive.Tip() || fLastTemplateSupportsSegwit != fSupportsSegwit)
+            templateHistory.clear();
+
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
         pindexPrev = nullptr;
 
         // Store the pindexBest used before CreateNewBlock, to avoid races
         nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
         CBlockIndex* pindexPrevNew = chainActive.Tip();
-        nStart = GetTime();
+        nLastTemplateBuild = GetTime();
         fLastTemplateSupportsSegwit = fSupportsSegwit;
 
         // Create new block
         CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit);
+        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit, fIncremental ? pblocktemplate.get() : nullptr);
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
         // Need to update only after we know CreateNewBlock succeeded
         pindexPrev = pindexPrevNew;
+
+        std::vector<uint256> vTxid;
+        for (size_t j = 1; j < pblocktemplate->block.vtx.size(); j++)
+            vTxid.push_back(pblocktemplate->block.vtx[j]->GetHash());
+        templateHistory.emplace_back(pindexPrev->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast), std::move(vTxid));
+        if (templateHistory.size() > MAX_TEMPLATE_HISTORY)
+            templateHistory.pop_front();
     }
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -574,7 +653,37 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     // NOTE: If at some point we support pre-segwit miners post-segwit-activation, this needs to take segwit support into consideration
     const bool fPreSegWit = (THRESHOLD_ACTIVE != VersionBitsState(pindexPrev, consensusParams, Consensus::DEPLOYMENT_SEGWIT, versionbitscache));
 
-    UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal");
+    UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal"); aCaps.push_back("templatedelta");
+
+    // For a templatedelta client holding a known template, keep the longest
+    // run of its transactions that is still in order and send the rest as
+    // removed/added
+    const std::vector<uint256>* pvDeltaBase = nullptr;
+    if (fTemplateDelta && lpval.isStr()) {
+        for (const auto& entry : templateHistory) {
+            if (entry.first == lpval.get_str())
+                pvDeltaBase = &entry.second;
+        }
+    }
+    std::set<uint256> setKept;
+    UniValue removed(UniValue::VARR);
+    if (pvDeltaBase) {
+        std::map<uint256, size_t> mapBasePos;
+        for (size_t j = 0; j < pvDeltaBase->size(); j++)
+            mapBasePos[(*pvDeltaBase)[j]] = j;
+        size_t nNextPos = 0;
+        for (size_t j = 1; j < pblock->vtx.size(); j++) {
+            auto pos = mapBasePos.find(pblock->vtx[j]->GetHash());
+            if (pos != mapBasePos.end() && pos->second >= nNextPos) {
+                setKept.insert(pos->first);
+                nNextPos = pos->second + 1;
+            }
+        }
+        for (const uint256& txid : *pvDeltaBase) {
+            if (!setKept.count(txid))
+                removed.push_back(txid.GetHex());
+        }
+    }
 
     UniValue transactions(UniValue::VARR);
     std::map<uint256, int64_t> setTxIndex;
@@ -584,7 +693,7 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
         uint256 txHash = tx.GetHash();
         setTxIndex[txHash] = i++;
 
-        if (tx.IsCoinBase())
+        if (tx.IsCoinBase() || setKept.count(txHash))
             continue;
 
         UniValue entry(UniValue::VOBJ);
@@ -610,6 +719,8 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
         }
         entry.push_back(Pair("sigops", nTxSigOps));
         entry.push_back(Pair("weight", GetTransactionWeight(tx)));
+        if (pvDeltaBase)
+            entry.push_back(Pair("index", index_in_template));
 
         transactions.push_back(entry);
     }
@@ -683,7 +794,15 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     }
 
     result.push_back(Pair("previousblockhash", pblock->hashPrevBlock.GetHex()));
-    result.push_back(Pair("transactions", transactions));
+    if (pvDeltaBase) {
+        UniValue delta(UniValue::VOBJ);
+        delta.push_back(Pair("longpollid", lpval.get_str()));
+        delta.push_back(Pair("removed", removed));
+        delta.push_back(Pair("added", transactions));
+        result.push_back(Pair("delta", delta));
+    } else {
+        result.push_back(Pair("transactions", transactions));
+    }
     result.push_back(Pair("coinbaseaux", aux));
     result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0]->vout[0].nValue));
     result.push_back(Pair("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)));
@@ -733,6 +852,13 @@ protected:
     }
 };
 
+void RPCNotifyMempoolChange()
+{
+    WaitableLock lock(csBestBlock);
+    nMempoolChanges++;
+    cvBlockChange.notify_all();
+}
+
 UniValue submitblock(const JSONRPCRequest& request)
 {
     // We allow 2 arguments for compliance with BIP22. Argument 2 is ignored.
@@ -789,7 +915,7 @@ UniValue submitblock(const JSONRPCRequest& request)
     }
 
     submitblock_StateCatcher sc(block.GetHash());
-    RegisterValidationInterface(&sc);
+    RegisterValidationInterface(&sc, "submitblock");
     bool fAccepted = ProcessNewBlock(Params(), blockptr, true, nullptr);
     UnregisterValidationInterface(&sc);
     if (fBlockPresent) {
@@ -974,10 +1100,10 @@ UniValue estimaterawfee(const JSONRPCRequest& request)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         argNames
+{ //  category              name                      actor (function)         argNames, concurrent
   //  --------------------- ------------------------  -----------------------  ----------
-    { "mining",             "getnetworkhashps",       &getnetworkhashps,       {"nblocks","height"} },
-    { "mining",             "getmininginfo",          &getmininginfo,          {} },
+    { "mining",             "getnetworkhashps",       &getnetworkhashps,       {"nblocks","height"}, true },
+    { "mining",             "getmininginfo",          &getmininginfo,          {}, true },
     { "mining",             "prioritisetransaction",  &prioritisetransaction,  {"txid","dummy","fee_delta"} },
     { "mining",             "getblocktemplate",       &getblocktemplate,       {"template_request"} },
     { "mining",             "submitblock",            &submitblock,            {"hexdata","dummy"} },
@@ -987,9 +1113,9 @@ static const CRPCCommand commands[] =
     { "generating",         "setgenerate",            &setgenerate,            {"generate","genproclimit"} },
 
     { "hidden",             "estimatefee",            &estimatefee,            {} },
-    { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode"} },
+    { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode"}, true },
 
-    { "hidden",             "estimaterawfee",         &estimaterawfee,         {"conf_target", "threshold"} },
+    { "hidden",             "estimaterawfee",         &estimaterawfee,         {"conf_target", "threshold"}, true },
 };
 
 void RegisterMiningRPCCommands(CRPCTable &t)
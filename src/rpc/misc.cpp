@@ -19,11 +19,13 @@
 #include <rpc/util.h>
 #include <sidechain.h>
 #include <sidechaindb.h>
+#include <sync.h>
 #include <timedata.h>
 #include <util.h>
 #include <utilmoneystr.h>
 #include <utilstrencodings.h>
 #include <validation.h>
+#include <validationinterface.h>
 #ifdef ENABLE_WALLET
 #include <wallet/coincontrol.h>
 #include <wallet/rpcwallet.h>
@@ -520,6 +522,137 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     }
 }
 
+UniValue getvalidationqueueinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getvalidationqueueinfo\n"
+            "Returns the backlog of the validation notification queue of each subscriber.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",        (string) The subscriber\n"
+            "    \"pending\": n,           (numeric) Number of notifications waiting to be processed\n"
+            "    \"maxpending\": n,        (numeric) Highest number of notifications that were waiting at once\n"
+            "    \"processed\": n,         (numeric) Number of notifications processed\n"
+            "    \"avgwait\": n,           (numeric) Average time in microseconds a notification waited in the queue\n"
+            "    \"avgrun\": n,            (numeric) Average time in microseconds the subscriber took to process a notification\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getvalidationqueueinfo", "")
+            + HelpExampleRpc("getvalidationqueueinfo", "")
+        );
+
+    UniValue ret(UniValue::VARR);
+    for (const ValidationQueueStats& stats : GetMainSignals().GetQueueStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", stats.name));
+        obj.push_back(Pair("pending", (uint64_t)stats.nPending));
+        obj.push_back(Pair("maxpending", (uint64_t)stats.nMaxPending));
+        obj.push_back(Pair("processed", stats.nProcessed));
+        obj.push_back(Pair("avgwait", stats.nProcessed ? stats.nWaitMicros / (int64_t)stats.nProcessed : 0));
+        obj.push_back(Pair("avgrun", stats.nProcessed ? stats.nRunMicros / (int64_t)stats.nProcessed : 0));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+/** The counters of a LockSite, copied once so they can't change while sorted */
+struct LockSiteSnapshot
+{
+    const LockSite* site;
+    uint64_t nAcquired;
+    uint64_t nContended;
+    uint64_t nWaitMicros;
+    uint64_t nHoldMicros;
+    uint64_t waitHist[LOCK_STATS_BUCKETS];
+    uint64_t holdHist[LOCK_STATS_BUCKETS];
+
+    explicit LockSiteSnapshot(const LockSite* siteIn) : site(siteIn),
+        nAcquired(siteIn->nAcquired), nContended(siteIn->nContended),
+        nWaitMicros(siteIn->nWaitMicros), nHoldMicros(siteIn->nHoldMicros)
+    {
+        for (int i = 0; i < LOCK_STATS_BUCKETS; i++) {
+            waitHist[i] = siteIn->waitHist[i];
+            holdHist[i] = siteIn->holdHist[i];
+        }
+    }
+};
+
+static UniValue LockHistogram(const uint64_t* hist)
+{
+    int nBuckets = LOCK_STATS_BUCKETS;
+    while (nBuckets > 0 && hist[nBuckets - 1] == 0)
+        nBuckets--;
+    UniValue ret(UniValue::VARR);
+    for (int i = 0; i < nBuckets; i++)
+        ret.push_back(hist[i]);
+    return ret;
+}
+
+UniValue getlockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getlockstats ( reset )\n"
+            "Returns acquisition and contention statistics of every lock site that was used,\n"
+            "sorted by total time spent waiting.\n"
+            "\nArguments:\n"
+            "1. reset    (boolean, optional, default=false) Clear the statistics after returning them\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"lock\": \"xxxx\",         (string) The locked mutex as written at the site\n"
+            "    \"site\": \"file:line\",    (string) The source location of the LOCK\n"
+            "    \"acquired\": n,          (numeric) Number of times the lock was taken here\n"
+            "    \"contended\": n,         (numeric) Number of those that had to wait\n"
+            "    \"waittime\": n,          (numeric) Total microseconds spent waiting\n"
+            "    \"holdtime\": n,          (numeric) Total microseconds the lock was held\n"
+            "    \"waithist\": [n,...],    (array) Waits per bucket: bucket 0 is under 1us, bucket i is [2^(i-1), 2^i) us\n"
+            "    \"holdhist\": [n,...]     (array) Hold times, bucketed the same way\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockstats", "")
+            + HelpExampleCli("getlockstats", "true")
+            + HelpExampleRpc("getlockstats", "")
+        );
+
+    bool fReset = !request.params[0].isNull() && request.params[0].get_bool();
+
+    // The counters keep changing under other threads, so sort a copy
+    std::vector<LockSiteSnapshot> vSites;
+    for (const LockSite* site = GetLockSites(); site; site = site->Next()) {
+        LockSiteSnapshot snapshot(site);
+        if (snapshot.nAcquired)
+            vSites.push_back(snapshot);
+    }
+    std::sort(vSites.begin(), vSites.end(), [](const LockSiteSnapshot& a, const LockSiteSnapshot& b) {
+        return a.nWaitMicros > b.nWaitMicros;
+    });
+
+    UniValue ret(UniValue::VARR);
+    for (const LockSiteSnapshot& snapshot : vSites) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("lock", snapshot.site->pszName));
+        obj.push_back(Pair("site", strprintf("%s:%d", snapshot.site->pszFile, snapshot.site->nLine)));
+        obj.push_back(Pair("acquired", snapshot.nAcquired));
+        obj.push_back(Pair("contended", snapshot.nContended));
+        obj.push_back(Pair("waittime", snapshot.nWaitMicros));
+        obj.push_back(Pair("holdtime", snapshot.nHoldMicros));
+        obj.push_back(Pair("waithist", LockHistogram(snapshot.waitHist)));
+        obj.push_back(Pair("holdhist", LockHistogram(snapshot.holdHist)));
+        ret.push_back(obj);
+    }
+
+    if (fReset) {
+        for (LockSite* site = GetLockSites(); site; site = site->Next())
+            site->Reset();
+    }
+    return ret;
+}
+
 uint32_t getCategoryMask(UniValue cats) {
     cats = cats.get_array();
     uint32_t mask = 0;
@@ -1579,19 +1712,21 @@ static UniValue getinfo_deprecated(const JSONRPCRequest& request)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         argNames
+{ //  category              name                      actor (function)         argNames, concurrent
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getmemoryinfo",          &getmemoryinfo,          {"mode"} },
+    { "control",            "getvalidationqueueinfo", &getvalidationqueueinfo, {}, true },
+    { "control",            "getlockstats",           &getlockstats,           {"reset"} },
     { "control",            "logging",                &logging,                {"include", "exclude"}},
-    { "util",               "validateaddress",        &validateaddress,        {"address"} }, /* uses wallet if enabled */
-    { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys"} },
-    { "util",               "verifymessage",          &verifymessage,          {"address","signature","message"} },
+    { "util",               "validateaddress",        &validateaddress,        {"address"}, true }, /* uses wallet if enabled */
+    { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys"}, true },
+    { "util",               "verifymessage",          &verifymessage,          {"address","signature","message"}, true },
     { "util",               "signmessagewithprivkey", &signmessagewithprivkey, {"privkey","message"} },
 
     /* Not shown in help */
     { "hidden",             "setmocktime",            &setmocktime,            {"timestamp"}},
-    { "hidden",             "echo",                   &echo,                   {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}},
-    { "hidden",             "echojson",               &echo,                   {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}},
+    { "hidden",             "echo",                   &echo,                   {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}, true },
+    { "hidden",             "echojson",               &echo,                   {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}, true },
     { "hidden",             "getinfo",                &getinfo_deprecated,     {}},
 
     // TODO improve & shorten names
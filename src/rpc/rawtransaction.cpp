@@ -884,27 +884,47 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
     // Use CTransaction for the constant parts of the
     // transaction to avoid rehashing.
     const CTransaction txConst(mtx);
-    // Sign what we can:
+    const PrecomputedTransactionData txdata(txConst);
+
+    // The coins view is not thread-safe, look up all spent outputs first.
+    std::vector<const Coin*> vCoins(mtx.vin.size());
     for (unsigned int i = 0; i < mtx.vin.size(); i++) {
-        CTxIn& txin = mtx.vin[i];
-        const Coin& coin = view.AccessCoin(txin.prevout);
-        if (coin.IsSpent()) {
-            TxInErrorToJSON(txin, vErrors, "Input not found or already spent");
-            continue;
-        }
-        const CScript& prevPubKey = coin.out.scriptPubKey;
-        const CAmount& amount = coin.out.nValue;
+        const Coin& coin = view.AccessCoin(mtx.vin[i].prevout);
+        if (!coin.IsSpent())
+            vCoins[i] = &coin;
+    }
+
+    // Sign what we can. Signing an input does not depend on the signatures
+    // of the others, so all inputs are signed against txConst in parallel.
+    std::vector<SignatureData> vSigData(mtx.vin.size());
+    std::vector<ScriptError> vErrorCodes(mtx.vin.size(), SCRIPT_ERR_OK);
+    ForEachInputParallel(mtx.vin.size(), [&](unsigned int i) {
+        if (!vCoins[i])
+            return;
+        const CScript& prevPubKey = vCoins[i]->out.scriptPubKey;
+        const CAmount& amount = vCoins[i]->out.nValue;
+        const TransactionSignatureChecker checker(&txConst, i, amount, txdata);
 
         SignatureData sigdata;
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
         if (!fHashSingle || (i < mtx.vout.size()))
-            ProduceSignature(MutableTransactionSignatureCreator(&keystore, &mtx, i, amount, nHashType), prevPubKey, sigdata);
-        sigdata = CombineSignatures(prevPubKey, TransactionSignatureChecker(&txConst, i, amount), sigdata, DataFromTransaction(mtx, i));
+            ProduceSignature(TransactionSignatureCreator(&keystore, &txConst, i, amount, nHashType, &txdata), prevPubKey, sigdata);
+        vSigData[i] = CombineSignatures(prevPubKey, checker, sigdata, DataFromTransaction(mtx, i));
+
+        VerifyScript(vSigData[i].scriptSig, prevPubKey, &vSigData[i].scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, checker, &vErrorCodes[i]);
+    });
+
+    for (unsigned int i = 0; i < mtx.vin.size(); i++) {
+        CTxIn& txin = mtx.vin[i];
+        if (!vCoins[i]) {
+            TxInErrorToJSON(txin, vErrors, "Input not found or already spent");
+            continue;
+        }
 
-        UpdateTransaction(mtx, i, sigdata);
+        UpdateTransaction(mtx, i, vSigData[i]);
 
-        ScriptError serror = SCRIPT_ERR_OK;
-        if (!VerifyScript(txin.scriptSig, prevPubKey, &txin.scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&txConst, i, amount), &serror)) {
+        const ScriptError serror = vErrorCodes[i];
+        if (serror != SCRIPT_ERR_OK) {
             if (serror == SCRIPT_ERR_INVALID_STACK_OPERATION) {
                 // Unable to sign input and verification failed (possible attempt to partially sign).
                 TxInErrorToJSON(txin, vErrors, "Unable to sign input, invalid stack size (possibly missing key)");
@@ -1023,18 +1043,18 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         argNames
+{ //  category              name                      actor (function)         argNames, concurrent
   //  --------------------- ------------------------  -----------------------  ----------
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      {"txid","verbose","blockhash"} },
-    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   {"inputs","outputs","locktime","replaceable"} },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   {"hexstring","iswitness"} },
-    { "rawtransactions",    "decodescript",           &decodescript,           {"hexstring"} },
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      {"txid","verbose","blockhash"}, true },
+    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   {"inputs","outputs","locktime","replaceable"}, true },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   {"hexstring","iswitness"}, true },
+    { "rawtransactions",    "decodescript",           &decodescript,           {"hexstring"}, true },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     {"hexstring","allowhighfees"} },
-    { "rawtransactions",    "combinerawtransaction",  &combinerawtransaction,  {"txs"} },
+    { "rawtransactions",    "combinerawtransaction",  &combinerawtransaction,  {"txs"}, true },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
 
-    { "blockchain",         "gettxoutproof",          &gettxoutproof,          {"txids", "blockhash"} },
-    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       {"proof"} },
+    { "blockchain",         "gettxoutproof",          &gettxoutproof,          {"txids", "blockhash"}, true },
+    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       {"proof"}, true },
 };
 
 void RegisterRawTransactionRPCCommands(CRPCTable &t)
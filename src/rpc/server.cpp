@@ -20,6 +20,8 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 
+#include <atomic>
+#include <future>
 #include <memory> // for unique_ptr
 #include <unordered_map>
 
@@ -260,12 +262,12 @@ UniValue uptime(const JSONRPCRequest& jsonRequest)
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
-{ //  category              name                      actor (function)         argNames
+{ //  category              name                      actor (function)         argNames, concurrent
   //  --------------------- ------------------------  -----------------------  ----------
     /* Overall control/query calls */
-    { "control",            "help",                   &help,                   {"command"}  },
+    { "control",            "help",                   &help,                   {"command"}, true },
     { "control",            "stop",                   &stop,                   {}  },
-    { "control",            "uptime",                 &uptime,                 {}  },
+    { "control",            "uptime",                 &uptime,                 {}, true },
 };
 
 CRPCTable::CRPCTable()
@@ -410,11 +412,69 @@ static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
     return rpc_result;
 }
 
+/** Whether a batch element calls a command flagged as safe to run concurrently */
+static bool IsConcurrentRequest(const UniValue& req)
+{
+    if (!req.isObject()) {
+        return false;
+    }
+    const UniValue& method = find_value(req, "method");
+    if (!method.isStr()) {
+        return false;
+    }
+    const CRPCCommand *pcmd = tableRPC[method.get_str()];
+    return pcmd && pcmd->fConcurrent;
+}
+
+/** Execute batch elements [nBegin, nEnd) on up to nThreads threads, including the calling one */
+static void JSONRPCExecConcurrently(const JSONRPCRequest& jreq, const UniValue& vReq, size_t nBegin, size_t nEnd, std::vector<UniValue>& vResults, size_t nThreads)
+{
+    std::atomic<size_t> nNext(nBegin);
+    auto worker = [&] {
+        for (size_t i = nNext++; i < nEnd; i = nNext++) {
+            vResults[i] = JSONRPCExecOne(jreq, vReq[i]);
+        }
+    };
+    std::vector<std::future<void>> vHelpers;
+    for (size_t n = 1; n < std::min(nThreads, nEnd - nBegin); n++) {
+        try {
+            vHelpers.push_back(std::async(std::launch::async, worker));
+        } catch (const std::system_error& e) {
+            // Out of threads, the ones we have will finish the work
+            LogPrint(BCLog::RPC, "%s: %s\n", __func__, e.what());
+            break;
+        }
+    }
+    worker();
+    for (std::future<void>& helper : vHelpers) {
+        helper.get();
+    }
+}
+
 std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
 {
+    const size_t nThreads = std::max<int64_t>(1, gArgs.GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS));
+    std::vector<UniValue> vResults(vReq.size());
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        // Calls flagged as concurrent only read state, so a run of them can
+        // be executed in any order. Anything else runs alone, in order.
+        size_t runEnd = reqIdx;
+        while (runEnd < vReq.size() && IsConcurrentRequest(vReq[runEnd])) {
+            runEnd++;
+        }
+        if (runEnd - reqIdx > 1 && nThreads > 1) {
+            JSONRPCExecConcurrently(jreq, vReq, reqIdx, runEnd, vResults, nThreads);
+            reqIdx = runEnd;
+        } else {
+            vResults[reqIdx] = JSONRPCExecOne(jreq, vReq[reqIdx]);
+            reqIdx++;
+        }
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+    for (const UniValue& result : vResults)
+        ret.push_back(result);
 
     return ret.write() + "\n";
 }
@@ -469,7 +529,8 @@ static inline JSONRPCRequest transformNamedArguments(const JSONRPCRequest& in, c
     return out;
 }
 
-UniValue CRPCTable::execute(const JSONRPCRequest &request) const
+/** Look up the command for a request, failing if the server is not ready or the method is unknown */
+static const CRPCCommand* FindCommand(const JSONRPCRequest &request)
 {
     // Return immediately if in warmup
     {
@@ -482,6 +543,12 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
     const CRPCCommand *pcmd = tableRPC[request.strMethod];
     if (!pcmd)
         throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
+    return pcmd;
+}
+
+UniValue CRPCTable::execute(const JSONRPCRequest &request) const
+{
+    const CRPCCommand *pcmd = FindCommand(request);
 
     g_rpcSignals.PreCommand(*pcmd);
 
@@ -500,6 +567,29 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
     }
 }
 
+bool CRPCTable::executeStream(const JSONRPCRequest &request, JSONStreamWriter& writer) const
+{
+    const CRPCCommand *pcmd = FindCommand(request);
+    if (!pcmd->streamActor)
+        return false;
+
+    g_rpcSignals.PreCommand(*pcmd);
+
+    try
+    {
+        if (request.params.isObject()) {
+            pcmd->streamActor(transformNamedArguments(request, pcmd->argNames), writer);
+        } else {
+            pcmd->streamActor(request, writer);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+    return true;
+}
+
 std::vector<std::string> CRPCTable::listCommands() const
 {
     std::vector<std::string> commandList;
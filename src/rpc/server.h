@@ -14,12 +14,16 @@
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <utility>
 
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+/** Default for -rpcbatchthreads, the number of threads executing one batch request */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
 
 class CRPCCommand;
+class JSONStreamWriter;
 
 namespace RPCServer
 {
@@ -126,14 +130,26 @@ void RPCUnsetTimerInterface(RPCTimerInterface *iface);
 void RPCRunLater(const std::string& name, std::function<void(void)> func, int64_t nSeconds);
 
 typedef UniValue(*rpcfn_type)(const JSONRPCRequest& jsonRequest);
+typedef void(*rpcstreamfn_type)(const JSONRPCRequest& jsonRequest, JSONStreamWriter& writer);
 
 class CRPCCommand
 {
 public:
+    CRPCCommand(std::string categoryIn, std::string nameIn, rpcfn_type actorIn, std::vector<std::string> argNamesIn,
+                bool fConcurrentIn = false, rpcstreamfn_type streamActorIn = nullptr)
+        : category(std::move(categoryIn)), name(std::move(nameIn)), actor(actorIn), argNames(std::move(argNamesIn)),
+          fConcurrent(fConcurrentIn), streamActor(streamActorIn) {}
+
     std::string category;
     std::string name;
     rpcfn_type actor;
     std::vector<std::string> argNames;
+    //! Calls have no side effects later calls could observe, so consecutive
+    //! such calls in a batch request may be executed concurrently.
+    bool fConcurrent;
+    //! Optional variant of actor that streams its result instead of
+    //! returning it. Used by the HTTP server for large responses.
+    rpcstreamfn_type streamActor;
 };
 
 /**
@@ -156,6 +172,14 @@ public:
      */
     UniValue execute(const JSONRPCRequest &request) const;
 
+    /**
+     * Execute a method that has a streamActor, writing its result into writer.
+     * @returns false, without calling anything, if the method has no streamActor.
+     * @throws an exception (UniValue) when an error happens. Output already
+     * flushed from writer can not be taken back, see JSONStreamWriter::Flushed.
+     */
+    bool executeStream(const JSONRPCRequest &request, JSONStreamWriter& writer) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -8,6 +8,8 @@
 
 #include <script/interpreter.h>
 
+#include <functional>
+
 class CKeyID;
 class CKeyStore;
 class CScript;
@@ -30,16 +32,18 @@ public:
     virtual bool CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& keyid, const CScript& scriptCode, SigVersion sigversion) const =0;
 };
 
-/** A signature creator for transactions. */
+/** A signature creator for transactions. Optionally shares sighash data
+ *  precomputed for txTo with other creators signing the same transaction. */
 class TransactionSignatureCreator : public BaseSignatureCreator {
     const CTransaction* txTo;
     unsigned int nIn;
     int nHashType;
     CAmount amount;
+    const PrecomputedTransactionData* txdata;
     const TransactionSignatureChecker checker;
 
 public:
-    TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn=SIGHASH_ALL);
+    TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn=SIGHASH_ALL, const PrecomputedTransactionData* txdataIn=nullptr);
     const BaseSignatureChecker& Checker() const override { return checker; }
     bool CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& keyid, const CScript& scriptCode, SigVersion sigversion) const override;
 };
@@ -74,6 +78,16 @@ bool ProduceSignature(const BaseSignatureCreator& creator, const CScript& script
 bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CMutableTransaction& txTo, unsigned int nIn, const CAmount& amount, int nHashType);
 bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CMutableTransaction& txTo, unsigned int nIn, int nHashType);
 
+/**
+ * Call fn(nIn) for each input index below nInputs, spread over the shared
+ * worker pool when there are enough inputs. The signature for an
+ * input does not depend on the scriptSigs or witnesses of the others, so
+ * inputs can be signed against the same unsigned transaction in any order.
+ * fn may only write state belonging to its own input. Exceptions thrown by
+ * fn are rethrown.
+ */
+void ForEachInputParallel(unsigned int nInputs, const std::function<void(unsigned int)>& fn);
+
 /** Combine two script signatures using a generic signature checker, intelligently, possibly with OP_0 placeholders. */
 SignatureData CombineSignatures(const CScript& scriptPubKey, const BaseSignatureChecker& checker, const SignatureData& scriptSig1, const SignatureData& scriptSig2);
 
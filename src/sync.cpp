@@ -10,6 +10,33 @@
 
 #include <stdio.h>
 
+static std::atomic<LockSite*> g_lock_sites{nullptr};
+
+LockSite::LockSite(const char* pszNameIn, const char* pszFileIn, int nLineIn)
+    : pszName(pszNameIn), pszFile(pszFileIn), nLine(nLineIn)
+{
+    Reset();
+    m_next = g_lock_sites.load();
+    while (!g_lock_sites.compare_exchange_weak(m_next, this)) {}
+}
+
+void LockSite::Reset()
+{
+    nAcquired = 0;
+    nContended = 0;
+    nWaitMicros = 0;
+    nHoldMicros = 0;
+    for (int i = 0; i < LOCK_STATS_BUCKETS; i++) {
+        waitHist[i] = 0;
+        holdHist[i] = 0;
+    }
+}
+
+LockSite* GetLockSites()
+{
+    return g_lock_sites.load();
+}
+
 #ifdef DEBUG_LOCKCONTENTION
 #if !defined(HAVE_THREAD_LOCAL)
 static_assert(false, "thread_local is not supported");
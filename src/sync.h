@@ -8,6 +8,8 @@
 
 #include <threadsafety.h>
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <thread>
 #include <mutex>
@@ -112,23 +114,102 @@ typedef std::unique_lock<std::mutex> WaitableLock;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/** Number of power-of-two microsecond buckets in the lock wait and hold time histograms */
+static const int LOCK_STATS_BUCKETS = 24;
+
+/**
+ * Contention statistics of one LOCK() site. Every LOCK, LOCK2 and TRY_LOCK
+ * has a static LockSite, which links itself into a global list the first
+ * time the site is reached.
+ */
+class LockSite
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    const char* const pszName;
+    const char* const pszFile;
+    const int nLine;
+
+    std::atomic<uint64_t> nAcquired;
+    std::atomic<uint64_t> nContended;
+    std::atomic<uint64_t> nWaitMicros;
+    std::atomic<uint64_t> nHoldMicros;
+    //! Bucket 0 counts durations under 1us, bucket i those in [2^(i-1), 2^i) us
+    std::atomic<uint64_t> waitHist[LOCK_STATS_BUCKETS];
+    std::atomic<uint64_t> holdHist[LOCK_STATS_BUCKETS];
+
+    LockSite(const char* pszNameIn, const char* pszFileIn, int nLineIn);
+
+    void Reset();
+    LockSite* Next() const { return m_next; }
+
+    void Acquired(clock::time_point& acquired)
+    {
+        acquired = clock::now();
+        nAcquired.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void AcquiredAfterWait(clock::time_point start, clock::time_point& acquired)
+    {
+        acquired = clock::now();
+        uint64_t nWait = Micros(acquired - start);
+        nAcquired.fetch_add(1, std::memory_order_relaxed);
+        nContended.fetch_add(1, std::memory_order_relaxed);
+        nWaitMicros.fetch_add(nWait, std::memory_order_relaxed);
+        waitHist[Bucket(nWait)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Released(clock::time_point acquired)
+    {
+        uint64_t nHold = Micros(clock::now() - acquired);
+        nHoldMicros.fetch_add(nHold, std::memory_order_relaxed);
+        holdHist[Bucket(nHold)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    LockSite* m_next;
+
+    static uint64_t Micros(clock::duration d)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    }
+
+    static int Bucket(uint64_t nMicros)
+    {
+        int nBucket = 0;
+        while (nMicros && nBucket < LOCK_STATS_BUCKETS - 1) {
+            nMicros >>= 1;
+            nBucket++;
+        }
+        return nBucket;
+    }
+};
+
+/** Return the most recently reached LockSite; the others follow through Next() */
+LockSite* GetLockSites();
+
 /** Wrapper around std::unique_lock<CCriticalSection> */
 class SCOPED_LOCKABLE CCriticalBlock
 {
 private:
     std::unique_lock<CCriticalSection> lock;
+    LockSite* m_site = nullptr;
+    LockSite::clock::time_point m_acquired;
 
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
-        if (!lock.try_lock()) {
-            PrintLockContention(pszName, pszFile, nLine);
-#endif
-            lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+        if (lock.try_lock()) {
+            if (m_site) m_site->Acquired(m_acquired);
+            return;
         }
+#ifdef DEBUG_LOCKCONTENTION
+        PrintLockContention(pszName, pszFile, nLine);
 #endif
+        LockSite::clock::time_point start = LockSite::clock::now();
+        lock.lock();
+        if (m_site) m_site->AcquiredAfterWait(start, m_acquired);
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -137,10 +218,31 @@ private:
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+        else if (m_site)
+            m_site->Acquired(m_acquired);
         return lock.owns_lock();
     }
 
 public:
+    CCriticalBlock(CCriticalSection& mutexIn, LockSite& site, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, std::defer_lock), m_site(&site)
+    {
+        if (fTry)
+            TryEnter(site.pszName, site.pszFile, site.nLine);
+        else
+            Enter(site.pszName, site.pszFile, site.nLine);
+    }
+
+    CCriticalBlock(CCriticalSection* pmutexIn, LockSite& site, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn) : m_site(&site)
+    {
+        if (!pmutexIn) return;
+
+        lock = std::unique_lock<CCriticalSection>(*pmutexIn, std::defer_lock);
+        if (fTry)
+            TryEnter(site.pszName, site.pszFile, site.nLine);
+        else
+            Enter(site.pszName, site.pszFile, site.nLine);
+    }
+
     CCriticalBlock(CCriticalSection& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, std::defer_lock)
     {
         if (fTry)
@@ -162,8 +264,10 @@ public:
 
     ~CCriticalBlock() UNLOCK_FUNCTION()
     {
-        if (lock.owns_lock())
+        if (lock.owns_lock()) {
+            if (m_site) m_site->Released(m_acquired);
             LeaveCritical();
+        }
     }
 
     operator bool()
@@ -175,9 +279,17 @@ public:
 #define PASTE(x, y) x ## y
 #define PASTE2(x, y) PASTE(x, y)
 
-#define LOCK(cs) CCriticalBlock PASTE2(criticalblock, __COUNTER__)(cs, #cs, __FILE__, __LINE__)
-#define LOCK2(cs1, cs2) CCriticalBlock criticalblock1(cs1, #cs1, __FILE__, __LINE__), criticalblock2(cs2, #cs2, __FILE__, __LINE__)
-#define TRY_LOCK(cs, name) CCriticalBlock name(cs, #cs, __FILE__, __LINE__, true)
+#define LOCK_AT(cs, n) \
+    static LockSite PASTE2(locksite, n)(#cs, __FILE__, __LINE__); \
+    CCriticalBlock PASTE2(criticalblock, n)(cs, PASTE2(locksite, n))
+
+#define LOCK(cs) LOCK_AT(cs, __COUNTER__)
+#define LOCK2(cs1, cs2) \
+    static LockSite locksite1(#cs1, __FILE__, __LINE__), locksite2(#cs2, __FILE__, __LINE__); \
+    CCriticalBlock criticalblock1(cs1, locksite1), criticalblock2(cs2, locksite2)
+#define TRY_LOCK(cs, name) \
+    static LockSite PASTE2(locksite_, name)(#cs, __FILE__, __LINE__); \
+    CCriticalBlock name(cs, PASTE2(locksite_, name), true)
 
 #define ENTER_CRITICAL_SECTION(cs)                            \
     {                                                         \
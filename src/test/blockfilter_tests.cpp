@@ -0,0 +1,294 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/data/blockfilters.json.h>
+#include <test/test_drivenet.h>
+
+#include <blockfilter.h>
+#include <blockfilterindex.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <core_io.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <undo.h>
+#include <utilstrencodings.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+extern UniValue read_json(const std::string& jsondata);
+
+BOOST_AUTO_TEST_SUITE(blockfilter_tests)
+
+BOOST_FIXTURE_TEST_CASE(gcsfilter_test, BasicTestingSetup)
+{
+    GCSFilter::ElementSet included_elements, excluded_elements;
+    for (int i = 0; i < 100; ++i) {
+        GCSFilter::Element element1(32);
+        element1[0] = i;
+        included_elements.insert(std::move(element1));
+
+        GCSFilter::Element element2(32);
+        element2[1] = i;
+        excluded_elements.insert(std::move(element2));
+    }
+
+    GCSFilter filter({0, 0, 10, 1 << 10}, included_elements);
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(filter.Match(element));
+
+        auto insertion = excluded_elements.insert(element);
+        BOOST_CHECK(filter.MatchAny(excluded_elements));
+        excluded_elements.erase(insertion.first);
+    }
+
+    // Decoding the encoding gives back an equivalent filter
+    GCSFilter decoded({0, 0, 10, 1 << 10}, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), filter.GetN());
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(decoded.Match(element));
+    }
+
+    // Trailing bytes are rejected
+    std::vector<unsigned char> encoded = filter.GetEncoded();
+    encoded.push_back(0);
+    BOOST_CHECK_THROW(GCSFilter({0, 0, 10, 1 << 10}, encoded), std::ios_base::failure);
+
+    // The empty filter matches nothing
+    GCSFilter empty({0, 0, 10, 1 << 10});
+    BOOST_CHECK_EQUAL(empty.GetN(), 0U);
+    BOOST_CHECK(!empty.MatchAny(included_elements));
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilter_basic_test, BasicTestingSetup)
+{
+    CScript included_scripts[5], excluded_scripts[3];
+
+    // First two are outputs on a single transaction.
+    included_scripts[0] << std::vector<unsigned char>(0, 65) << OP_CHECKSIG;
+    included_scripts[1] << OP_DUP << OP_HASH160 << std::vector<unsigned char>(1, 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    // Third is an output on in a second transaction.
+    included_scripts[2] << OP_1 << std::vector<unsigned char>(2, 33) << OP_1 << OP_CHECKMULTISIG;
+
+    // Last two are spent by a single transaction.
+    included_scripts[3] << OP_0 << std::vector<unsigned char>(3, 32);
+    included_scripts[4] << OP_4 << OP_ADD << OP_8 << OP_EQUAL;
+
+    // OP_RETURN output is excluded, as is the input script of the spending
+    // transaction.
+    excluded_scripts[0] << OP_RETURN << OP_4 << OP_ADD << OP_8 << OP_EQUAL;
+    excluded_scripts[1] << std::vector<unsigned char>(5, 33) << OP_CHECKSIG;
+
+    CMutableTransaction tx_1;
+    tx_1.vout.emplace_back(100, included_scripts[0]);
+    tx_1.vout.emplace_back(200, included_scripts[1]);
+    tx_1.vout.emplace_back(0, CScript());
+
+    CMutableTransaction tx_2;
+    tx_2.vout.emplace_back(300, included_scripts[2]);
+    tx_2.vout.emplace_back(0, excluded_scripts[0]);
+
+    CMutableTransaction tx_3;
+    tx_3.vin.emplace_back(COutPoint(uint256S("0x01"), 0), excluded_scripts[1]);
+    tx_3.vin.emplace_back(COutPoint(uint256S("0x02"), 0));
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx_1));
+    block.vtx.push_back(MakeTransactionRef(tx_2));
+    block.vtx.push_back(MakeTransactionRef(tx_3));
+
+    CBlockUndo block_undo;
+    block_undo.vtxundo.emplace_back();
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(500, included_scripts[3]), 1000, true, false, false);
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(600, included_scripts[4]), 10000, false, false, false);
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(700, CScript()), 100000, false, false, false);
+
+    BlockFilter block_filter(BlockFilterType::BASIC, block, block_undo);
+    const GCSFilter& filter = block_filter.GetFilter();
+
+    for (const CScript& script : included_scripts) {
+        BOOST_CHECK(filter.Match(GCSFilter::Element(script.begin(), script.end())));
+    }
+    for (const CScript& script : excluded_scripts) {
+        BOOST_CHECK(!filter.Match(GCSFilter::Element(script.begin(), script.end())));
+    }
+
+    // Test serialization/unserialization.
+    BlockFilter block_filter2;
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block_filter;
+    stream >> block_filter2;
+
+    BOOST_CHECK(block_filter.GetFilterType() == block_filter2.GetFilterType());
+    BOOST_CHECK(block_filter.GetBlockHash() == block_filter2.GetBlockHash());
+    BOOST_CHECK(block_filter.GetEncodedFilter() == block_filter2.GetEncodedFilter());
+    BOOST_CHECK(block_filter.GetHash() == block_filter2.GetHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilters_json_test, BasicTestingSetup)
+{
+    UniValue json = read_json(std::string(json_tests::blockfilters, json_tests::blockfilters + sizeof(json_tests::blockfilters)));
+    uint256 last_block_hash, last_filter_header_basic;
+    int last_block_height = -1;
+    for (unsigned int i = 0; i < json.size(); i++) {
+        const UniValue& test = json[i];
+        std::string strTest = test.write();
+
+        if (test.size() == 1) {
+            continue; // comment
+        } else if (test.size() < 7) {
+            BOOST_ERROR("Bad test: " << strTest);
+            continue;
+        }
+
+        unsigned int pos = 0;
+        int block_height = test[pos++].get_int();
+        uint256 block_hash = ParseHashStr(test[pos++].get_str(), "block_hash");
+
+        CBlock block;
+        BOOST_REQUIRE(DecodeHexBlk(block, test[pos++].get_str()));
+        BOOST_CHECK_MESSAGE(block.GetHash() == block_hash, strTest);
+
+        CBlockUndo block_undo;
+        block_undo.vtxundo.emplace_back();
+        CTxUndo& tx_undo = block_undo.vtxundo.back();
+        const UniValue& prev_scripts = test[pos++].get_array();
+        for (unsigned int ii = 0; ii < prev_scripts.size(); ii++) {
+            std::vector<unsigned char> raw_script = ParseHex(prev_scripts[ii].get_str());
+            CTxOut txout(0, CScript(raw_script.begin(), raw_script.end()));
+            tx_undo.vprevout.emplace_back(txout, 0, false, false, false);
+        }
+
+        uint256 prev_filter_header_basic = ParseHashStr(test[pos++].get_str(), "prev_filter_header_basic");
+        std::vector<unsigned char> filter_basic = ParseHex(test[pos++].get_str());
+        uint256 filter_header_basic = ParseHashStr(test[pos++].get_str(), "filter_header_basic");
+
+        BlockFilter computed_filter_basic(BlockFilterType::BASIC, block, block_undo);
+        BOOST_CHECK_MESSAGE(computed_filter_basic.GetEncodedFilter() == filter_basic, strTest);
+
+        uint256 computed_header_basic = computed_filter_basic.ComputeHeader(prev_filter_header_basic);
+        BOOST_CHECK_MESSAGE(computed_header_basic == filter_header_basic, strTest);
+
+        // Consecutive vectors form a header chain
+        if (last_block_height >= 0 && block_height == last_block_height + 1) {
+            BOOST_CHECK_MESSAGE(block.hashPrevBlock == last_block_hash, strTest);
+            BOOST_CHECK_MESSAGE(prev_filter_header_basic == last_filter_header_basic, strTest);
+        }
+        last_block_hash = block_hash;
+        last_filter_header_basic = filter_header_basic;
+        last_block_height = block_height;
+    }
+}
+
+static bool CheckFilterLookups(const CBlockFilterIndex& index, const CBlockIndex* pindex)
+{
+    CBlock block;
+    CBlockUndo block_undo;
+    if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus())) return false;
+    if (pindex->pprev && !UndoReadFromDisk(block_undo, pindex)) return false;
+    BlockFilter expected(BlockFilterType::BASIC, block, block_undo);
+
+    BlockFilter filter;
+    uint256 header, prev_header;
+    if (!index.LookupFilter(pindex, filter)) return false;
+    if (!index.LookupFilterHeader(pindex, header)) return false;
+    if (pindex->pprev && !index.LookupFilterHeader(pindex->pprev, prev_header)) return false;
+
+    return filter.GetBlockHash() == pindex->GetBlockHash() &&
+        filter.GetEncodedFilter() == expected.GetEncodedFilter() &&
+        header == expected.ComputeHeader(prev_header);
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilterindex_sync_and_reorg, TestChain100Setup)
+{
+    g_blockfilterindex.reset(new CBlockFilterIndex(1 << 20, true));
+
+    // Nothing is indexed until the existing chain is synced
+    uint256 header;
+    BOOST_CHECK(!g_blockfilterindex->LookupFilterHeader(chainActive.Genesis(), header));
+    BOOST_CHECK(g_blockfilterindex->Sync());
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(g_blockfilterindex->GetBestBlockHash() == chainActive.Tip()->GetBlockHash());
+        for (const CBlockIndex* pindex = chainActive.Tip(); pindex; pindex = pindex->pprev) {
+            BOOST_CHECK(CheckFilterLookups(*g_blockfilterindex, pindex));
+        }
+    }
+
+    // New blocks are indexed as they are connected
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    for (int i = 0; i < 3; i++) {
+        CreateAndProcessBlock({}, scriptPubKey);
+    }
+    const CBlockIndex* pindexOldTip;
+    {
+        LOCK(cs_main);
+        pindexOldTip = chainActive.Tip();
+        BOOST_CHECK(g_blockfilterindex->GetBestBlockHash() == pindexOldTip->GetBlockHash());
+        BOOST_CHECK(CheckFilterLookups(*g_blockfilterindex, pindexOldTip));
+    }
+
+    // Disconnecting steps the index back, the competing block gets indexed
+    CValidationState state;
+    InvalidateBlock(state, Params(), const_cast<CBlockIndex*>(pindexOldTip));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(g_blockfilterindex->GetBestBlockHash() == pindexOldTip->pprev->GetBlockHash());
+    }
+    CScript otherScriptPubKey = CScript() << OP_TRUE;
+    CreateAndProcessBlock({}, otherScriptPubKey);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(chainActive.Tip() != pindexOldTip);
+        BOOST_CHECK(g_blockfilterindex->GetBestBlockHash() == chainActive.Tip()->GetBlockHash());
+        BOOST_CHECK(CheckFilterLookups(*g_blockfilterindex, chainActive.Tip()));
+
+        BlockFilter filter;
+        BOOST_CHECK(g_blockfilterindex->LookupFilter(chainActive.Tip(), filter));
+        BOOST_CHECK(filter.GetFilter().Match(GCSFilter::Element(otherScriptPubKey.begin(), otherScriptPubKey.end())));
+    }
+
+    // The filter of the disconnected block stays available
+    BOOST_CHECK(CheckFilterLookups(*g_blockfilterindex, pindexOldTip));
+
+    g_blockfilterindex.reset();
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilterindex_flush, TestChain100Setup)
+{
+    g_blockfilterindex.reset(new CBlockFilterIndex(1 << 20, false, true));
+    BOOST_CHECK(g_blockfilterindex->Sync());
+
+    // Entries of new blocks are served before they are written to the database
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    for (int i = 0; i < 3; i++) {
+        CreateAndProcessBlock({}, scriptPubKey);
+    }
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(CheckFilterLookups(*g_blockfilterindex, chainActive.Tip()));
+    }
+
+    // Flushing writes them together with the index tip, which survive a reopen
+    FlushStateToDisk();
+    g_blockfilterindex.reset();
+    g_blockfilterindex.reset(new CBlockFilterIndex(1 << 20));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(g_blockfilterindex->GetBestBlockHash() == chainActive.Tip()->GetBlockHash());
+        for (const CBlockIndex* pindex = chainActive.Tip(); pindex; pindex = pindex->pprev) {
+            BOOST_CHECK(CheckFilterLookups(*g_blockfilterindex, pindex));
+        }
+    }
+
+    g_blockfilterindex.reset();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
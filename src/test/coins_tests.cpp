@@ -590,7 +590,8 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
 
 void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
-    CCoinsMap map;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map{0, CCoinsMap::hasher{}, CCoinsMap::key_equal{}, &resource};
     InsertCoinsMapEntry(map, value, flags);
     view.BatchWrite(map, {});
 }
@@ -859,4 +860,125 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_copy_dirty)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    const CTxOut out(1000, CScript() << OP_TRUE);
+    const COutPoint fresh(InsecureRand256(), 0);
+    const COutPoint modified(InsecureRand256(), 0);
+    const COutPoint spent(InsecureRand256(), 0);
+    const COutPoint clean(InsecureRand256(), 0);
+
+    cache.AddCoin(modified, Coin(out, 1, false, false, false), false);
+    cache.AddCoin(spent, Coin(out, 1, false, false, false), false);
+    cache.AddCoin(clean, Coin(out, 1, false, false, false), false);
+    // Write to the base so spending leaves a dirty, spent entry
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Flush());
+    cache.AccessCoin(clean);
+    cache.AccessCoin(modified);
+    BOOST_CHECK(cache.SpendCoin(spent, false));
+    cache.AddCoin(fresh, Coin(out, 2, false, false, false), false);
+    BOOST_CHECK(cache.map().at(fresh).flags & CCoinsCacheEntry::FRESH);
+
+    CCoinsMapMemoryResource resource;
+    CCoinsMap batch{0, CCoinsMap::hasher{}, CCoinsMap::key_equal{}, &resource};
+    BOOST_CHECK(!cache.CopyDirty(batch, 1));
+    batch.clear();
+    BOOST_CHECK(cache.CopyDirty(batch, 10));
+    BOOST_CHECK_EQUAL(batch.size(), 2U);
+    BOOST_CHECK(batch.count(fresh) && batch.count(spent));
+    // The base is about to see the fresh coin
+    BOOST_CHECK_EQUAL(cache.map().at(fresh).flags, CCoinsCacheEntry::DIRTY);
+
+    // Modify an entry while the batch is being written
+    BOOST_CHECK(cache.SpendCoin(fresh, false));
+    cache.AddCoin(modified, Coin(out, 3, false, false, false), true);
+
+    cache.MarkWritten(batch);
+    BOOST_CHECK(cache.map().at(fresh).flags & CCoinsCacheEntry::DIRTY);
+    BOOST_CHECK(cache.map().at(modified).flags & CCoinsCacheEntry::DIRTY);
+    BOOST_CHECK(!cache.map().count(spent));
+    BOOST_CHECK_EQUAL(cache.map().at(clean).flags, 0);
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_evict_clean)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    const CTxOut out(1000, CScript() << OP_TRUE);
+    std::vector<COutPoint> vClean;
+    for (int i = 0; i < 100; i++) {
+        vClean.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(vClean.back(), Coin(out, 1, false, false, false), false);
+    }
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Flush());
+    for (const COutPoint& outpoint : vClean) {
+        cache.AccessCoin(outpoint);
+    }
+    const COutPoint dirty(InsecureRand256(), 0);
+    const COutPoint fresh(InsecureRand256(), 0);
+    cache.AddCoin(dirty, Coin(out, 2, false, false, false), true);
+    cache.AddCoin(fresh, Coin(out, 2, false, false, false), false);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 102U);
+
+    // Nothing to do below the target
+    BOOST_CHECK_EQUAL(cache.EvictClean(cache.DynamicMemoryUsage()), 0U);
+
+    // Only clean entries go, even if that leaves the cache over the target
+    BOOST_CHECK_EQUAL(cache.EvictClean(0), 100U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 2U);
+    BOOST_CHECK(cache.map().count(dirty) && cache.map().count(fresh));
+    cache.SelfTest();
+
+    // Evicted coins are fetched from the base again
+    BOOST_CHECK(cache.HaveCoin(vClean[0]));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_evict_clean_limit)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    const CTxOut out(1000, CScript() << OP_TRUE);
+    std::vector<COutPoint> vClean, vDirty;
+    for (int i = 0; i < 20000; i++) {
+        vClean.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(vClean.back(), Coin(out, 1, false, false, false), false);
+    }
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Flush());
+    for (const COutPoint& outpoint : vClean) {
+        cache.AccessCoin(outpoint);
+    }
+    for (int i = 0; i < 1000; i++) {
+        vDirty.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(vDirty.back(), Coin(out, 2, false, false, false), false);
+    }
+    const size_t nUsage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > (size_t)(1 << 20));
+
+    // Pool chunks are handed back, so the cache really ends up below the target
+    const size_t nTarget = nUsage / 2;
+    BOOST_CHECK(cache.EvictClean(nTarget) > 0);
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= nTarget);
+    BOOST_CHECK(cache.GetCacheSize() > vDirty.size() + 1000);
+    for (const COutPoint& outpoint : vDirty) {
+        BOOST_CHECK(cache.map().at(outpoint).flags & CCoinsCacheEntry::DIRTY);
+    }
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.EvictClean(nTarget), 0U);
+
+    // With only dirty coins left eviction cannot reach the target, so
+    // FlushStateToDisk falls back to a full flush
+    const size_t nDirtyUsage = cache.DynamicMemoryUsage();
+    cache.EvictClean(0);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), vDirty.size());
+    BOOST_CHECK(cache.DynamicMemoryUsage() < nDirtyUsage);
+    BOOST_CHECK(cache.DynamicMemoryUsage() > 0);
+    cache.SelfTest();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
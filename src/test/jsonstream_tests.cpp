@@ -0,0 +1,86 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/jsonstream.h>
+#include <test/test_drivenet.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+BOOST_FIXTURE_TEST_SUITE(jsonstream_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(jsonstream_matches_univalue)
+{
+    UniValue inner(UniValue::VOBJ);
+    inner.pushKV("a \"quoted\"\nkey", 1.5);
+    inner.pushKV("empty", UniValue(UniValue::VARR));
+    UniValue expected(UniValue::VOBJ);
+    expected.pushKV("hash", "00ff");
+    UniValue arr(UniValue::VARR);
+    arr.push_back(inner);
+    arr.push_back(NullUniValue);
+    arr.push_back(UniValue(UniValue::VOBJ));
+    arr.push_back(-7);
+    expected.pushKV("tx", arr);
+    expected.pushKV("flag", UniValue(true));
+
+    std::string out;
+    JSONStreamWriter writer([&out](const std::string& chunk) { out += chunk; });
+    writer.BeginObject();
+    writer.Key("hash");
+    writer.Value("00ff");
+    writer.Key("tx");
+    writer.BeginArray();
+    writer.BeginObject();
+    writer.Pairs(inner);
+    writer.EndObject();
+    writer.Value(NullUniValue);
+    writer.BeginObject();
+    writer.EndObject();
+    writer.Value(-7);
+    writer.EndArray();
+    writer.Key("flag");
+    writer.Value(true);
+    writer.EndObject();
+    BOOST_CHECK(!writer.Flushed());
+    writer.Flush();
+    BOOST_CHECK(writer.Flushed());
+
+    BOOST_CHECK_EQUAL(out, expected.write());
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_chunks)
+{
+    std::vector<std::string> chunks;
+    JSONStreamWriter writer([&chunks](const std::string& chunk) { chunks.push_back(chunk); }, 16);
+    UniValue expected(UniValue::VARR);
+    writer.BeginArray();
+    for (int i = 0; i < 100; i++) {
+        expected.push_back(i);
+        writer.Value(i);
+    }
+    writer.EndArray();
+    std::string rest = writer.Release();
+
+    // Output is handed over once the flush size is reached, not per value
+    BOOST_CHECK(chunks.size() > 1);
+    BOOST_CHECK(chunks.size() < 100);
+    std::string out;
+    for (const std::string& chunk : chunks) {
+        BOOST_CHECK(chunk.size() >= 16);
+        out += chunk;
+    }
+    BOOST_CHECK_EQUAL(out + rest, expected.write());
+
+    // Nothing is left to flush after Release
+    size_t nChunks = chunks.size();
+    writer.Flush();
+    BOOST_CHECK_EQUAL(chunks.size(), nChunks);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
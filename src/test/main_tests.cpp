@@ -3,6 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chainparams.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <miner.h>
+#include <pow.h>
+#include <streams.h>
 #include <validation.h>
 #include <net.h>
 
@@ -74,4 +79,89 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+/** Mine a block on hashPrev from the coinbase of tmpl, without processing it */
+static std::shared_ptr<CBlock> MineBlockOn(const CBlock& tmpl, const uint256& hashPrev, int nHeight, uint32_t nTime)
+{
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(tmpl);
+    pblock->vtx.resize(1);
+    CMutableTransaction coinbase(*pblock->vtx[0]);
+    coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    pblock->vtx[0] = MakeTransactionRef(std::move(coinbase));
+    pblock->hashPrevBlock = hashPrev;
+    pblock->nTime = nTime;
+    pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+    while (!CheckProofOfWork(pblock->GetPoWHash(), pblock->nBits, Params().GetConsensus())) ++pblock->nNonce;
+    return pblock;
+}
+
+/** Append blocks to fileout in the blk?????.dat format */
+static void WriteBlocks(CAutoFile& fileout, const std::vector<std::shared_ptr<CBlock>>& vBlocks)
+{
+    for (const std::shared_ptr<CBlock>& pblock : vBlocks) {
+        unsigned int nSize = GetSerializeSize(fileout, *pblock);
+        fileout << FLATDATA(Params().MessageStart()) << nSize << *pblock;
+    }
+}
+
+static bool HaveBlockData(const uint256& hash)
+{
+    LOCK(cs_main);
+    BlockMap::const_iterator it = mapBlockIndex.find(hash);
+    return it != mapBlockIndex.end() && (it->second->nStatus & BLOCK_HAVE_DATA);
+}
+
+BOOST_FIXTURE_TEST_CASE(reindex_block_files, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlock tmpl = BlockAssembler(chainparams).CreateNewBlock(scriptPubKey)->block;
+
+    uint256 hashPrev;
+    int nHeight;
+    uint32_t nTime;
+    {
+        LOCK(cs_main);
+        hashPrev = chainActive.Tip()->GetBlockHash();
+        nHeight = chainActive.Height();
+        nTime = chainActive.Tip()->GetBlockTime();
+    }
+    std::vector<std::shared_ptr<CBlock>> vBlocks;
+    for (int i = 0; i < 5; i++) {
+        vBlocks.push_back(MineBlockOn(tmpl, hashPrev, ++nHeight, ++nTime));
+        hashPrev = vBlocks.back()->GetHash();
+    }
+
+    // A second block file, with a block stored ahead of its parent. With a one
+    // byte read-ahead budget every block goes through the allowance of the
+    // file being imported.
+    {
+        CAutoFile fileout(fsbridge::fopen(GetBlockPosFilename(CDiskBlockPos(1, 0), "blk"), "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(!fileout.IsNull());
+        WriteBlocks(fileout, {vBlocks[2], vBlocks[0], vBlocks[1]});
+    }
+    ReindexBlockFiles(chainparams, 1);
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK(HaveBlockData(vBlocks[i]->GetHash()));
+    BOOST_CHECK(!HaveBlockData(vBlocks[3]->GetHash()));
+
+    // -loadblock streams external files through LoadExternalBlockFile; blocks
+    // that are already known are not loaded again
+    fs::path pathExternal = GetDataDir() / "bootstrap.dat";
+    {
+        CAutoFile fileout(fsbridge::fopen(pathExternal, "wb"), SER_DISK, CLIENT_VERSION);
+        WriteBlocks(fileout, {vBlocks[2], vBlocks[3], vBlocks[4]});
+    }
+    BOOST_CHECK(LoadExternalBlockFile(chainparams, fsbridge::fopen(pathExternal, "rb")));
+    BOOST_CHECK(HaveBlockData(vBlocks[3]->GetHash()));
+    BOOST_CHECK(HaveBlockData(vBlocks[4]->GetHash()));
+    BOOST_CHECK(!LoadExternalBlockFile(chainparams, fsbridge::fopen(pathExternal, "rb")));
+
+    // The imported blocks connect to the chain
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    LOCK(cs_main);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == vBlocks[4]->GetHash());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
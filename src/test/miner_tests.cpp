@@ -12,6 +12,7 @@
 #include <miner.h>
 #include <policy/policy.h>
 #include <pubkey.h>
+#include <script/sign.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
@@ -524,4 +525,109 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     */
 }
 
+// Spend the first output of a mature test chain coinbase, paying nFee
+static CMutableTransaction SpendCoinbase(const TestChain100Setup& setup, int n, CAmount nFee)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(setup.coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(setup.coinbaseTxns[n].GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = setup.coinbaseTxns[n].vout[0].nValue - nFee;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(setup.coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(CreateNewBlock_reuse_template, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    TestMemPoolEntryHelper entry;
+
+    // Mature the second and third coinbase
+    for (int i = 0; i < 2; i++)
+        CreateAndProcessBlock({}, CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG);
+    LOCK(cs_main);
+
+    CMutableTransaction txLow = SpendCoinbase(*this, 0, 10000);
+    CMutableTransaction txMedium = SpendCoinbase(*this, 1, 20000);
+    CMutableTransaction txHigh = SpendCoinbase(*this, 2, 50000);
+    mempool.addUnchecked(txLow.GetHash(), entry.Fee(10000).SpendsCoinbase(true).FromTx(txLow));
+    mempool.addUnchecked(txMedium.GetHash(), entry.Fee(20000).SpendsCoinbase(true).FromTx(txMedium));
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == txMedium.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == txLow.GetHash());
+
+    // A new transaction is appended after the ones carried over, even though
+    // a full reselection would put it first
+    mempool.addUnchecked(txHigh.GetHash(), entry.Fee(50000).SpendsCoinbase(true).FromTx(txHigh));
+    std::unique_ptr<CBlockTemplate> pnext = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey, true, pblocktemplate.get());
+    BOOST_CHECK_EQUAL(pnext->block.vtx.size(), 4);
+    BOOST_CHECK(pnext->block.vtx[1]->GetHash() == txMedium.GetHash());
+    BOOST_CHECK(pnext->block.vtx[2]->GetHash() == txLow.GetHash());
+    BOOST_CHECK(pnext->block.vtx[3]->GetHash() == txHigh.GetHash());
+    BOOST_CHECK_EQUAL(pnext->vTxFees[0], -80000);
+
+    // Transactions that left the mempool are dropped
+    mempool.removeRecursive(txLow);
+    pnext = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey, true, pnext.get());
+    BOOST_CHECK_EQUAL(pnext->block.vtx.size(), 3);
+    BOOST_CHECK(pnext->block.vtx[1]->GetHash() == txMedium.GetHash());
+    BOOST_CHECK(pnext->block.vtx[2]->GetHash() == txHigh.GetHash());
+
+    // A template built on another tip is not reused
+    pnext->block.hashPrevBlock.SetNull();
+    pnext = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey, true, pnext.get());
+    BOOST_CHECK(pnext->block.vtx[1]->GetHash() == txHigh.GetHash());
+    BOOST_CHECK(pnext->block.vtx[2]->GetHash() == txMedium.GetHash());
+
+    mempool.clear();
+}
+
+BOOST_FIXTURE_TEST_CASE(TestBlockValidity_trust_mempool, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    TestMemPoolEntryHelper entry;
+    LOCK(cs_main);
+
+    // A mempool entry with a bad signature, as if the mempool had accepted it
+    CMutableTransaction tx = SpendCoinbase(*this, 0, 10000);
+    tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1);
+    mempool.addUnchecked(tx.GetHash(), entry.Fee(10000).SpendsCoinbase(true).FromTx(tx));
+
+    // Templates trust the mempool's script checks
+    std::unique_ptr<CBlockTemplate> pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    CBlock block = pblocktemplate->block;
+    CValidationState state;
+    BOOST_CHECK(TestBlockValidity(state, chainparams, block, chainActive.Tip(), false, false, true));
+    BOOST_CHECK(!TestBlockValidity(state, chainparams, block, chainActive.Tip(), false, false, false));
+
+    // A transaction that is not the mempool's own copy is checked in full
+    block.vtx[1] = MakeTransactionRef(tx);
+    state = CValidationState();
+    BOOST_CHECK(!TestBlockValidity(state, chainparams, block, chainActive.Tip(), false, false, true));
+
+    // The coinbase is always checked
+    block = pblocktemplate->block;
+    CMutableTransaction coinbaseTx(*block.vtx[0]);
+    coinbaseTx.vout[0].nValue += 1;
+    block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    state = CValidationState();
+    BOOST_CHECK(!TestBlockValidity(state, chainparams, block, chainActive.Tip(), false, false, true));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-cb-amount");
+
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
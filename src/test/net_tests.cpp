@@ -185,4 +185,40 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(cnode_shared_message)
+{
+    CConnman connman(0x1337, 0x1337);
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr(CService(ipv4Addr, 7777), NODE_NETWORK);
+    std::unique_ptr<CNode> pnode1(new CNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", false));
+    std::unique_ptr<CNode> pnode2(new CNode(1, NODE_NETWORK, 0, INVALID_SOCKET, addr, 1, 1, CAddress(), "", false));
+
+    CSerializedNetMsg msg;
+    msg.command = "ping";
+    msg.data.assign(8, 0x42);
+    const CSharedNetMsg shared = CConnman::MakeSharedMessage(std::move(msg));
+    BOOST_CHECK_EQUAL(shared.header->size(), (size_t)CMessageHeader::HEADER_SIZE);
+    BOOST_CHECK_EQUAL(shared.data->size(), 8U);
+
+    connman.PushMessage(pnode1.get(), shared);
+    connman.PushMessage(pnode2.get(), shared);
+
+    // Both peers queue references to the same buffers; nothing is copied.
+    LOCK2(pnode1->cs_vSend, pnode2->cs_vSend);
+    BOOST_CHECK_EQUAL(pnode1->vSendMsg.size(), 2U);
+    BOOST_CHECK_EQUAL(pnode2->vSendMsg.size(), 2U);
+    BOOST_CHECK(pnode1->vSendMsg[0] == shared.header);
+    BOOST_CHECK(pnode1->vSendMsg[1] == shared.data);
+    BOOST_CHECK(pnode2->vSendMsg[1] == shared.data);
+    BOOST_CHECK_EQUAL(pnode1->nSendSize, (size_t)CMessageHeader::HEADER_SIZE + 8);
+    BOOST_CHECK_EQUAL(shared.data.use_count(), 3);
+
+    // Messages without a payload only queue the header
+    CSerializedNetMsg empty;
+    empty.command = "verack";
+    connman.PushMessage(pnode1.get(), std::move(empty));
+    BOOST_CHECK_EQUAL(pnode1->vSendMsg.size(), 3U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
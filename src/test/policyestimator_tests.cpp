@@ -4,6 +4,7 @@
 
 #include <policy/policy.h>
 #include <policy/fees.h>
+#include <streams.h>
 #include <txmempool.h>
 #include <uint256.h>
 #include <util.h>
@@ -179,4 +180,54 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimatesPersist)
+{
+    CBlockPolicyEstimator feeEst;
+    CTxMemPool mpool(&feeEst);
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 0LL;
+
+    // Enough blocks for the short horizon's decay to be folded into its
+    // averages at least once. Everything confirms, so the unconfirmed counts
+    // that aren't persisted don't matter.
+    std::vector<CTransactionRef> block;
+    for (int blocknum = 0; blocknum < 600; blocknum++) {
+        for (int j = 0; j < 10; j++) {
+            tx.vin[0].prevout.n = 100 * blocknum + j;
+            uint256 hash = tx.GetHash();
+            mpool.addUnchecked(hash, entry.Fee(1000 * (j + 1)).Time(GetTime()).Height(blocknum).FromTx(tx));
+            block.push_back(mpool.get(hash));
+        }
+        mpool.removeForBlock(block, blocknum + 1);
+        block.clear();
+    }
+
+    fs::path path = fs::temp_directory_path() / fs::unique_path();
+    {
+        CAutoFile fileout(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(feeEst.Write(fileout));
+    }
+    CBlockPolicyEstimator feeEst2;
+    {
+        CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(feeEst2.Read(filein));
+    }
+    fs::remove(path);
+
+    for (FeeEstimateHorizon horizon : {FeeEstimateHorizon::SHORT_HALFLIFE, FeeEstimateHorizon::MED_HALFLIFE, FeeEstimateHorizon::LONG_HALFLIFE}) {
+        for (int target = 1; target <= 12; target++) {
+            EstimationResult result, result2;
+            CFeeRate rate = feeEst.estimateRawFee(target, 0.85, horizon, &result);
+            CFeeRate rate2 = feeEst2.estimateRawFee(target, 0.85, horizon, &result2);
+            BOOST_CHECK(rate == rate2);
+            BOOST_CHECK_CLOSE(result.pass.totalConfirmed, result2.pass.totalConfirmed, 1e-6);
+        }
+    }
+    BOOST_CHECK(feeEst.estimateRawFee(2, 0.85, FeeEstimateHorizon::SHORT_HALFLIFE) != CFeeRate(0));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
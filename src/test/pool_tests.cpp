@@ -0,0 +1,97 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <memusage.h>
+#include <support/allocators/pool.h>
+#include <test/test_drivenet.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_resource_reuse)
+{
+    PoolResource<64, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+    void* a = resource.Allocate(24, 8);
+    void* b = resource.Allocate(24, 8);
+    BOOST_CHECK(a != b);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK_EQUAL(static_cast<char*>(b) - static_cast<char*>(a), 24);
+
+    // Freed blocks are handed out again for the same size class
+    resource.Deallocate(a, 24, 8);
+    BOOST_CHECK(resource.Allocate(17, 8) == a);
+
+    // Other size classes do not pick up the freed block
+    resource.Deallocate(b, 24, 8);
+    void* c = resource.Allocate(32, 8);
+    BOOST_CHECK(c != b);
+    resource.Deallocate(c, 32, 8);
+
+    // Too large or overaligned requests bypass the pool
+    void* big = resource.Allocate(65, 8);
+    void* aligned = resource.Allocate(8, 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    resource.Deallocate(big, 65, 8);
+    resource.Deallocate(aligned, 8, 16);
+}
+
+BOOST_AUTO_TEST_CASE(pool_resource_chunks)
+{
+    PoolResource<64, 8> resource(1024);
+    std::vector<void*> blocks;
+    for (int i = 0; i < 64; ++i) {
+        blocks.push_back(resource.Allocate(64, 8));
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 4U);
+
+    // After freeing everything no new chunks are needed
+    for (void* p : blocks) {
+        resource.Deallocate(p, 64, 8);
+    }
+    for (int i = 0; i < 64; ++i) {
+        resource.Allocate(64, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 4U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator_unordered_map)
+{
+    typedef std::pair<const uint64_t, uint64_t> Value;
+    typedef std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                               PoolAllocator<Value, sizeof(Value) + sizeof(void*) * 4>> Map;
+
+    Map::allocator_type::ResourceType resource;
+    {
+        Map map{0, Map::hasher{}, Map::key_equal{}, &resource};
+        for (uint64_t i = 0; i < 10000; ++i) {
+            map[i] = i * i;
+        }
+        for (uint64_t i = 0; i < 10000; i += 2) {
+            map.erase(i);
+        }
+        BOOST_CHECK_EQUAL(map.size(), 5000U);
+        for (uint64_t i = 1; i < 10000; i += 2) {
+            BOOST_CHECK_EQUAL(map.at(i), i * i);
+        }
+        // Nodes come from the pool, so usage is accounted in whole chunks
+        BOOST_CHECK(resource.NumAllocatedChunks() > 0);
+        BOOST_CHECK(memusage::DynamicUsage(map) >= resource.NumAllocatedChunks() * resource.ChunkSizeBytes());
+
+        // Reinserting reuses freed nodes
+        const size_t chunks = resource.NumAllocatedChunks();
+        for (uint64_t i = 0; i < 10000; i += 2) {
+            map[i] = i;
+        }
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), chunks);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -345,4 +345,35 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_batch_order)
+{
+    SetRPCWarmupFinished();
+
+    // Runs of concurrent calls, separated by calls that execute alone
+    UniValue batch(UniValue::VARR);
+    for (int i = 0; i < 50; i++) {
+        UniValue req(UniValue::VOBJ);
+        UniValue params(UniValue::VARR);
+        params.push_back(i);
+        req.pushKV("method", i % 20 == 7 ? "nosuchmethod" : "echo");
+        req.pushKV("params", params);
+        req.pushKV("id", i);
+        batch.push_back(req);
+    }
+    batch.push_back(UniValue("not an object"));
+
+    UniValue reply;
+    BOOST_CHECK(reply.read(JSONRPCExecBatch(JSONRPCRequest(), batch)));
+    BOOST_CHECK_EQUAL(reply.size(), batch.size());
+    for (int i = 0; i < 50; i++) {
+        BOOST_CHECK_EQUAL(find_value(reply[i], "id").get_int(), i);
+        if (i % 20 == 7) {
+            BOOST_CHECK_EQUAL(find_value(find_value(reply[i], "error"), "code").get_int(), RPC_METHOD_NOT_FOUND);
+        } else {
+            BOOST_CHECK_EQUAL(find_value(reply[i], "result")[0].get_int(), i);
+        }
+    }
+    BOOST_CHECK(!find_value(reply[50], "error").isNull());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
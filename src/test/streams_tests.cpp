@@ -71,6 +71,42 @@ BOOST_AUTO_TEST_CASE(streams_vector_writer)
     vch.clear();
 }
 
+BOOST_AUTO_TEST_CASE(streams_span_reader)
+{
+    unsigned char bytes[] = { 3, 4, 5, 6 };
+    CSpanReader reader(SER_NETWORK, INIT_PROTO_VERSION, bytes, sizeof(bytes));
+    BOOST_CHECK_EQUAL(reader.size(), 4U);
+
+    unsigned char a, b;
+    reader >> a >> b;
+    BOOST_CHECK_EQUAL(a, 3);
+    BOOST_CHECK_EQUAL(b, 4);
+    BOOST_CHECK_EQUAL(reader.size(), 2U);
+    BOOST_CHECK(!reader.empty());
+
+    // Reading past the end throws and does not consume anything
+    uint32_t n;
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+    BOOST_CHECK_EQUAL(reader.size(), 2U);
+
+    reader.ignore(1);
+    reader >> a;
+    BOOST_CHECK_EQUAL(a, 6);
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader.ignore(1), std::ios_base::failure);
+
+    // Round trip through a CVectorWriter
+    std::vector<unsigned char> vch;
+    CVectorWriter(SER_NETWORK, INIT_PROTO_VERSION, vch, 0, std::string("span"), uint64_t{42});
+    CSpanReader reader2(SER_NETWORK, INIT_PROTO_VERSION, vch.data(), vch.size());
+    std::string str;
+    uint64_t n64;
+    reader2 >> str >> n64;
+    BOOST_CHECK_EQUAL(str, "span");
+    BOOST_CHECK_EQUAL(n64, 42U);
+    BOOST_CHECK(reader2.empty());
+}
+
 BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
 {
     std::vector<char> in;
@@ -0,0 +1,76 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <sync.h>
+#include <utiltime.h>
+
+#include <test/test_drivenet.h>
+
+#include <future>
+#include <string>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sync_tests, BasicTestingSetup)
+
+static int LockOnce(CCriticalSection& cs)
+{
+    LOCK(cs); return __LINE__;
+}
+
+static LockSite* FindSite(int nLine)
+{
+    for (LockSite* site = GetLockSites(); site; site = site->Next()) {
+        if (site->nLine == nLine && std::string(site->pszFile) == __FILE__)
+            return site;
+    }
+    return nullptr;
+}
+
+BOOST_AUTO_TEST_CASE(lock_site_stats)
+{
+    CCriticalSection cs;
+    LockSite* site = FindSite(LockOnce(cs));
+    BOOST_REQUIRE(site);
+    site->Reset();
+
+    for (int i = 0; i < 10; i++) {
+        LockOnce(cs);
+    }
+    BOOST_CHECK_EQUAL(site->nAcquired, 10);
+    BOOST_CHECK_EQUAL(site->nContended, 0);
+    uint64_t nHeld = 0;
+    for (int i = 0; i < LOCK_STATS_BUCKETS; i++) {
+        nHeld += site->holdHist[i];
+    }
+    BOOST_CHECK_EQUAL(nHeld, 10);
+
+    // Wait on a lock held by another thread for ~20ms
+    std::promise<void> locked;
+    std::thread holder([&cs, &locked] {
+        LOCK(cs);
+        locked.set_value();
+        MilliSleep(20);
+    });
+    locked.get_future().wait();
+    LockOnce(cs);
+    holder.join();
+
+    BOOST_CHECK_EQUAL(site->nAcquired, 11);
+    BOOST_CHECK_EQUAL(site->nContended, 1);
+    BOOST_CHECK_GE(site->nWaitMicros, 10000);
+    // 10ms or more lands in bucket 14 or above
+    uint64_t nLongWaits = 0;
+    for (int i = 14; i < LOCK_STATS_BUCKETS; i++) {
+        nLongWaits += site->waitHist[i];
+    }
+    BOOST_CHECK_EQUAL(nLongWaits, 1);
+
+    site->Reset();
+    BOOST_CHECK_EQUAL(site->nAcquired, 0);
+    BOOST_CHECK_EQUAL(site->nWaitMicros, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -20,6 +20,7 @@
 #include <script/script_error.h>
 #include <script/standard.h>
 #include <utilstrencodings.h>
+#include <workerpool.h>
 
 #include <map>
 #include <string>
@@ -492,6 +493,58 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction) {
     threadGroup.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(test_parallel_signing)
+{
+    CBasicKeyStore keystore;
+    std::vector<CScript> scriptPubKeys;
+    for (int i = 0; i < 3; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        keystore.AddKeyPubKey(key, key.GetPubKey());
+        const CKeyID keyid = key.GetPubKey().GetID();
+        scriptPubKeys.push_back(GetScriptForDestination(keyid));
+        CScript witness = GetScriptForDestination(WitnessV0KeyHash(keyid));
+        keystore.AddCScript(witness);
+        scriptPubKeys.push_back(witness);
+        scriptPubKeys.push_back(GetScriptForDestination(CScriptID(witness)));
+    }
+
+    const std::vector<int> sigHashes{SIGHASH_ALL, SIGHASH_NONE, SIGHASH_SINGLE | SIGHASH_ANYONECANPAY};
+    const unsigned int nInputs = 16 * MIN_ITEMS_PER_WORKER;
+    CMutableTransaction mtx;
+    for (unsigned int i = 0; i < nInputs; i++) {
+        mtx.vin.emplace_back(COutPoint(uint256S("0x0100"), i));
+        mtx.vout.emplace_back(1000, CScript() << OP_1);
+    }
+
+    // Signing inputs in parallel against the unsigned transaction gives the
+    // same result as signing them one after the other.
+    CMutableTransaction sequential = mtx;
+    for (unsigned int i = 0; i < nInputs; i++) {
+        BOOST_CHECK(SignSignature(keystore, scriptPubKeys[i % scriptPubKeys.size()], sequential, i, 1000 + i, sigHashes[i % sigHashes.size()]));
+    }
+
+    const CTransaction txConst(mtx);
+    const PrecomputedTransactionData txdata(txConst);
+    std::vector<SignatureData> vSigData(nInputs);
+    std::vector<int> vCalls(nInputs, 0);
+    ForEachInputParallel(nInputs, [&](unsigned int i) {
+        vCalls[i]++;
+        TransactionSignatureCreator creator(&keystore, &txConst, i, 1000 + i, sigHashes[i % sigHashes.size()], &txdata);
+        ProduceSignature(creator, scriptPubKeys[i % scriptPubKeys.size()], vSigData[i]);
+    });
+    for (unsigned int i = 0; i < nInputs; i++) {
+        BOOST_CHECK_EQUAL(vCalls[i], 1);
+        UpdateTransaction(mtx, i, vSigData[i]);
+    }
+    BOOST_CHECK(CTransaction(mtx).GetWitnessHash() == CTransaction(sequential).GetWitnessHash());
+
+    // Exceptions reach the caller
+    BOOST_CHECK_THROW(ForEachInputParallel(nInputs, [](unsigned int i) {
+        if (i == 42) throw std::runtime_error("signing failed");
+    }), std::runtime_error);
+}
+
 BOOST_AUTO_TEST_CASE(test_witness)
 {
     CBasicKeyStore keystore, keystore2;
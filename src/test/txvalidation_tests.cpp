@@ -8,7 +8,9 @@
 #include <consensus/validation.h>
 #include <primitives/transaction.h>
 #include <script/script.h>
+#include <script/standard.h>
 #include <test/test_drivenet.h>
+#include <utiltime.h>
 
 #include <boost/test/unit_test.hpp>
 
@@ -58,4 +60,101 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK_EQUAL(nDoS, 100);
 }
 
+/**
+ * Ensure mempool.dat round-trips, both on the tip it was dumped on and after
+ * the tip has moved on.
+ */
+BOOST_FIXTURE_TEST_CASE(mempool_dump_load, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CScript redeemScript = CScript() << OP_TRUE;
+    CScript scriptP2SH = GetScriptForDestination(CScriptID(redeemScript));
+
+    // A parent spending a mature coinbase, and two children
+    CMutableTransaction parent;
+    parent.vin.resize(1);
+    parent.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    parent.vout.resize(2);
+    for (CTxOut& out : parent.vout) {
+        out.nValue = 24 * COIN;
+        out.scriptPubKey = scriptP2SH;
+    }
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, parent, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    parent.vin[0].scriptSig << vchSig;
+
+    std::vector<CMutableTransaction> txs{parent};
+    for (uint32_t i = 0; i < 2; i++) {
+        CMutableTransaction child;
+        child.vin.resize(1);
+        child.vin[0].prevout = COutPoint(parent.GetHash(), i);
+        child.vin[0].scriptSig = CScript() << std::vector<unsigned char>(redeemScript.begin(), redeemScript.end());
+        child.vout.resize(1);
+        child.vout[0].nValue = (23 - i) * COIN;
+        child.vout[0].scriptPubKey = scriptPubKey;
+        txs.push_back(child);
+    }
+
+    {
+        LOCK(cs_main);
+        for (const CMutableTransaction& tx : txs) {
+            CValidationState state;
+            BOOST_CHECK(AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), nullptr /* pfMissingInputs */,
+                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */));
+        }
+    }
+    BOOST_CHECK_EQUAL(mempool.size(), 3);
+
+    auto check_pool = [&]() {
+        LOCK(mempool.cs);
+        BOOST_CHECK_EQUAL(mempool.size(), 3);
+        for (const CMutableTransaction& tx : txs) {
+            CTxMemPool::txiter it = mempool.mapTx.find(tx.GetHash());
+            BOOST_CHECK(it != mempool.mapTx.end());
+        }
+        CTxMemPool::txiter it = mempool.mapTx.find(parent.GetHash());
+        BOOST_CHECK_EQUAL(it->GetFee(), 2 * COIN);
+        BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 3);
+        it = mempool.mapTx.find(txs[2].GetHash());
+        BOOST_CHECK_EQUAL(it->GetFee(), 2 * COIN);
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 2);
+    };
+
+    // Same tip: added without revalidation
+    int64_t nAddedDirectly = 0;
+    BOOST_CHECK(DumpMempool());
+    mempool.clear();
+    BOOST_CHECK(LoadMempool(&nAddedDirectly));
+    BOOST_CHECK_EQUAL(nAddedDirectly, 3);
+    check_pool();
+
+    // A transaction with a bad signature only sends itself down the full path
+    CMutableTransaction bad;
+    bad.vin.resize(1);
+    bad.vin[0].prevout = COutPoint(coinbaseTxns[1].GetHash(), 0);
+    bad.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30);
+    bad.vout.resize(1);
+    bad.vout[0].nValue = coinbaseTxns[1].vout[0].nValue - COIN;
+    bad.vout[0].scriptPubKey = scriptPubKey;
+    {
+        LOCK(mempool.cs);
+        mempool.addUnchecked(bad.GetHash(), TestMemPoolEntryHelper().Fee(COIN).Time(GetTime()).SpendsCoinbase(true).FromTx(bad));
+    }
+    BOOST_CHECK(DumpMempool());
+    mempool.clear();
+    BOOST_CHECK(LoadMempool(&nAddedDirectly));
+    BOOST_CHECK_EQUAL(nAddedDirectly, 3);
+    check_pool();
+
+    // New tip: everything is revalidated
+    BOOST_CHECK(DumpMempool());
+    mempool.clear();
+    CreateAndProcessBlock({}, scriptPubKey);
+    BOOST_CHECK(LoadMempool(&nAddedDirectly));
+    BOOST_CHECK_EQUAL(nAddedDirectly, 0);
+    check_pool();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
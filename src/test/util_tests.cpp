@@ -5,12 +5,15 @@
 #include <util.h>
 
 #include <clientversion.h>
+#include <core_io.h>
 #include <primitives/transaction.h>
+#include <streams.h>
 #include <sync.h>
 #include <utilstrencodings.h>
 #include <utilmoneystr.h>
 #include <test/test_drivenet.h>
 
+#include <deque>
 #include <stdint.h>
 #include <vector>
 
@@ -87,6 +90,79 @@ BOOST_AUTO_TEST_CASE(util_HexStr)
         "04 67 8a fd b0");
 }
 
+BOOST_AUTO_TEST_CASE(util_Hex_blocks)
+{
+    // Lengths around the 16 byte blocks handled at once, with every byte value
+    static const char hexmap[] = "0123456789abcdef";
+    static const char hexmap_upper[] = "0123456789ABCDEF";
+    for (size_t len = 0; len < 70; len++) {
+        std::vector<unsigned char> data(len);
+        std::string expected, upper;
+        for (size_t i = 0; i < len; i++) {
+            data[i] = (unsigned char)(i * 37 + len);
+            expected += hexmap[data[i] >> 4];
+            expected += hexmap[data[i] & 15];
+            upper += hexmap_upper[data[i] >> 4];
+            upper += hexmap_upper[data[i] & 15];
+        }
+        BOOST_CHECK_EQUAL(HexStr(data), expected);
+        BOOST_CHECK_EQUAL(HexStr(data.data(), data.data() + data.size()), expected);
+        BOOST_CHECK(ParseHex(expected) == data);
+        BOOST_CHECK(ParseHex(upper) == data);
+        BOOST_CHECK_EQUAL(IsHex(expected), len > 0);
+    }
+
+    // Reverse iterators are encoded in their own order
+    std::vector<unsigned char> vch{0x01, 0x02, 0x03};
+    BOOST_CHECK_EQUAL(HexStr(vch.rbegin(), vch.rend()), "030201");
+
+    // Only iterators known to be contiguous take the block path
+    static_assert(IsHexEncodableIterator<const unsigned char*>::value, "");
+    static_assert(IsHexEncodableIterator<std::vector<unsigned char>::const_iterator>::value, "");
+    static_assert(IsHexEncodableIterator<std::string::iterator>::value, "");
+    static_assert(IsHexEncodableIterator<CScript::const_iterator>::value, "");
+    static_assert(!IsHexEncodableIterator<const uint32_t*>::value, "");
+    static_assert(!IsHexEncodableIterator<std::vector<unsigned char>::reverse_iterator>::value, "");
+    static_assert(!IsHexEncodableIterator<CScript::reverse_iterator>::value, "");
+    static_assert(!IsHexEncodableIterator<std::deque<unsigned char>::iterator>::value, "");
+    static_assert(IsHexEncodableIterator<CDataStream::const_iterator>::value, "");
+    static_assert(IsHexEncodableIterator<CSerializeData::iterator>::value, "");
+    std::deque<unsigned char> deq(vch.begin(), vch.end());
+    BOOST_CHECK_EQUAL(HexStr(deq.begin(), deq.end()), "010203");
+
+    // Serialized transactions are encoded from the CDataStream buffer
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(100, 0xab);
+    mtx.vout.resize(2);
+    mtx.vout[0].nValue = 12345;
+    mtx.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << mtx;
+    std::deque<char> deqTx(ssTx.begin(), ssTx.end());
+    BOOST_CHECK_EQUAL(EncodeHexTx(mtx), HexStr(deqTx.begin(), deqTx.end()));
+
+    // Characters just outside the digit ranges stop parsing wherever they are
+    const std::string hex = "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff";
+    for (char c : std::string("/:@G`g \x80")) {
+        for (size_t pos = 0; pos < hex.size(); pos++) {
+            std::string str = hex;
+            str[pos] = c;
+            BOOST_CHECK(!IsHex(str));
+            std::vector<unsigned char> result = ParseHex(str);
+            if (c == ' ' && pos % 2 == 0) {
+                // Whitespace is skipped in front of a byte
+                BOOST_CHECK_EQUAL(result.size(), hex.size() / 2 - 1);
+            } else {
+                BOOST_CHECK_EQUAL(result.size(), pos / 2);
+            }
+            BOOST_CHECK(std::equal(result.begin(), result.begin() + pos / 2, ParseHex(hex).begin()));
+        }
+    }
+
+    // Whitespace between bytes is accepted anywhere in long inputs
+    BOOST_CHECK(ParseHex("00112233445566778899aabbccddeeff 00112233445566778899aabbccddeeff") == ParseHex(hex));
+}
 
 BOOST_AUTO_TEST_CASE(util_DateTimeStrFormat)
 {
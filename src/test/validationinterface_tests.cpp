@@ -0,0 +1,93 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <scheduler.h>
+#include <utiltime.h>
+#include <validationinterface.h>
+
+#include <test/test_drivenet.h>
+
+#include <atomic>
+#include <future>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, TestingSetup)
+
+class TxCounter : public CValidationInterface
+{
+public:
+    std::atomic<int> nTxs{0};
+    std::shared_future<void> gate;
+
+protected:
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override
+    {
+        if (gate.valid()) gate.wait();
+        ++nTxs;
+    }
+};
+
+static ValidationQueueStats GetStats(const std::string& name)
+{
+    for (const ValidationQueueStats& stats : GetMainSignals().GetQueueStats()) {
+        if (stats.name == name) return stats;
+    }
+    BOOST_ERROR("no queue named " + name);
+    return ValidationQueueStats();
+}
+
+BOOST_AUTO_TEST_CASE(slow_subscriber_does_not_block_others)
+{
+    // A second thread to service the other subscriber's queue
+    threadGroup.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+
+    std::promise<void> release;
+    TxCounter slow, fast;
+    slow.gate = release.get_future().share();
+    RegisterValidationInterface(&slow, "slow");
+    RegisterValidationInterface(&fast, "fast");
+
+    CTransactionRef tx = MakeTransactionRef(CMutableTransaction());
+    for (int i = 0; i < 5; i++) {
+        GetMainSignals().TransactionAddedToMempool(tx);
+    }
+    for (int i = 0; i < 1000 && fast.nTxs < 5; i++) {
+        MilliSleep(10);
+    }
+    BOOST_CHECK_EQUAL(fast.nTxs, 5);
+    BOOST_CHECK_EQUAL(slow.nTxs, 0);
+    BOOST_CHECK_EQUAL(GetStats("fast").nProcessed, 5);
+    BOOST_CHECK_EQUAL(GetStats("slow").nProcessed, 0);
+    BOOST_CHECK_GE(GetStats("slow").nMaxPending, 4);
+    BOOST_CHECK_EQUAL(GetMainSignals().CallbacksPending(), GetStats("slow").nPending);
+
+    // Syncing with one subscriber doesn't wait for the others
+    GetMainSignals().TransactionAddedToMempool(tx);
+    SyncWithValidationInterfaceQueue(&fast);
+    BOOST_CHECK_EQUAL(fast.nTxs, 6);
+    BOOST_CHECK_EQUAL(slow.nTxs, 0);
+
+    // Backpressure doesn't wait for a queue within the limit
+    LimitValidationInterfaceQueues(10);
+    BOOST_CHECK_EQUAL(slow.nTxs, 0);
+
+    release.set_value();
+    SyncWithValidationInterfaceQueue(&slow);
+    BOOST_CHECK_EQUAL(slow.nTxs, 6);
+    BOOST_CHECK_EQUAL(GetStats("slow").nProcessed, 6);
+    BOOST_CHECK_EQUAL(GetStats("slow").nPending, 0);
+
+    // An unregistered subscriber gets no more callbacks
+    SyncWithValidationInterfaceQueue(&fast);
+    UnregisterValidationInterface(&fast);
+    GetMainSignals().TransactionAddedToMempool(tx);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(fast.nTxs, 6);
+    BOOST_CHECK_EQUAL(slow.nTxs, 7);
+    UnregisterValidationInterface(&slow);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
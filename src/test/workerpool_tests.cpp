@@ -0,0 +1,72 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <workerpool.h>
+
+#include <test/test_drivenet.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(workerpool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(workerpool_submit)
+{
+    std::vector<std::future<int>> results;
+    {
+        CWorkerPool pool(2, "test");
+        BOOST_CHECK_EQUAL(pool.GetThreadCount(), 2);
+        for (int i = 0; i < 100; i++)
+            results.push_back(pool.Submit([i]() { return i * i; }));
+        std::future<void> failed = pool.Submit([]() { throw std::runtime_error("task"); });
+        BOOST_CHECK_THROW(failed.get(), std::runtime_error);
+    }
+    // Queued tasks still run when the pool is destroyed
+    for (int i = 0; i < 100; i++)
+        BOOST_CHECK_EQUAL(results[i].get(), i * i);
+}
+
+BOOST_AUTO_TEST_CASE(workerpool_foreach)
+{
+    CWorkerPool pool(3, "test");
+    const size_t nItems = 1000;
+
+    std::vector<std::atomic<int>> vCalls(nItems);
+    for (std::atomic<int>& nCalls : vCalls)
+        nCalls = 0;
+    pool.ForEach(nItems, 1, [&](size_t i) { vCalls[i]++; });
+    for (size_t i = 0; i < nItems; i++)
+        BOOST_CHECK_EQUAL(vCalls[i].load(), 1);
+
+    // Too few items per worker runs everything on the calling thread
+    const std::thread::id caller = std::this_thread::get_id();
+    std::atomic<int> nOther(0);
+    pool.ForEach(7, MIN_ITEMS_PER_WORKER, [&](size_t) {
+        if (std::this_thread::get_id() != caller)
+            nOther++;
+    });
+    BOOST_CHECK_EQUAL(nOther.load(), 0);
+
+    // The first exception is rethrown and stops handing out items
+    std::atomic<size_t> nRun(0);
+    BOOST_CHECK_THROW(pool.ForEach(nItems, 1, [&](size_t i) {
+        nRun++;
+        if (i == 0)
+            throw std::runtime_error("item");
+    }), std::runtime_error);
+    BOOST_CHECK(nRun.load() >= 1);
+
+    // Nesting from within pool threads cannot run out of threads
+    std::atomic<size_t> nInner(0);
+    pool.ForEach(8, 1, [&](size_t) {
+        pool.ForEach(100, 1, [&](size_t) { nInner++; });
+    });
+    BOOST_CHECK_EQUAL(nInner.load(), 800U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
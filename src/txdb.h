@@ -81,6 +81,14 @@ public:
     CCoinsViewCursor *Cursor() const override;
     CCoinsViewLoadedCursor *LoadedCursor() const;
 
+    /**
+     * Write the dirty entries of mapCoins, leaving the map untouched. Unless
+     * fComplete is set the database stays marked as being in transition
+     * towards hashBlock, so ReplayBlocks can finish the job after a crash.
+     * Safe to call from a background thread.
+     */
+    bool WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fComplete);
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
@@ -98,6 +106,9 @@ public:
     bool WriteLoadedCoins(); // Note: only used for creating loaded_coins.dat
     std::vector<LoadedCoin> ReadMyLoadedCoins();
     void WriteMyLoadedCoins(const std::vector<LoadedCoin>& vLoadedCoin);
+
+private:
+    bool WriteEntries(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase, bool fComplete);
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
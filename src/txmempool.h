@@ -133,6 +133,7 @@ public:
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint64_t m_epoch; //!< Last CTxMemPool walk epoch that visited this entry
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -523,6 +524,35 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
+    // Ancestor and descendant walks mark the entries they reach with the
+    // current epoch instead of collecting them in temporary sets, and stage
+    // them in scratch vectors that keep their capacity between walks.
+    mutable uint64_t m_epoch;
+    mutable bool m_has_epoch_guard;
+    mutable std::vector<txiter> m_walk_stage;
+    mutable std::vector<txiter> m_walk_found;
+
+    /** Starts a new epoch for one walk. Walks share the epoch and the scratch
+     *  vectors, so they must not nest. Requires cs. */
+    class EpochGuard
+    {
+    public:
+        explicit EpochGuard(const CTxMemPool& pool);
+        ~EpochGuard();
+    private:
+        const CTxMemPool& pool;
+    };
+
+    /** Mark an entry as visited in the current epoch; returns whether it already was */
+    bool visited(txiter it) const
+    {
+        assert(m_has_epoch_guard);
+        if (it->m_epoch == m_epoch)
+            return true;
+        it->m_epoch = m_epoch;
+        return false;
+    }
+
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
@@ -8,8 +8,58 @@
 #include "univalue.h"
 #include "univalue_utffilter.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 
+// Skip JSON whitespace, returning a pointer to the first other character
+static const char *skip_space(const char *raw, const char *end)
+{
+#if defined(__SSE2__)
+    while (end - raw >= 16) {
+        const __m128i c = _mm_loadu_si128((const __m128i *)raw);
+        const __m128i space = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(0x20)), _mm_cmpeq_epi8(c, _mm_set1_epi8(0x09))),
+            _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(0x0a)), _mm_cmpeq_epi8(c, _mm_set1_epi8(0x0d))));
+        const int mask = ~_mm_movemask_epi8(space) & 0xffff;
+        if (mask)
+            return raw + __builtin_ctz(mask);
+        raw += 16;
+    }
+#endif
+    while (raw < end && (json_isspace(*raw)))
+        raw++;
+    return raw;
+}
+
+// Skip string characters that need no special handling (printable 7-bit
+// ASCII other than '"' and '\'), returning a pointer to the first other one
+static const char *skip_plain(const char *raw, const char *end)
+{
+#if defined(__SSE2__)
+    while (end - raw >= 16) {
+        const __m128i c = _mm_loadu_si128((const __m128i *)raw);
+        // Signed comparison, so bytes >= 0x80 count as below 0x20 too
+        const __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('"')), _mm_cmpeq_epi8(c, _mm_set1_epi8('\\'))),
+            _mm_cmplt_epi8(c, _mm_set1_epi8(0x20)));
+        const int mask = _mm_movemask_epi8(special);
+        if (mask)
+            return raw + __builtin_ctz(mask);
+        raw += 16;
+    }
+#endif
+    while (raw < end) {
+        unsigned char ch = *raw;
+        if (ch < 0x20 || ch >= 0x80 || ch == '"' || ch == '\\')
+            break;
+        raw++;
+    }
+    return raw;
+}
+
 static bool json_isdigit(int ch)
 {
     return ((ch >= '0') && (ch <= '9'));
@@ -50,8 +100,7 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
 
     const char *rawStart = raw;
 
-    while (raw < end && (json_isspace(*raw)))          // skip whitespace
-        raw++;
+    raw = skip_space(raw, end);                        // skip whitespace
 
     if (raw >= end)
         return JTOK_NONE;
@@ -166,7 +215,7 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
             }
         }
 
-        tokenVal = numStr;
+        tokenVal.swap(numStr);
         consumed = (raw - rawStart);
         return JTOK_NUMBER;
         }
@@ -178,6 +227,10 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
         JSONUTF8StringFilter writer(valStr);
 
         while (true) {
+            const char *plain = skip_plain(raw, end);
+            writer.append(raw, plain);
+            raw = plain;
+
             if (raw >= end || (unsigned char)*raw < 0x20)
                 return JTOK_ERR;
 
@@ -228,7 +281,7 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
 
         if (!writer.finalize())
             return JTOK_ERR;
-        tokenVal = valStr;
+        tokenVal.swap(valStr);
         consumed = (raw - rawStart);
         return JTOK_STRING;
         }
@@ -423,13 +476,14 @@ bool UniValue::read(const char *raw, size_t size)
                 clearExpect(OBJ_NAME);
                 setExpect(COLON);
             } else {
-                UniValue tmpVal(VSTR, tokenVal);
                 if (!stack.size()) {
-                    *this = tmpVal;
+                    setStr(tokenVal);
                     break;
                 }
+                // Strings can be megabytes of hex, so move rather than copy
                 UniValue *top = stack.back();
-                top->values.push_back(tmpVal);
+                top->values.push_back(UniValue(VSTR));
+                top->values.back().val.swap(tokenVal);
             }
 
             setExpect(NOT_VALUE);
@@ -45,6 +45,15 @@ public:
                 push_back_u(codepoint);
         }
     }
+    // Write a run of 7-bit ASCII characters
+    void append(const char *begin, const char *end)
+    {
+        if (state == 0) // fast direct pass-through, as in push_back
+            str.append(begin, end);
+        else
+            for (; begin != end; ++begin)
+                push_back(*begin);
+    }
     // Write codepoint directly, possibly collating surrogate pairs
     void push_back_u(unsigned int codepoint_)
     {
@@ -12,6 +12,10 @@
 #include <errno.h>
 #include <limits>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 static const std::string CHARS_ALPHA_NUM = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
 
 static const std::string SAFE_CHARS[] =
@@ -55,9 +59,93 @@ signed char HexDigit(char c)
     return p_util_hexdigit[(unsigned char)c];
 }
 
+namespace {
+
+#if defined(__SSE2__)
+/** Hex digits for the 16 nibbles (values 0-15) in n */
+inline __m128i NibblesToHex(__m128i n)
+{
+    const __m128i letter = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+    return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), _mm_and_si128(letter, _mm_set1_epi8('a' - '0' - 10)));
+}
+
+/**
+ * Decode 16 hex digits at psz into 8 bytes at out. Returns false, possibly
+ * after writing to out, if any of the characters is not a hex digit.
+ */
+inline bool DecodeHexBlock(const char* psz, unsigned char* out)
+{
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(psz));
+    // Setting bit 5 lowercases letters and leaves digits alone. Bytes >= 0x80
+    // are negative in the signed comparisons and so never match.
+    const __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    const __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    if (_mm_movemask_epi8(_mm_or_si128(digit, letter)) != 0xffff)
+        return false;
+    const __m128i n = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+                                   _mm_andnot_si128(digit, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    // Each 16-bit lane holds a high nibble in its low byte and a low nibble
+    // in its high byte; combine them and pack the lanes into bytes.
+    const __m128i bytes = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n, _mm_set1_epi16(0x00ff)), 4), _mm_srli_epi16(n, 8));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(bytes, bytes));
+    return true;
+}
+#endif
+
+/**
+ * Decode leading blocks of 16 hex digits of psz into out, stopping at the
+ * first block that is not made up of hex digits only. Returns the number of
+ * characters consumed; the rest is left to the character by character code.
+ */
+size_t DecodeHexBlocks(const char* psz, size_t len, std::vector<unsigned char>& out)
+{
+    size_t pos = 0;
+#if defined(__SSE2__)
+    const size_t start = out.size();
+    out.resize(start + len / 2);
+    size_t nOut = start;
+    while (len - pos >= 16 && DecodeHexBlock(psz + pos, out.data() + nOut)) {
+        nOut += 8;
+        pos += 16;
+    }
+    out.resize(nOut);
+#endif
+    return pos;
+}
+
+} // namespace
+
+void HexEncode(const unsigned char* data, size_t len, char* out)
+{
+    static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+                                     '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    for (; i + 16 <= len; i += 16) {
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const __m128i hi = _mm_and_si128(_mm_srli_epi16(b, 4), mask);
+        const __m128i lo = _mm_and_si128(b, mask);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), NibblesToHex(_mm_unpacklo_epi8(hi, lo)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), NibblesToHex(_mm_unpackhi_epi8(hi, lo)));
+    }
+#endif
+    for (; i < len; i++) {
+        out[2 * i] = hexmap[data[i] >> 4];
+        out[2 * i + 1] = hexmap[data[i] & 15];
+    }
+}
+
 bool IsHex(const std::string& str)
 {
-    for(std::string::const_iterator it(str.begin()); it != str.end(); ++it)
+    size_t pos = 0;
+#if defined(__SSE2__)
+    unsigned char buf[8];
+    while (str.size() - pos >= 16 && DecodeHexBlock(str.data() + pos, buf))
+        pos += 16;
+#endif
+    for(std::string::const_iterator it(str.begin() + pos); it != str.end(); ++it)
     {
         if (HexDigit(*it) < 0)
             return false;
@@ -82,6 +170,7 @@ std::vector<unsigned char> ParseHex(const char* psz)
 {
     // convert hex dump to vector
     std::vector<unsigned char> vch;
+    psz += DecodeHexBlocks(psz, strlen(psz), vch);
     while (true)
     {
         while (isspace(*psz))
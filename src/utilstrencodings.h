@@ -9,8 +9,12 @@
 #ifndef BITCOIN_UTILSTRENCODINGS_H
 #define BITCOIN_UTILSTRENCODINGS_H
 
+#include <support/allocators/zeroafterfree.h>
+
+#include <iterator>
 #include <stdint.h>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #define BEGIN(a)            ((char*)&(a))
@@ -96,10 +100,56 @@ bool ParseUInt64(const std::string& str, uint64_t *out);
  */
 bool ParseDouble(const std::string& str, double *out);
 
+/**
+ * Write the lowercase hex encoding of the len bytes at data to out, which
+ * must have room for 2 * len characters.
+ */
+void HexEncode(const unsigned char* data, size_t len, char* out);
+
+/** Whether T is an iterator of a char or unsigned char std::vector using Alloc */
+template<typename T, template<typename> class Alloc>
+struct IsByteVectorIterator : std::integral_constant<bool,
+    std::is_same<T, typename std::vector<unsigned char, Alloc<unsigned char>>::iterator>::value ||
+    std::is_same<T, typename std::vector<unsigned char, Alloc<unsigned char>>::const_iterator>::value ||
+    std::is_same<T, typename std::vector<char, Alloc<char>>::iterator>::value ||
+    std::is_same<T, typename std::vector<char, Alloc<char>>::const_iterator>::value> {};
+
+/**
+ * Whether HexStr may treat [itbegin, itend) as one block of memory. Only
+ * iterators known to point into contiguous storage qualify: pointers to
+ * bytes, iterators of std::strings and of byte std::vectors (with the
+ * default allocator, or the zero_after_free_allocator of CDataStream and
+ * CSerializeData), and iterators that declare themselves contiguous with an
+ * is_contiguous typedef (prevector).
+ */
+template<typename T, typename Enable = void>
+struct IsHexEncodableIterator : std::false_type {};
+
+template<typename T>
+struct IsHexEncodableIterator<T*, void> : std::integral_constant<bool, sizeof(T) == 1> {};
+
+template<typename T>
+struct IsHexEncodableIterator<T, typename std::enable_if<!std::is_pointer<T>::value && (
+    IsByteVectorIterator<T, std::allocator>::value ||
+    IsByteVectorIterator<T, zero_after_free_allocator>::value ||
+    std::is_same<T, std::string::iterator>::value ||
+    std::is_same<T, std::string::const_iterator>::value)>::type> : std::true_type {};
+
+template<typename T>
+struct IsHexEncodableIterator<T, typename std::enable_if<T::is_contiguous::value>::type>
+    : std::integral_constant<bool, sizeof(typename T::value_type) == 1> {};
+
 template<typename T>
 std::string HexStr(const T itbegin, const T itend, bool fSpaces=false)
 {
     std::string rv;
+    if (!fSpaces && IsHexEncodableIterator<T>::value) {
+        if (itbegin < itend) {
+            rv.resize((itend - itbegin) * 2);
+            HexEncode(reinterpret_cast<const unsigned char*>(&*itbegin), itend - itbegin, &rv[0]);
+        }
+        return rv;
+    }
     static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
                                      '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
     rv.reserve((itend-itbegin)*3);
@@ -6,6 +6,8 @@
 #include <validation.h>
 
 #include <arith_uint256.h>
+#include <blockfilemap.h>
+#include <blockfilterindex.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -44,7 +46,9 @@
 #include <versionbits.h>
 #include <warnings.h>
 
+#include <condition_variable>
 #include <future>
+#include <mutex>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -164,7 +168,7 @@ public:
     // Block (dis)connection on a given view:
     DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view);
     bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                    CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false);
+                    CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false, bool fTrustMempool = false);
 
     // Block disconnection on our pcoinsTip:
     bool DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool);
@@ -231,6 +235,7 @@ CAmount maxTxFee = DEFAULT_TRANSACTION_MAXFEE;
 
 CBlockPolicyEstimator feeEstimator;
 CTxMemPool mempool(&feeEstimator);
+CBlockFileMapCache g_blockfile_maps;
 
 SidechainDB scdb;
 
@@ -1273,21 +1278,63 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
     return true;
 }
 
+/**
+ * Locate the record stored at pos in a memory-mapped blk or rev file. Records
+ * are preceded by the network magic and their serialized size; nTrailer extra
+ * bytes (e.g. an undo checksum) follow the record. Returns false if the file
+ * cannot be mapped, in which case callers fall back to stdio.
+ */
+static bool GetMappedRecord(const CDiskBlockPos& pos, const char* prefix, size_t nTrailer, std::shared_ptr<const CMappedBlockFile>& mapped, const unsigned char*& pbegin, size_t& nSize)
+{
+    if (pos.IsNull() || pos.nPos < 8 || !g_blockfile_maps.IsEnabled())
+        return false;
+
+    fs::path path = GetBlockPosFilename(pos, prefix);
+    mapped = g_blockfile_maps.Get(path, pos.nPos);
+    if (!mapped)
+        return false;
+
+    size_t nEnd = (size_t)pos.nPos + ReadLE32(mapped->data() + pos.nPos - 4) + nTrailer;
+    if (nEnd > mapped->size()) {
+        // Written after the file was mapped
+        mapped = g_blockfile_maps.Get(path, nEnd);
+        if (!mapped)
+            return false;
+    }
+    pbegin = mapped->data() + pos.nPos;
+    nSize = nEnd - pos.nPos;
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    std::shared_ptr<const CMappedBlockFile> mapped;
+    const unsigned char* pbegin;
+    size_t nSize;
+    if (GetMappedRecord(pos, "blk", 0, mapped, pbegin, nSize)) {
+        // Deserialize straight out of the mapping
+        try {
+            CSpanReader reader(SER_DISK, CLIENT_VERSION, pbegin, nSize);
+            reader >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -1655,37 +1702,60 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
-static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+} // namespace
+
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
 {
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
         return error("%s: no undo data available", __func__);
     }
 
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
-    // Read block
     uint256 hashChecksum;
-    CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
-    try {
-        verifier << pindex->pprev->GetBlockHash();
-        verifier >> blockundo;
-        filein >> hashChecksum;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    uint256 hashData;
+    std::shared_ptr<const CMappedBlockFile> mapped;
+    const unsigned char* pbegin;
+    size_t nSize;
+    if (GetMappedRecord(pos, "rev", sizeof(hashChecksum), mapped, pbegin, nSize)) {
+        CSpanReader reader(SER_DISK, CLIENT_VERSION, pbegin, nSize);
+        CHashVerifier<CSpanReader> verifier(&reader); // We need a CHashVerifier as reserializing may lose data
+        try {
+            verifier << pindex->pprev->GetBlockHash();
+            verifier >> blockundo;
+            reader >> hashChecksum;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s", __func__, e.what());
+        }
+        hashData = verifier.GetHash();
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenUndoFile failed", __func__);
+
+        // Read block
+        CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
+        try {
+            verifier << pindex->pprev->GetBlockHash();
+            verifier >> blockundo;
+            filein >> hashChecksum;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+        hashData = verifier.GetHash();
     }
 
     // Verify checksum
-    if (hashChecksum != verifier.GetHash())
+    if (hashChecksum != hashData)
         return error("%s: Checksum mismatch", __func__);
 
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1814,6 +1884,12 @@ void static FlushBlockFile(bool fFinalize = false)
 
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
+    // Truncation may shrink the files below the size of an existing mapping
+    if (fFinalize) {
+        g_blockfile_maps.Invalidate(GetBlockPosFilename(posOld, "blk"));
+        g_blockfile_maps.Invalidate(GetBlockPosFilename(posOld, "rev"));
+    }
+
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
         if (fFinalize)
@@ -1872,6 +1948,17 @@ static bool WriteTxIndexDataForBlock(const CBlock& block, CValidationState& stat
     return true;
 }
 
+static bool WriteBlockFilterDataForBlock(const CBlock& block, const CBlockUndo& blockundo, CValidationState& state, CBlockIndex* pindex)
+{
+    if (!g_blockfilterindex) return true;
+
+    if (!g_blockfilterindex->BlockConnected(block, blockundo, pindex)) {
+        return AbortNode(state, "Failed to write block filter index");
+    }
+
+    return true;
+}
+
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 
 void ThreadScriptCheck() {
@@ -1971,12 +2058,15 @@ static int64_t nBlocksTotal = 0;
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
- *  can fail if those validity checks fail (among other reasons). */
+ *  can fail if those validity checks fail (among other reasons).
+ *  fTrustMempool (only with fJustCheck) skips script and BIP30 checks for
+ *  transactions that are the very same objects as mempool entries. */
 bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck, bool fTrustMempool)
 {
     AssertLockHeld(cs_main);
     assert(pindex);
+    assert(fJustCheck || !fTrustMempool);
     // pindex->phashBlock can be null if called by CreateNewBlock/TestBlockValidity
     assert((pindex->phashBlock == nullptr) ||
            (*pindex->phashBlock == block.GetHash()));
@@ -2038,6 +2128,16 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         }
     }
 
+    // The mempool is kept consistent with the tip, and its entries passed
+    // script checks under standard flags, which include every block rule,
+    // and were refused if their outputs already existed. Coin-dependent
+    // checks (inputs, fees, sequence locks, sigops) are still redone.
+    std::vector<bool> vTrusted(block.vtx.size(), false);
+    if (fTrustMempool) {
+        for (size_t i = 1; i < block.vtx.size(); i++)
+            vTrusted[i] = mempool.get(block.vtx[i]->GetHash()) == block.vtx[i];
+    }
+
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime1 - nTimeStart), nTimeCheck * MICRO, nTimeCheck * MILLI / nBlocksTotal);
 
@@ -2069,7 +2169,10 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     fEnforceBIP30 = fEnforceBIP30 && (!pindexBIP34height || !(pindexBIP34height->GetBlockHash() == chainparams.GetConsensus().BIP34Hash));
 
     if (fEnforceBIP30) {
-        for (const auto& tx : block.vtx) {
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            if (vTrusted[i])
+                continue;
+            const CTransactionRef& tx = block.vtx[i];
             for (size_t o = 0; o < tx->vout.size(); o++) {
                 if (view.HaveCoin(COutPoint(tx->GetHash(), o))) {
                     return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
@@ -2164,7 +2267,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                              REJECT_INVALID, "bad-blk-sigops");
 
         txdata.emplace_back(tx);
-        if (!tx.IsCoinBase())
+        if (!tx.IsCoinBase() && !vTrusted[i])
         {
             std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
@@ -2261,6 +2364,9 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     if (!WriteTxIndexDataForBlock(block, state, pindex))
         return false;
 
+    if (!WriteBlockFilterDataForBlock(block, blockundo, state, pindex))
+        return false;
+
     assert(pindex->phashBlock);
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2289,6 +2395,80 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     return true;
 }
 
+/** A batch of dirty coins being written to the coins database off cs_main */
+struct CoinsBackgroundWrite
+{
+    CCoinsMapMemoryResource resource;
+    CCoinsMap batch;
+    uint256 hashBlock;
+    bool fComplete;
+    std::future<bool> result;
+
+    CoinsBackgroundWrite() : batch(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource), fComplete(false) {}
+};
+
+/** The background write in progress, if any. Protected by cs_main. */
+static std::unique_ptr<CoinsBackgroundWrite> g_coins_write;
+/** Whether the coins database may hold a partial write that no complete
+ *  write has followed yet. Protected by cs_main. */
+static bool g_coins_db_partial = false;
+
+/** Collect the background coins write and mark its coins as clean. Waits for
+ *  it if fWait is set, otherwise only collects it once it has finished. */
+static bool FinishCoinsBackgroundWrite(CValidationState& state, bool fWait)
+{
+    AssertLockHeld(cs_main);
+    if (!g_coins_write) {
+        return true;
+    }
+    if (!fWait && g_coins_write->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return true;
+    }
+    std::unique_ptr<CoinsBackgroundWrite> write = std::move(g_coins_write);
+    if (!write->result.get()) {
+        return AbortNode(state, "Failed to write to coin database");
+    }
+    pcoinsTip->MarkWritten(write->batch);
+    if (write->fComplete) {
+        g_coins_db_partial = false;
+    }
+    LogPrint(BCLog::COINDB, "Background write of %u coins at %s done%s\n", (unsigned int)write->batch.size(),
+        write->hashBlock.ToString(), write->fComplete ? "" : " (partial)");
+    return true;
+}
+
+/** Copy dirty coins out of pcoinsTip and write them on a background thread.
+ *  Unless all of them fit in one batch the database is left partially
+ *  written, which ReplayBlocks recovers from as long as the chain is only
+ *  extended until the next complete write. */
+static void StartCoinsBackgroundWrite()
+{
+    AssertLockHeld(cs_main);
+    assert(!g_coins_write);
+    std::unique_ptr<CoinsBackgroundWrite> write(new CoinsBackgroundWrite());
+    write->hashBlock = pcoinsTip->GetBestBlock();
+    if (write->hashBlock.IsNull()) {
+        return;
+    }
+    write->fComplete = pcoinsTip->CopyDirty(write->batch, MAX_BACKGROUND_SYNC_COINS);
+    if (write->batch.empty()) {
+        return;
+    }
+    g_coins_db_partial = true;
+    CoinsBackgroundWrite* pwrite = write.get();
+    CCoinsViewDB* pdb = pcoinsdbview.get();
+    write->result = std::async(std::launch::async, [pwrite, pdb] {
+        RenameThread("drivenet-coinsync");
+        try {
+            return pdb->WriteCoins(pwrite->batch, pwrite->hashBlock, pwrite->fComplete);
+        } catch (const std::exception& e) {
+            LogPrintf("StartCoinsBackgroundWrite: %s\n", e.what());
+            return false;
+        }
+    });
+    g_coins_write = std::move(write);
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
@@ -2339,21 +2519,40 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
-        // The cache is over the limit, we have to write now.
+        // The cache is over the limit, we have to make room now.
         bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nTotalSpace;
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
         bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
-        // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
-        bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
+        // It's been a while since we wrote dirty coins. Do this often and in the background, so a full flush finds little left to write.
+        bool fPeriodicSync = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_SYNC_INTERVAL * 1000000;
         // Combine all conditions that result in a full cache flush.
-        fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
+        fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fFlushForPrune;
+        // A full flush has to wait for the background write, otherwise only collect it once it is done.
+        // Over the limit, wait for it too so the coins it wrote can be evicted.
+        if (!FinishCoinsBackgroundWrite(state, fDoFullFlush || fCacheCritical)) {
+            return false;
+        }
+        if (fCacheCritical) {
+            // Drop clean coins, leaving some headroom so this doesn't happen on every block.
+            size_t nEvicted = pcoinsTip->EvictClean((9 * nTotalSpace) / 10);
+            LogPrint(BCLog::COINDB, "Evicted %u clean coins, cache now %.1fMiB\n", (unsigned int)nEvicted, pcoinsTip->DynamicMemoryUsage() * (1.0 / (1<<20)));
+            // Too many dirty coins to get below the limit, write and drop everything.
+            if (pcoinsTip->DynamicMemoryUsage() > (size_t)nTotalSpace) {
+                fDoFullFlush = true;
+            }
+        }
+        // Write dirty coins in the background, keeping them cached as clean entries.
+        bool fBackgroundSync = !fDoFullFlush && !g_coins_write && (fCacheLarge || fCacheCritical || fPeriodicSync);
         // Write blocks and block index to disk.
-        if (fDoFullFlush || fPeriodicWrite) {
+        if (fDoFullFlush || fPeriodicWrite || fBackgroundSync) {
             // Depend on nMinDiskSpace to ensure we can write block index
             if (!CheckDiskSpace(0))
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
             FlushBlockFile();
+            // The block filter index syncs its filters before writing entries and tip.
+            if (g_blockfilterindex && !g_blockfilterindex->Flush())
+                return AbortNode(state, "Failed to write to block filter index");
             // Then update all block file information (which may refer to block and undo files).
             {
                 std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
@@ -2389,6 +2588,10 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             // Flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
+            g_coins_db_partial = false;
+            nLastFlush = nNow;
+        } else if (fBackgroundSync) {
+            StartCoinsBackgroundWrite();
             nLastFlush = nNow;
         }
     }
@@ -2492,6 +2695,11 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
 {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
+    // Background writes may leave the coins database mixing states along the
+    // current chain. ReplayBlocks can't untangle such a mix once it spans a
+    // reorg, so make the database consistent before stepping back.
+    if (g_coins_db_partial && !FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS))
+        return false;
     // Read block from disk.
     std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
     CBlock& block = *pblock;
@@ -2507,6 +2715,8 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
         bool flushed = view.Flush();
         assert(flushed);
     }
+    if (g_blockfilterindex && !g_blockfilterindex->BlockDisconnected(pindexDelete))
+        return AbortNode(state, "Failed to update block filter index");
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * MILLI);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_IF_NEEDED))
@@ -2860,12 +3070,11 @@ bool CChainState::ActivateBestChain(CValidationState &state, const CChainParams&
     do {
         boost::this_thread::interruption_point();
 
-        if (GetMainSignals().CallbacksPending() > 10) {
-            // Block until the validation queue drains. This should largely
-            // never happen in normal operation, however may happen during
-            // reindex, causing memory blowup if we run too far ahead.
-            SyncWithValidationInterfaceQueue();
-        }
+        // Block until the overloaded validation queues drain. This should
+        // largely never happen in normal operation, however may happen during
+        // reindex, causing memory blowup if we run too far ahead. Only the
+        // subscribers that fell behind are waited for.
+        LimitValidationInterfaceQueues(10);
 
         const CBlockIndex *pindexFork;
         bool fInitialDownload;
@@ -4073,10 +4282,13 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
     return true;
 }
 
-bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot)
+bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot, bool fTrustMempool)
 {
     AssertLockHeld(cs_main);
     assert(pindexPrev && pindexPrev == chainActive.Tip());
+    // Mempool entries may not satisfy the block's script flags otherwise
+    if (gArgs.IsArgSet("-promiscuousmempoolflags"))
+        fTrustMempool = false;
     CCoinsViewCache viewNew(pcoinsTip.get());
     CBlockIndex indexDummy(block);
     indexDummy.pprev = pindexPrev;
@@ -4089,7 +4301,7 @@ bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams,
         return error("%s: Consensus::CheckBlock: %s", __func__, FormatStateMessage(state));
     if (!ContextualCheckBlock(block, state, chainparams.GetConsensus(), pindexPrev))
         return error("%s: Consensus::ContextualCheckBlock: %s", __func__, FormatStateMessage(state));
-    if (!g_chainstate.ConnectBlock(block, state, &indexDummy, viewNew, chainparams, true))
+    if (!g_chainstate.ConnectBlock(block, state, &indexDummy, viewNew, chainparams, true, fTrustMempool))
         return false;
     assert(state.IsValid());
 
@@ -4151,6 +4363,8 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        g_blockfile_maps.Invalidate(GetBlockPosFilename(pos, "blk"));
+        g_blockfile_maps.Invalidate(GetBlockPosFilename(pos, "rev"));
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -4764,6 +4978,13 @@ void CChainState::UnloadBlockIndex() {
 void UnloadBlockIndex()
 {
     LOCK(cs_main);
+    if (g_coins_write) {
+        // The coins view is going away, ReplayBlocks picks up from whatever
+        // made it to disk.
+        g_coins_write->result.wait();
+        g_coins_write.reset();
+    }
+    g_coins_db_partial = false;
     chainActive.SetTip(nullptr);
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
@@ -4771,6 +4992,7 @@ void UnloadBlockIndex()
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
+    g_blockfile_maps.Clear();
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
     versionbitscache.Clear();
@@ -4844,121 +5066,335 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
+namespace {
+
+/** Map of disk positions for blocks with unknown parent (only used for reindex) */
+std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+
+/** A block deserialized from a block file ahead of being imported */
+struct ScannedBlock
+{
+    std::shared_ptr<CBlock> pblock;
+    uint256 hash;
+    CDiskBlockPos pos;
+};
+
+/**
+ * Locate and deserialize the blocks stored in a block file, calling
+ * fnBlock(pblock, nBlockPos) for each of them in file order. Stops at the end
+ * of the file, when fAbort is set or when fnBlock returns false. Exceptions
+ * thrown by fnBlock are logged like deserialization errors.
+ */
+template <typename Callback>
+void ScanBlockFile(const CChainParams& chainparams, CBufferedFile& blkdat, const std::atomic<bool>& fAbort, Callback fnBlock)
+{
+    uint64_t nRewind = blkdat.GetPos();
+    while (!blkdat.eof() && !fAbort) {
+        boost::this_thread::interruption_point();
+
+        blkdat.SetPos(nRewind);
+        nRewind++; // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        try {
+            // locate a header
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(chainparams.MessageStart()[0]);
+            nRewind = blkdat.GetPos()+1;
+            blkdat >> FLATDATA(buf);
+            if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            break;
+        }
+        try {
+            // read block
+            uint64_t nBlockPos = blkdat.GetPos();
+            blkdat.SetLimit(nBlockPos + nSize);
+            blkdat.SetPos(nBlockPos);
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            blkdat >> *pblock;
+            nRewind = blkdat.GetPos();
+
+            if (!fnBlock(pblock, nBlockPos))
+                break;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
+}
+
+/**
+ * Hand a block read from a block file to AcceptBlock. Blocks whose parent is
+ * not known yet are remembered (by disk position) and processed once their
+ * parent arrives. Returns false if a validation error means importing should
+ * stop.
+ */
+bool ImportBlock(const CChainParams& chainparams, const std::shared_ptr<CBlock>& pblock, const uint256& hash, CDiskBlockPos* dbp, int& nLoaded)
+{
+    const CBlock& block = *pblock;
+
+    // detect out of order blocks, and store them for later
+    if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                block.hashPrevBlock.ToString());
+        if (dbp)
+            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+        LOCK(cs_main);
+        CValidationState state;
+        if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+        LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip();
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+            std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
+            {
+                LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                        head.ToString());
+                LOCK(cs_main);
+                CValidationState dummy;
+                if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
+                {
+                    nLoaded++;
+                    queue.push_back(pblockrecursive->GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip();
+        }
+    }
+    return true;
+}
+
+/**
+ * Blocks scanned ahead of the import during -reindex. Scanning threads queue
+ * the blocks of their file here and the importer takes them out in file
+ * order. The serialized size of all queued blocks is kept below a byte
+ * budget, except that the file being imported may always queue one block so
+ * the importer never waits on a scanner that is out of budget.
+ */
+class ReindexReadAhead
+{
+public:
+    explicit ReindexReadAhead(uint64_t nMaxBytesIn) : nMaxBytes(nMaxBytesIn) {}
+
+    /** Queue a block of nFile, waiting for budget. Returns false once aborted. */
+    bool Push(int nFile, ScannedBlock&& block, uint64_t nBlockBytes)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&] {
+            return fAbort || nBytes + nBlockBytes <= nMaxBytes || (nFile == nImporting && mapQueues[nFile].empty());
+        });
+        if (fAbort)
+            return false;
+        mapQueues[nFile].emplace_back(std::move(block), nBlockBytes);
+        nBytes += nBlockBytes;
+        cond.notify_all();
+        return true;
+    }
+
+    /** Mark nFile as completely scanned */
+    void Finish(int nFile)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        setFinished.insert(nFile);
+        cond.notify_all();
+    }
+
+    /** Take the next block of nFile. Returns false when the file is done. */
+    bool Pop(int nFile, ScannedBlock& block)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (nImporting != nFile) {
+            nImporting = nFile;
+            cond.notify_all();
+        }
+        cond.wait(lock, [&] { return fAbort || !mapQueues[nFile].empty() || setFinished.count(nFile); });
+        auto& queue = mapQueues[nFile];
+        if (fAbort || queue.empty()) {
+            mapQueues.erase(nFile);
+            setFinished.erase(nFile);
+            return false;
+        }
+        block = std::move(queue.front().first);
+        nBytes -= queue.front().second;
+        queue.pop_front();
+        cond.notify_all();
+        return true;
+    }
+
+    void Abort()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fAbort = true;
+        cond.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::map<int, std::deque<std::pair<ScannedBlock, uint64_t>>> mapQueues;
+    std::set<int> setFinished;
+    int nImporting = 0;
+    uint64_t nBytes = 0;
+    const uint64_t nMaxBytes;
+    bool fAbort = false;
+};
+
+/**
+ * First stage of the reindex pipeline: deserialize every block of block file
+ * nFile, hash it and run the context-free checks, and queue it for import.
+ * This does not touch any shared state, so several files can be scanned
+ * concurrently.
+ */
+void ScanBlockFileForReindex(const CChainParams& chainparams, int nFile, ReindexReadAhead& readahead, const std::atomic<bool>& fAbort)
+{
+    CDiskBlockPos pos(nFile, 0);
+    FILE* file = OpenBlockFile(pos, true);
+    if (!file)
+        return; // This error is logged in OpenBlockFile
+
+    // This takes over file and calls fclose() on it in the CBufferedFile destructor
+    CBufferedFile blkdat(file, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+    ScanBlockFile(chainparams, blkdat, fAbort, [&](const std::shared_ptr<CBlock>& pblock, uint64_t nBlockPos) {
+        // Caches the result in CBlock::fChecked, so AcceptBlock doesn't repeat
+        // the merkle root and transaction checks. Failures are reported there.
+        CValidationState state;
+        CheckBlock(*pblock, state, chainparams.GetConsensus());
+        uint64_t nBlockBytes = blkdat.GetPos() - nBlockPos;
+        return readahead.Push(nFile, ScannedBlock{pblock, pblock->GetHash(), CDiskBlockPos(nFile, nBlockPos)}, nBlockBytes);
+    });
+}
+
+} // namespace
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
+    std::atomic<bool> fAbort(false);
 
     int nLoaded = 0;
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+        ScanBlockFile(chainparams, blkdat, fAbort, [&](const std::shared_ptr<CBlock>& pblock, uint64_t nBlockPos) {
+            if (dbp)
+                dbp->nPos = nBlockPos;
+            return ImportBlock(chainparams, pblock, pblock->GetHash(), dbp, nLoaded);
+        });
+    } catch (const std::runtime_error& e) {
+        AbortNode(std::string("System error: ") + e.what());
+    }
+    if (nLoaded > 0)
+        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    return nLoaded > 0;
+}
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
+void ReindexBlockFiles(const CChainParams& chainparams, uint64_t nMaxReadAheadBytes)
+{
+    // Files are scanned ahead on worker threads while blocks of earlier files
+    // are imported in order on this one. Scanned blocks wait in memory, up to
+    // nMaxReadAheadBytes of them.
+    const int nLookahead = std::max(1, std::min(GetNumCores() - 1, MAX_REINDEX_SCAN_AHEAD));
+    std::atomic<bool> fAbort(false);
+    ReindexReadAhead readahead(nMaxReadAheadBytes);
+    std::deque<std::future<void>> scans;
+    int nNextScan = 0;
+    bool fMoreFiles = true;
+
+    auto scheduleScans = [&]() {
+        while (fMoreFiles && (int)scans.size() < nLookahead) {
+            if (!fs::exists(GetBlockPosFilename(CDiskBlockPos(nNextScan, 0), "blk"))) {
+                fMoreFiles = false; // No block files left to reindex
                 break;
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
-
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
+            int nFile = nNextScan++;
+            scans.push_back(std::async(std::launch::async, [&chainparams, nFile, &readahead, &fAbort]() {
+                RenameThread("drivenet-reindexscan");
+                try {
+                    ScanBlockFileForReindex(chainparams, nFile, readahead, fAbort);
+                } catch (...) {
+                    readahead.Finish(nFile);
+                    throw;
                 }
+                readahead.Finish(nFile);
+            }));
+        }
+    };
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
-                            {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
+    try {
+        for (int nFile = 0; ; nFile++) {
+            scheduleScans();
+            if (scans.empty())
+                break;
+            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+            int64_t nStart = GetTimeMillis();
+            int nLoaded = 0;
+
+            // Second stage: link headers and store the block index, in file order
+            ScannedBlock scanned;
+            bool fContinue = true;
+            while (readahead.Pop(nFile, scanned)) {
+                boost::this_thread::interruption_point();
+                if (!fContinue)
+                    continue; // Drain the rest of the file
+                try {
+                    fContinue = ImportBlock(chainparams, scanned.pblock, scanned.hash, &scanned.pos, nLoaded);
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                scanned.pblock.reset();
             }
+            try {
+                scans.front().get();
+            } catch (const std::runtime_error& e) {
+                AbortNode(std::string("System error: ") + e.what());
+            }
+            scans.pop_front();
+            if (nLoaded > 0)
+                LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
         }
-    } catch (const std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
+    } catch (...) {
+        // Don't leave scanning threads behind on interruption
+        fAbort = true;
+        readahead.Abort();
+        scans.clear();
+        throw;
     }
-    if (nLoaded > 0)
-        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
-    return nLoaded > 0;
 }
 
 void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
@@ -5175,9 +5611,183 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+
+/** Number of mempool.dat transactions whose scripts are checked together */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
+
+/** A transaction as stored in mempool.dat */
+struct MempoolSnapshotEntry
+{
+    CTransactionRef tx;
+    int64_t nTime;
+    int64_t nFeeDelta;
+
+    // Pool state at dump time, only stored since version 2
+    CAmount nFee = 0;
+    uint64_t nCountWithAncestors = 0;
+    uint64_t nSizeWithAncestors = 0;
+    uint64_t nCountWithDescendants = 0;
+    uint64_t nSizeWithDescendants = 0;
+
+    // Set by CheckMempoolSnapshotScripts once the scripts were verified
+    bool fScriptsChecked = false;
+};
 
-bool LoadMempool(void)
+/**
+ * Verify the scripts of a batch of mempool.dat transactions on the script
+ * check threads, against the current coins plus the outputs of earlier
+ * transactions in the batch. Valid signatures end up in the signature cache,
+ * so accepting the transactions afterwards is cheap. Sets fScriptsChecked on
+ * the entries whose scripts all passed.
+ */
+static void CheckMempoolSnapshotScripts(std::vector<MempoolSnapshotEntry>& vEntry)
+{
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(vEntry.size());
+    // Checked entries with the outputs they spend, for finding failures
+    std::vector<std::pair<MempoolSnapshotEntry*, std::vector<CTxOut>>> vChecked;
+    std::vector<CScriptCheck> vChecks;
+    {
+        LOCK2(cs_main, mempool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), mempool);
+        CCoinsViewCache view(&viewMemPool);
+        for (MempoolSnapshotEntry& entry : vEntry) {
+            const CTransaction& tx = *entry.tx;
+            if (tx.IsCoinBase() || mempool.exists(tx.GetHash()) || !view.HaveInputs(tx))
+                continue;
+            txdata.emplace_back(tx);
+            vChecked.emplace_back(&entry, std::vector<CTxOut>());
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                const CTxOut& out = view.AccessCoin(tx.vin[i].prevout).out;
+                vChecked.back().second.push_back(out);
+                vChecks.emplace_back(out, tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true /* cacheStore */, &txdata.back());
+            }
+            AddCoins(view, tx, MEMPOOL_HEIGHT);
+        }
+    }
+
+    bool fAllOk = true;
+    if (!nScriptCheckThreads) {
+        for (CScriptCheck& check : vChecks) {
+            if (!check()) {
+                fAllOk = false;
+                break;
+            }
+        }
+    } else {
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        fAllOk = control.Wait();
+    }
+
+    for (size_t i = 0; i < vChecked.size(); i++) {
+        MempoolSnapshotEntry& entry = *vChecked[i].first;
+        if (fAllOk) {
+            entry.fScriptsChecked = true;
+            continue;
+        }
+        // Find the failing transactions one by one; the ones that passed
+        // hit the signature cache. Their children are left to the full path
+        // when the failing parent isn't added.
+        const CTransaction& tx = *entry.tx;
+        bool fOk = true;
+        for (unsigned int j = 0; fOk && j < tx.vin.size(); j++) {
+            fOk = CScriptCheck(vChecked[i].second[j], tx, j, STANDARD_SCRIPT_VERIFY_FLAGS, true /* cacheStore */, &txdata[i])();
+        }
+        entry.fScriptsChecked = fOk;
+    }
+}
+
+/**
+ * Add a mempool.dat transaction that was dumped on the current tip without
+ * running it through AcceptToMemoryPool again. Its scripts were verified by
+ * CheckMempoolSnapshotScripts; the context-dependent checks are repeated
+ * here and the stored fee and package sizes must still hold. Returns false
+ * if the transaction has to take the full path instead.
+ */
+static bool AddMempoolSnapshotEntry(const MempoolSnapshotEntry& entry)
+{
+    AssertLockHeld(cs_main);
+    LOCK(mempool.cs);
+
+    const CTransaction& tx = *entry.tx;
+    const uint256& hash = tx.GetHash();
+    if (!entry.fScriptsChecked || !tx.criticalData.IsNull() || mempool.exists(hash))
+        return false;
+    for (const CTxIn& txin : tx.vin) {
+        if (mempool.mapNextTx.count(txin.prevout))
+            return false;
+    }
+
+    // The limits may have been lowered since the dump
+    if (entry.nCountWithAncestors > (uint64_t)gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT) ||
+            entry.nSizeWithAncestors > (uint64_t)gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000 ||
+            entry.nCountWithDescendants > (uint64_t)gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT) ||
+            entry.nSizeWithDescendants > (uint64_t)gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000)
+        return false;
+
+    CValidationState state;
+    std::string reason;
+    bool witnessEnabled = IsWitnessEnabled(chainActive.Tip(), Params().GetConsensus());
+    if (!CheckTransaction(tx, state) || (fRequireStandard && !IsStandardTx(tx, reason, witnessEnabled)))
+        return false;
+    if (!CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS))
+        return false;
+
+    CCoinsViewMemPool viewMemPool(pcoinsTip.get(), mempool);
+    CCoinsViewCache view(&viewMemPool);
+    if (!view.HaveInputs(tx))
+        return false;
+
+    // Leave anything touching a sidechain to the full checks
+    bool drivechainsEnabled = IsDrivechainEnabled(chainActive.Tip(), Params().GetConsensus());
+    uint8_t nSidechain;
+    bool fSpendsCoinbase = false;
+    bool fSpendsCriticalData = false;
+    for (const CTxIn& txin : tx.vin) {
+        const Coin& coin = view.AccessCoin(txin.prevout);
+        if (drivechainsEnabled && scdb.HasSidechainScript(std::vector<CScript>{coin.out.scriptPubKey}, nSidechain))
+            return false;
+        fSpendsCoinbase |= coin.IsCoinBase();
+        fSpendsCriticalData |= drivechainsEnabled && coin.IsCriticalData();
+    }
+    if (drivechainsEnabled) {
+        for (const CTxOut& out : tx.vout) {
+            if (scdb.HasSidechainScript(std::vector<CScript>{out.scriptPubKey}, nSidechain))
+                return false;
+        }
+    }
+
+    LockPoints lp;
+    if (!CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
+        return false;
+
+    CAmount nFees = 0;
+    if (!Consensus::CheckTxInputs(tx, state, view, GetSpendHeight(view), nFees) || nFees != entry.nFee)
+        return false;
+    if (fRequireStandard && (!AreInputsStandard(tx, view) || (tx.HasWitness() && !IsWitnessStandard(tx, view))))
+        return false;
+
+    int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+    if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
+        return false;
+
+    CTxMemPoolEntry poolEntry(entry.tx, nFees, entry.nTime, chainActive.Height(),
+                              fSpendsCoinbase, fSpendsCriticalData, nSigOpsCost, lp);
+    unsigned int nSize = poolEntry.GetTxSize();
+    CAmount nModifiedFees = nFees;
+    mempool.ApplyDelta(hash, nModifiedFees);
+    CAmount mempoolRejectFee = mempool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+    if ((mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee) || nModifiedFees < ::minRelayTxFee.GetFee(nSize))
+        return false;
+
+    mempool.addUnchecked(hash, poolEntry, false);
+    GetMainSignals().TransactionAddedToMempool(entry.tx);
+    return true;
+}
+
+bool LoadMempool(int64_t* pnAddedDirectly)
 {
     const CChainParams& chainparams = Params();
     int64_t nExpiryTimeout = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
@@ -5189,6 +5799,7 @@ bool LoadMempool(void)
     }
 
     int64_t count = 0;
+    int64_t fast = 0;
     int64_t expired = 0;
     int64_t failed = 0;
     int64_t already_there = 0;
@@ -5197,27 +5808,65 @@ bool LoadMempool(void)
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != 1 && version != MEMPOOL_DUMP_VERSION) {
             return false;
         }
+        uint256 hashBestBlock;
+        if (version >= 2) {
+            file >> hashBestBlock;
+        }
         uint64_t num;
         file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+        std::vector<MempoolSnapshotEntry> vEntry;
+        while (num) {
+            vEntry.clear();
+            while (num && vEntry.size() < MEMPOOL_LOAD_BATCH_SIZE) {
+                --num;
+                MempoolSnapshotEntry entry;
+                file >> entry.tx;
+                file >> entry.nTime;
+                file >> entry.nFeeDelta;
+                if (version >= 2) {
+                    file >> entry.nFee;
+                    file >> entry.nCountWithAncestors;
+                    file >> entry.nSizeWithAncestors;
+                    file >> entry.nCountWithDescendants;
+                    file >> entry.nSizeWithDescendants;
+                }
+
+                CAmount amountdelta = entry.nFeeDelta;
+                if (amountdelta) {
+                    mempool.PrioritiseTransaction(entry.tx->GetHash(), amountdelta);
+                }
+                if (entry.nTime + nExpiryTimeout > nNow) {
+                    vEntry.push_back(std::move(entry));
+                } else {
+                    ++expired;
+                }
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
+
+            // Verify the batch's signatures in parallel before taking cs_main
+            // for the (serial) mempool insertion
+            CheckMempoolSnapshotScripts(vEntry);
+            if (ShutdownRequested())
+                return false;
+
+            LOCK(cs_main);
+            // On the tip the dump was taken on, previously accepted
+            // transactions with valid scripts are added directly
+            bool fFastPath = version >= 2 &&
+                    chainActive.Tip() && chainActive.Tip()->GetBlockHash() == hashBestBlock &&
+                    !gArgs.IsArgSet("-promiscuousmempoolflags");
+            bool fAddedFast = false;
+            for (const MempoolSnapshotEntry& entry : vEntry) {
+                if (fFastPath && AddMempoolSnapshotEntry(entry)) {
+                    ++count;
+                    ++fast;
+                    fAddedFast = true;
+                    continue;
+                }
+                CValidationState state;
+                AcceptToMemoryPoolWithTime(chainparams, mempool, state, entry.tx, nullptr /* pfMissingInputs */, entry.nTime,
                                            nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
                 if (state.IsValid()) {
                     ++count;
@@ -5226,17 +5875,19 @@ bool LoadMempool(void)
                     // wallet(s) having loaded it while we were processing
                     // mempool transactions; consider these as valid, instead of
                     // failed, but mark them as 'already there'
-                    if (mempool.exists(tx->GetHash())) {
+                    if (mempool.exists(entry.tx->GetHash())) {
                         ++already_there;
                     } else {
                         ++failed;
                     }
                 }
-            } else {
-                ++expired;
+                if (ShutdownRequested())
+                    return false;
+            }
+            if (fAddedFast) {
+                LimitMempoolSize(mempool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
+                                 gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
             }
-            if (ShutdownRequested())
-                return false;
         }
         std::map<uint256, CAmount> mapDeltas;
         file >> mapDeltas;
@@ -5249,7 +5900,9 @@ bool LoadMempool(void)
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
+    LogPrintf("Imported mempool transactions from disk: %i succeeded (%i without revalidation), %i failed, %i expired, %i already there\n", count, fast, failed, expired, already_there);
+    if (pnAddedDirectly)
+        *pnAddedDirectly = fast;
     return true;
 }
 
@@ -5259,13 +5912,31 @@ bool DumpMempool(void)
 
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
+    std::vector<MempoolSnapshotEntry> vEntry;
+    uint256 hashBestBlock;
 
     {
-        LOCK(mempool.cs);
+        LOCK2(cs_main, mempool.cs);
+        if (chainActive.Tip())
+            hashBestBlock = chainActive.Tip()->GetBlockHash();
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
         vinfo = mempool.infoAll();
+        vEntry.reserve(vinfo.size());
+        for (const auto& i : vinfo) {
+            CTxMemPool::txiter it = mempool.mapTx.find(i.tx->GetHash());
+            MempoolSnapshotEntry entry;
+            entry.tx = i.tx;
+            entry.nTime = i.nTime;
+            entry.nFeeDelta = i.nFeeDelta;
+            entry.nFee = it->GetFee();
+            entry.nCountWithAncestors = it->GetCountWithAncestors();
+            entry.nSizeWithAncestors = it->GetSizeWithAncestors();
+            entry.nCountWithDescendants = it->GetCountWithDescendants();
+            entry.nSizeWithDescendants = it->GetSizeWithDescendants();
+            vEntry.push_back(std::move(entry));
+        }
     }
 
     int64_t mid = GetTimeMicros();
@@ -5280,12 +5951,18 @@ bool DumpMempool(void)
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
+        file << hashBestBlock;
 
-        file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
+        file << (uint64_t)vEntry.size();
+        for (const auto& i : vEntry) {
             file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta;
+            file << i.nTime;
+            file << i.nFeeDelta;
+            file << i.nFee;
+            file << i.nCountWithAncestors;
+            file << i.nSizeWithAncestors;
+            file << i.nCountWithDescendants;
+            file << i.nSizeWithDescendants;
             mapDeltas.erase(i.tx->GetHash());
         }
 
@@ -30,8 +30,10 @@
 
 #include <atomic>
 
+class CBlockFileMapCache;
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CChainParams;
 class CCoinsViewDB;
 class CInv;
@@ -78,6 +80,10 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
+/** Maximum number of block files scanned concurrently during -reindex */
+static const int MAX_REINDEX_SCAN_AHEAD = 4;
+/** Maximum serialized size of the blocks held in memory ahead of the import during -reindex */
+static const uint64_t MAX_REINDEX_READ_AHEAD_BYTES = 64 << 20;
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
@@ -101,8 +107,10 @@ static const int MAX_BLOCKTXN_DEPTH = 10;
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
-/** Time to wait (in seconds) between flushing chainstate to disk. */
-static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Time to wait (in seconds) between writing dirty coins to disk in the background. */
+static const unsigned int DATABASE_SYNC_INTERVAL = 60;
+/** Maximum number of dirty coins written by one background write. */
+static const unsigned int MAX_BACKGROUND_SYNC_COINS = 200000;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Average delay between local address broadcasts in seconds. */
@@ -162,6 +170,8 @@ extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CBlockPolicyEstimator feeEstimator;
 extern CTxMemPool mempool;
+/** Recently used blk/rev files kept memory-mapped for reading */
+extern CBlockFileMapCache g_blockfile_maps;
 typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap& mapBlockIndex;
 extern uint64_t nLastBlockTx;
@@ -265,6 +275,10 @@ FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = nullptr);
+/** Rebuild the block index from all blk?????.dat files (-reindex). Files are
+ *  deserialized and checked in parallel, blocks are accepted in file order.
+ *  At most nMaxReadAheadBytes of scanned blocks wait for import. */
+void ReindexBlockFiles(const CChainParams& chainparams, uint64_t nMaxReadAheadBytes = MAX_REINDEX_READ_AHEAD_BYTES);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk,
@@ -408,14 +422,16 @@ void InitScriptExecutionCache();
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
 /** Functions for validating blocks and updating the block tree */
 
 /** Context-independent validity checks */
 bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
 
-/** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
-bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+/** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held).
+ *  With fTrustMempool, transactions identical to a mempool entry skip the script and BIP30 checks they passed on acceptance. */
+bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fTrustMempool = false);
 
 /** Check whether witness commitments are required for block. */
 bool IsWitnessEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& params);
@@ -518,8 +534,9 @@ CBlockFileInfo* GetBlockFileInfo(size_t n);
 /** Dump the mempool to disk. */
 bool DumpMempool();
 
-/** Load the mempool from disk. */
-bool LoadMempool();
+/** Load the mempool from disk. If pnAddedDirectly is set, it receives the
+ *  number of transactions added without going through AcceptToMemoryPool. */
+bool LoadMempool(int64_t* pnAddedDirectly = nullptr);
 
 // TODO replace all of these Drivechain related DAT files with sqlite
 
@@ -16,17 +16,27 @@
 #include <list>
 #include <atomic>
 #include <future>
+#include <string>
 
 #include <boost/signals2/signal.hpp>
 
+/** A registered CValidationInterface, shared with the callbacks queued for it */
+struct ValidationSubscriber {
+    CValidationInterface* const pinterface;
+    const std::string name;
+    SingleThreadedSchedulerClient* const queue;
+    std::atomic<bool> connected{true};
+
+    std::atomic<uint64_t> nProcessed{0};
+    std::atomic<int64_t> nWaitMicros{0};
+    std::atomic<int64_t> nRunMicros{0};
+    std::atomic<size_t> nMaxPending{0};
+
+    ValidationSubscriber(CValidationInterface* pinterfaceIn, const std::string& nameIn, SingleThreadedSchedulerClient* queueIn)
+        : pinterface(pinterfaceIn), name(nameIn), queue(queueIn) {}
+};
+
 struct MainSignalsInstance {
-    boost::signals2::signal<void (const CBlockIndex *, const CBlockIndex *, bool fInitialDownload)> UpdatedBlockTip;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionAddedToMempool;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::vector<CTransactionRef>&)> BlockConnected;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &)> BlockDisconnected;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionRemovedFromMempool;
-    boost::signals2::signal<void (const CBlockLocator &)> SetBestChain;
-    boost::signals2::signal<void (const uint256 &)> Inventory;
     boost::signals2::signal<void (int64_t nBestBlockTime, CConnman* connman)> Broadcast;
     boost::signals2::signal<void (const CBlock&, const CValidationState&)> BlockChecked;
     boost::signals2::signal<void (const CBlockIndex *, const std::shared_ptr<const CBlock>&)> NewPoWValidBlock;
@@ -35,10 +45,59 @@ struct MainSignalsInstance {
 
     // We are not allowed to assume the scheduler only runs in one thread,
     // but must ensure all callbacks happen in-order, so we end up creating
-    // our own queue here :(
+    // our own queues here :(
+    // Each subscriber gets its own queue, so that a slow subscriber only
+    // delays its own callbacks. m_schedulerClient only runs
+    // CallFunctionInValidationInterfaceQueue barriers.
+    CScheduler* m_pscheduler;
     SingleThreadedSchedulerClient m_schedulerClient;
 
-    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+    CCriticalSection m_cs_subscribers;
+    std::vector<std::shared_ptr<ValidationSubscriber>> m_subscribers;
+    // Queues are never destroyed before the scheduler is unregistered, as
+    // callbacks of a former subscriber may still be scheduled on them;
+    // unused ones are handed to the next subscriber instead
+    std::vector<std::unique_ptr<SingleThreadedSchedulerClient>> m_queues;
+    std::vector<SingleThreadedSchedulerClient*> m_free_queues;
+
+    explicit MainSignalsInstance(CScheduler *pscheduler) : m_pscheduler(pscheduler), m_schedulerClient(pscheduler) {}
+
+    /** Queue func to be called on every current subscriber */
+    void Enqueue(const std::function<void (CValidationInterface*)>& func)
+    {
+        int64_t nQueued = GetTimeMicros();
+        LOCK(m_cs_subscribers);
+        for (const std::shared_ptr<ValidationSubscriber>& subscriber : m_subscribers) {
+            std::shared_ptr<ValidationSubscriber> sub = subscriber;
+            sub->queue->AddToProcessQueue([sub, func, nQueued] {
+                if (!sub->connected) return;
+                int64_t nStart = GetTimeMicros();
+                func(sub->pinterface);
+                sub->nWaitMicros += nStart - nQueued;
+                sub->nRunMicros += GetTimeMicros() - nStart;
+                ++sub->nProcessed;
+            });
+            size_t nPending = sub->queue->CallbacksPending();
+            if (nPending > sub->nMaxPending) sub->nMaxPending = nPending;
+        }
+    }
+
+    std::vector<SingleThreadedSchedulerClient*> AllQueues()
+    {
+        LOCK(m_cs_subscribers);
+        std::vector<SingleThreadedSchedulerClient*> vQueues{&m_schedulerClient};
+        for (const auto& queue : m_queues) {
+            vQueues.push_back(queue.get());
+        }
+        return vQueues;
+    }
+
+    void Disconnect(const std::shared_ptr<ValidationSubscriber>& sub)
+    {
+        AssertLockHeld(m_cs_subscribers);
+        sub->connected = false;
+        m_free_queues.push_back(sub->queue);
+    }
 };
 
 static CMainSignals g_signals;
@@ -54,13 +113,36 @@ void CMainSignals::UnregisterBackgroundSignalScheduler() {
 
 void CMainSignals::FlushBackgroundCallbacks() {
     if (m_internals) {
-        m_internals->m_schedulerClient.EmptyQueue();
+        for (SingleThreadedSchedulerClient* queue : m_internals->AllQueues()) {
+            queue->EmptyQueue();
+        }
     }
 }
 
 size_t CMainSignals::CallbacksPending() {
     if (!m_internals) return 0;
-    return m_internals->m_schedulerClient.CallbacksPending();
+    size_t nPending = 0;
+    for (SingleThreadedSchedulerClient* queue : m_internals->AllQueues()) {
+        nPending = std::max(nPending, queue->CallbacksPending());
+    }
+    return nPending;
+}
+
+std::vector<ValidationQueueStats> CMainSignals::GetQueueStats() {
+    std::vector<ValidationQueueStats> vStats;
+    if (!m_internals) return vStats;
+    LOCK(m_internals->m_cs_subscribers);
+    for (const auto& sub : m_internals->m_subscribers) {
+        ValidationQueueStats stats;
+        stats.name = sub->name;
+        stats.nPending = sub->queue->CallbacksPending();
+        stats.nMaxPending = sub->nMaxPending;
+        stats.nProcessed = sub->nProcessed;
+        stats.nWaitMicros = sub->nWaitMicros;
+        stats.nRunMicros = sub->nRunMicros;
+        vStats.push_back(stats);
+    }
+    return vStats;
 }
 
 void CMainSignals::RegisterWithMempoolSignals(CTxMemPool& pool) {
@@ -84,56 +166,75 @@ void CMainSignals::ResetRequestCount(const uint256& hash) {
     m_internals->ResetRequestCount(hash);
 }
 
-void RegisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.m_internals->UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->TransactionAddedToMempool.connect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.m_internals->BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->BlockDisconnected.connect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
-    g_signals.m_internals->TransactionRemovedFromMempool.connect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
-    g_signals.m_internals->SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.m_internals->Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.m_internals->Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.m_internals->BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.m_internals->NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
-    g_signals.m_internals->BlockFound.connect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
-    g_signals.m_internals->ResetRequestCount.connect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
+void RegisterValidationInterface(CValidationInterface* pwalletIn, const std::string& name) {
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    {
+        LOCK(internals.m_cs_subscribers);
+        SingleThreadedSchedulerClient* queue;
+        if (internals.m_free_queues.empty()) {
+            internals.m_queues.emplace_back(new SingleThreadedSchedulerClient(internals.m_pscheduler));
+            queue = internals.m_queues.back().get();
+        } else {
+            queue = internals.m_free_queues.back();
+            internals.m_free_queues.pop_back();
+        }
+        internals.m_subscribers.push_back(std::make_shared<ValidationSubscriber>(pwalletIn, name.empty() ? "unnamed" : name, queue));
+    }
+    internals.Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
+    internals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
+    internals.NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    internals.BlockFound.connect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
+    internals.ResetRequestCount.connect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.m_internals->BlockFound.disconnect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
-    g_signals.m_internals->ResetRequestCount.disconnect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
-    g_signals.m_internals->BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.m_internals->Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.m_internals->Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.m_internals->SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.m_internals->TransactionAddedToMempool.disconnect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.m_internals->BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->BlockDisconnected.disconnect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
-    g_signals.m_internals->TransactionRemovedFromMempool.disconnect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
-    g_signals.m_internals->UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    internals.BlockFound.disconnect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
+    internals.ResetRequestCount.disconnect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
+    internals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
+    internals.Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
+    internals.NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+
+    LOCK(internals.m_cs_subscribers);
+    std::vector<std::shared_ptr<ValidationSubscriber>>& subscribers = internals.m_subscribers;
+    for (auto it = subscribers.begin(); it != subscribers.end(); ) {
+        if ((*it)->pinterface == pwalletIn) {
+            internals.Disconnect(*it);
+            it = subscribers.erase(it);
+        } else {
+            ++it;
+        }
+    }
 }
 
 void UnregisterAllValidationInterfaces() {
     if (!g_signals.m_internals) {
         return;
     }
-    g_signals.m_internals->BlockFound.disconnect_all_slots();
-    g_signals.m_internals->ResetRequestCount.disconnect_all_slots();
-    g_signals.m_internals->BlockChecked.disconnect_all_slots();
-    g_signals.m_internals->Broadcast.disconnect_all_slots();
-    g_signals.m_internals->Inventory.disconnect_all_slots();
-    g_signals.m_internals->SetBestChain.disconnect_all_slots();
-    g_signals.m_internals->TransactionAddedToMempool.disconnect_all_slots();
-    g_signals.m_internals->BlockConnected.disconnect_all_slots();
-    g_signals.m_internals->BlockDisconnected.disconnect_all_slots();
-    g_signals.m_internals->TransactionRemovedFromMempool.disconnect_all_slots();
-    g_signals.m_internals->UpdatedBlockTip.disconnect_all_slots();
-    g_signals.m_internals->NewPoWValidBlock.disconnect_all_slots();
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    internals.BlockFound.disconnect_all_slots();
+    internals.ResetRequestCount.disconnect_all_slots();
+    internals.BlockChecked.disconnect_all_slots();
+    internals.Broadcast.disconnect_all_slots();
+    internals.NewPoWValidBlock.disconnect_all_slots();
+
+    LOCK(internals.m_cs_subscribers);
+    for (const auto& sub : internals.m_subscribers) {
+        internals.Disconnect(sub);
+    }
+    internals.m_subscribers.clear();
 }
 
 void CallFunctionInValidationInterfaceQueue(std::function<void ()> func) {
-    g_signals.m_internals->m_schedulerClient.AddToProcessQueue(std::move(func));
+    // Run func from whichever queue reaches this point last
+    std::vector<SingleThreadedSchedulerClient*> vQueues = g_signals.m_internals->AllQueues();
+    auto remaining = std::make_shared<std::atomic<size_t>>(vQueues.size());
+    auto pfunc = std::make_shared<std::function<void ()>>(std::move(func));
+    for (SingleThreadedSchedulerClient* queue : vQueues) {
+        queue->AddToProcessQueue([remaining, pfunc] {
+            if (--*remaining == 0) (*pfunc)();
+        });
+    }
 }
 
 void SyncWithValidationInterfaceQueue() {
@@ -146,47 +247,86 @@ void SyncWithValidationInterfaceQueue() {
     promise.get_future().wait();
 }
 
+void SyncWithValidationInterfaceQueue(CValidationInterface* pinterface) {
+    AssertLockNotHeld(cs_main);
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    SingleThreadedSchedulerClient* queue = nullptr;
+    {
+        LOCK(internals.m_cs_subscribers);
+        for (const auto& sub : internals.m_subscribers) {
+            if (sub->pinterface == pinterface) {
+                queue = sub->queue;
+                break;
+            }
+        }
+    }
+    if (!queue) return;
+    // Block until the subscriber's own queue drains
+    std::promise<void> promise;
+    queue->AddToProcessQueue([&promise] {
+        promise.set_value();
+    });
+    promise.get_future().wait();
+}
+
+void LimitValidationInterfaceQueues(size_t nMaxPending) {
+    AssertLockNotHeld(cs_main);
+    if (!g_signals.m_internals) return;
+    std::vector<std::shared_ptr<std::promise<void>>> vPromises;
+    for (SingleThreadedSchedulerClient* queue : g_signals.m_internals->AllQueues()) {
+        if (queue->CallbacksPending() <= nMaxPending) continue;
+        auto promise = std::make_shared<std::promise<void>>();
+        queue->AddToProcessQueue([promise] {
+            promise->set_value();
+        });
+        vPromises.push_back(promise);
+    }
+    for (const auto& promise : vPromises) {
+        promise->get_future().wait();
+    }
+}
+
 void CMainSignals::MempoolEntryRemoved(CTransactionRef ptx, MemPoolRemovalReason reason) {
     if (reason != MemPoolRemovalReason::BLOCK && reason != MemPoolRemovalReason::CONFLICT) {
-        m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-            m_internals->TransactionRemovedFromMempool(ptx);
+        m_internals->Enqueue([ptx](CValidationInterface* pinterface) {
+            pinterface->TransactionRemovedFromMempool(ptx);
         });
     }
 }
 
 void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pindexNew, pindexFork, fInitialDownload, this] {
-        m_internals->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
+    m_internals->Enqueue([pindexNew, pindexFork, fInitialDownload](CValidationInterface* pinterface) {
+        pinterface->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
     });
 }
 
 void CMainSignals::TransactionAddedToMempool(const CTransactionRef &ptx) {
-    m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-        m_internals->TransactionAddedToMempool(ptx);
+    m_internals->Enqueue([ptx](CValidationInterface* pinterface) {
+        pinterface->TransactionAddedToMempool(ptx);
     });
 }
 
 void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, const std::shared_ptr<const std::vector<CTransactionRef>>& pvtxConflicted) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, pindex, pvtxConflicted, this] {
-        m_internals->BlockConnected(pblock, pindex, *pvtxConflicted);
+    m_internals->Enqueue([pblock, pindex, pvtxConflicted](CValidationInterface* pinterface) {
+        pinterface->BlockConnected(pblock, pindex, *pvtxConflicted);
     });
 }
 
 void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock> &pblock) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, this] {
-        m_internals->BlockDisconnected(pblock);
+    m_internals->Enqueue([pblock](CValidationInterface* pinterface) {
+        pinterface->BlockDisconnected(pblock);
     });
 }
 
 void CMainSignals::SetBestChain(const CBlockLocator &locator) {
-    m_internals->m_schedulerClient.AddToProcessQueue([locator, this] {
-        m_internals->SetBestChain(locator);
+    m_internals->Enqueue([locator](CValidationInterface* pinterface) {
+        pinterface->SetBestChain(locator);
     });
 }
 
 void CMainSignals::Inventory(const uint256 &hash) {
-    m_internals->m_schedulerClient.AddToProcessQueue([hash, this] {
-        m_internals->Inventory(hash);
+    m_internals->Enqueue([hash](CValidationInterface* pinterface) {
+        pinterface->Inventory(hash);
     });
 }
 
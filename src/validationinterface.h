@@ -10,6 +10,8 @@
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 class CBlock;
 class CBlockIndex;
@@ -24,10 +26,16 @@ class CScheduler;
 class CTxMemPool;
 enum class MemPoolRemovalReason;
 
+/** Number of threads servicing the scheduler, and with it the per-subscriber validation interface queues */
+static const int DEFAULT_SCHEDULER_THREADS = 3;
+
 // These functions dispatch to one or all registered wallets
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface* pwalletIn);
+/**
+ * Register a wallet to receive updates from core. Its background callbacks
+ * run in order on a queue of its own; name identifies it in the queue stats.
+ */
+void RegisterValidationInterface(CValidationInterface* pwalletIn, const std::string& name = "");
 /** Unregister a wallet from core */
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
@@ -52,6 +60,17 @@ void CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
  *     promise.get_future().wait();
  */
 void SyncWithValidationInterfaceQueue();
+/**
+ * Wait for the callbacks generated prior to now for one subscriber only, so
+ * that a slow subscriber doesn't hold up the others. Returns immediately if
+ * pinterface isn't registered.
+ */
+void SyncWithValidationInterfaceQueue(CValidationInterface* pinterface);
+/**
+ * Wait for the callback queues holding more than nMaxPending callbacks to
+ * drain. Queues within the limit are not waited for.
+ */
+void LimitValidationInterfaceQueues(size_t nMaxPending);
 
 class CValidationInterface {
 protected:
@@ -121,20 +140,33 @@ protected:
 
     virtual void ResetRequestCount(const uint256 &hash) {};
 
-    friend void ::RegisterValidationInterface(CValidationInterface*);
+    friend class CMainSignals;
+    friend void ::RegisterValidationInterface(CValidationInterface*, const std::string&);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
 };
 
+/** Backlog and timing of a subscriber's callback queue */
+struct ValidationQueueStats {
+    std::string name;
+    size_t nPending;
+    size_t nMaxPending;
+    uint64_t nProcessed;
+    int64_t nWaitMicros; //!< total time callbacks spent queued
+    int64_t nRunMicros; //!< total time spent running callbacks
+};
+
 struct MainSignalsInstance;
 class CMainSignals {
 private:
     std::unique_ptr<MainSignalsInstance> m_internals;
 
-    friend void ::RegisterValidationInterface(CValidationInterface*);
+    friend void ::RegisterValidationInterface(CValidationInterface*, const std::string&);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
     friend void ::CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
+    friend void ::SyncWithValidationInterfaceQueue(CValidationInterface* pinterface);
+    friend void ::LimitValidationInterfaceQueues(size_t nMaxPending);
 
     void MempoolEntryRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
 
@@ -146,7 +178,10 @@ public:
     /** Call any remaining callbacks on the calling thread */
     void FlushBackgroundCallbacks();
 
+    /** Return the backlog of the longest callback queue */
     size_t CallbacksPending();
+    /** Return the stats of every subscriber's callback queue */
+    std::vector<ValidationQueueStats> GetQueueStats();
 
     /** Register with mempool to call TransactionRemovedFromMempool callbacks */
     void RegisterWithMempoolSignals(CTxMemPool& pool);
@@ -0,0 +1,118 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/coinselection.h>
+
+#include <wallet/wallet.h>
+
+#include <algorithm>
+#include <assert.h>
+
+CInputCoin::CInputCoin(const CWalletTx* walletTx, unsigned int i)
+{
+    if (!walletTx)
+        throw std::invalid_argument("walletTx should not be null");
+    if (i >= walletTx->tx->vout.size())
+        throw std::out_of_range("The output index is out of range");
+
+    outpoint = COutPoint(walletTx->GetHash(), i);
+    txout = walletTx->tx->vout[i];
+    effective_value = txout.nValue;
+}
+
+namespace {
+
+struct CompareEffectiveValueDescending
+{
+    bool operator()(const CInputCoin& a, const CInputCoin& b) const
+    {
+        return a.effective_value > b.effective_value;
+    }
+};
+
+} // namespace
+
+bool SelectCoinsBnB(std::vector<CInputCoin>& utxo_pool, const CAmount& target_value, const CAmount& cost_of_change,
+                    std::set<CInputCoin>& out_set, CAmount& value_ret, CAmount not_input_fees)
+{
+    out_set.clear();
+
+    const CAmount actual_target = not_input_fees + target_value;
+    CAmount curr_available_value = 0;
+    for (const CInputCoin& utxo : utxo_pool) {
+        assert(utxo.effective_value > 0);
+        curr_available_value += utxo.effective_value;
+    }
+    if (curr_available_value < actual_target) {
+        return false;
+    }
+
+    // Largest first, so the inclusion branches reach the target quickly and
+    // the exclusion branches are cut off early.
+    std::sort(utxo_pool.begin(), utxo_pool.end(), CompareEffectiveValueDescending());
+
+    CAmount curr_value = 0;
+    std::vector<bool> curr_selection;
+    curr_selection.reserve(utxo_pool.size());
+    std::vector<bool> best_selection;
+    CAmount best_waste = MAX_MONEY;
+
+    for (size_t nTries = 0; nTries < MAX_BNB_TRIES; ++nTries) {
+        bool backtrack = false;
+        if (curr_value + curr_available_value < actual_target || // Cannot reach the target any more
+            curr_value > actual_target + cost_of_change) {        // Overshot, a change output would be cheaper
+            backtrack = true;
+        } else if (curr_value >= actual_target) {
+            // In range. Adding more inputs would only burn their value as fee.
+            const CAmount waste = curr_value - actual_target;
+            if (waste <= best_waste) {
+                best_selection = curr_selection;
+                best_selection.resize(utxo_pool.size());
+                best_waste = waste;
+                if (best_waste == 0)
+                    break;
+            }
+            backtrack = true;
+        }
+
+        if (backtrack) {
+            // Walk back to the last included input and try omitting it.
+            while (!curr_selection.empty() && !curr_selection.back()) {
+                curr_selection.pop_back();
+                curr_available_value += utxo_pool[curr_selection.size()].effective_value;
+            }
+            if (curr_selection.empty())
+                break; // Every branch was explored
+
+            curr_selection.back() = false;
+            curr_value -= utxo_pool[curr_selection.size() - 1].effective_value;
+        } else {
+            const CInputCoin& utxo = utxo_pool[curr_selection.size()];
+            curr_available_value -= utxo.effective_value;
+
+            // Including an input of the same value as an omitted predecessor
+            // only repeats a branch that was already searched.
+            if (!curr_selection.empty() && !curr_selection.back() &&
+                utxo.effective_value == utxo_pool[curr_selection.size() - 1].effective_value) {
+                curr_selection.push_back(false);
+            } else {
+                curr_selection.push_back(true);
+                curr_value += utxo.effective_value;
+            }
+        }
+    }
+
+    if (best_selection.empty()) {
+        return false;
+    }
+
+    value_ret = 0;
+    for (size_t i = 0; i < best_selection.size(); ++i) {
+        if (best_selection[i]) {
+            out_set.insert(utxo_pool[i]);
+            value_ret += utxo_pool[i].txout.nValue;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_COINSELECTION_H
+#define BITCOIN_WALLET_COINSELECTION_H
+
+#include <amount.h>
+#include <primitives/transaction.h>
+
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+class CWalletTx;
+
+class CInputCoin {
+public:
+    CInputCoin(const CWalletTx* walletTx, unsigned int i);
+
+    CInputCoin(const COutPoint& outpointIn, const CTxOut& txoutIn)
+    {
+        outpoint = outpointIn;
+        txout = txoutIn;
+        effective_value = txoutIn.nValue;
+    }
+
+    COutPoint outpoint;
+    CTxOut txout;
+    //! Value minus the fee for spending this input at the target feerate
+    CAmount effective_value;
+
+    bool operator<(const CInputCoin& rhs) const {
+        return outpoint < rhs.outpoint;
+    }
+
+    bool operator!=(const CInputCoin& rhs) const {
+        return outpoint != rhs.outpoint;
+    }
+
+    bool operator==(const CInputCoin& rhs) const {
+        return outpoint == rhs.outpoint;
+    }
+};
+
+/** Maximum number of branches SelectCoinsBnB explores before giving up */
+static const size_t MAX_BNB_TRIES = 100000;
+
+/**
+ * Depth first branch and bound search for a set of inputs that needs no
+ * change output: one whose total effective value lies within
+ * [target_value + not_input_fees, target_value + not_input_fees + cost_of_change].
+ * Among the solutions found, the one wasting the least is returned, where
+ * waste is the excess over the target. Inputs with a non-positive effective
+ * value must be left out of utxo_pool, which is sorted in place.
+ */
+bool SelectCoinsBnB(std::vector<CInputCoin>& utxo_pool, const CAmount& target_value, const CAmount& cost_of_change,
+                    std::set<CInputCoin>& out_set, CAmount& value_ret, CAmount not_input_fees);
+
+#endif // BITCOIN_WALLET_COINSELECTION_H
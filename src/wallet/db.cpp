@@ -222,6 +222,12 @@ bool CDB::Recover(const std::string& filename, void *callbackDataIn, bool (*reco
     // Rewrite salvaged data to fresh wallet file
     // Set -rescan so any missing transactions will be
     // found.
+    if (CLogDB::IsLogFile(GetWalletDir() / filename)) {
+        // Torn or corrupt records at the end of a log are dropped when it is opened.
+        LogPrintf("%s: %s is a record log, nothing to salvage\n", __func__, filename);
+        return true;
+    }
+
     int64_t now = GetTime();
     newFilename = strprintf("%s.%d.bak", filename, now);
 
@@ -301,7 +307,7 @@ bool CDB::VerifyEnvironment(const std::string& walletFile, const fs::path& walle
 
 bool CDB::VerifyDatabaseFile(const std::string& walletFile, const fs::path& walletDir, std::string& warningStr, std::string& errorStr, CDBEnv::recoverFunc_type recoverFunc)
 {
-    if (fs::exists(walletDir / walletFile))
+    if (fs::exists(walletDir / walletFile) && !CLogDB::IsLogFile(walletDir / walletFile))
     {
         std::string backup_filename;
         CDBEnv::VerifyResult r = bitdb.Verify(walletFile, recoverFunc, backup_filename);
@@ -398,7 +404,18 @@ void CDBEnv::CheckpointLSN(const std::string& strFile)
 }
 
 
-CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdb(nullptr), activeTxn(nullptr)
+CWalletDBWrapper::CWalletDBWrapper(CDBEnv *env_in, const std::string &strFile_in) :
+    nUpdateCounter(0), nLastSeen(0), nLastFlushed(0), nLastWalletUpdate(0), env(env_in), strFile(strFile_in)
+{
+    if (env->IsMock())
+        return;
+    fs::path path = GetWalletDir() / strFile;
+    if (fs::exists(path) ? CLogDB::IsLogFile(path) : gArgs.GetBoolArg("-walletlogdb", DEFAULT_WALLET_LOGDB)) {
+        logdb.reset(new CLogDB(path));
+    }
+}
+
+CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdb(nullptr), activeTxn(nullptr), plog(nullptr), fLogTxnActive(false)
 {
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
     fFlushOnClose = fFlushOnCloseIn;
@@ -409,6 +426,21 @@ CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdb
     const std::string &strFilename = dbw.strFile;
 
     bool fCreate = strchr(pszMode, 'c') != nullptr;
+
+    if (dbw.logdb) {
+        if (!dbw.logdb->Open(fCreate))
+            throw std::runtime_error(strprintf("CDB: can't open database %s", strFilename));
+        plog = dbw.logdb.get();
+        strFile = strFilename;
+        if (fCreate && !Exists(std::string("version"))) {
+            bool fTmp = fReadOnly;
+            fReadOnly = false;
+            WriteVersion(CLIENT_VERSION);
+            fReadOnly = fTmp;
+        }
+        return;
+    }
+
     unsigned int nFlags = DB_THREAD;
     if (fCreate)
         nFlags |= DB_CREATE;
@@ -461,6 +493,11 @@ CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdb
 
 void CDB::Flush()
 {
+    if (plog) {
+        if (!fLogTxnActive)
+            plog->Flush();
+        return;
+    }
     if (activeTxn)
         return;
 
@@ -479,6 +516,15 @@ void CWalletDBWrapper::IncrementUpdateCounter()
 
 void CDB::Close()
 {
+    if (plog) {
+        // Like an active BerkeleyDB transaction, unfinished batches are aborted
+        logTxn.Clear();
+        fLogTxnActive = false;
+        if (fFlushOnClose)
+            plog->Flush();
+        plog = nullptr;
+        return;
+    }
     if (!pdb)
         return;
     if (activeTxn)
@@ -514,6 +560,15 @@ bool CDB::Rewrite(CWalletDBWrapper& dbw, const char* pszSkip)
     if (dbw.IsDummy()) {
         return true;
     }
+    if (dbw.logdb) {
+        LogPrintf("CDB::Rewrite: Rewriting %s...\n", dbw.strFile);
+        {
+            CDB db(dbw, "r+");
+            if (!db.WriteVersion(CLIENT_VERSION))
+                return false;
+        }
+        return dbw.logdb->Compact(pszSkip);
+    }
     CDBEnv *env = dbw.env;
     const std::string& strFile = dbw.strFile;
     while (true) {
@@ -543,17 +598,15 @@ bool CDB::Rewrite(CWalletDBWrapper& dbw, const char* pszSkip)
                         fSuccess = false;
                     }
 
-                    Dbc* pcursor = db.GetCursor();
+                    std::unique_ptr<CDBCursor> pcursor = db.GetCursor();
                     if (pcursor)
                         while (fSuccess) {
                             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
                             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-                            int ret1 = db.ReadAtCursor(pcursor, ssKey, ssValue);
+                            int ret1 = db.ReadAtCursor(pcursor.get(), ssKey, ssValue);
                             if (ret1 == DB_NOTFOUND) {
-                                pcursor->close();
                                 break;
                             } else if (ret1 != 0) {
-                                pcursor->close();
                                 fSuccess = false;
                                 break;
                             }
@@ -571,6 +624,7 @@ bool CDB::Rewrite(CWalletDBWrapper& dbw, const char* pszSkip)
                             if (ret2 > 0)
                                 fSuccess = false;
                         }
+                    pcursor.reset();
                     if (fSuccess) {
                         db.Close();
                         env->CloseDb(strFile);
@@ -643,6 +697,15 @@ bool CDB::PeriodicFlush(CWalletDBWrapper& dbw)
     if (dbw.IsDummy()) {
         return true;
     }
+    if (dbw.logdb) {
+        // Appends are never held back, so this only syncs, and compacts
+        // once superseded records take up most of the file.
+        if (!dbw.logdb->Flush())
+            return false;
+        if (dbw.logdb->NeedsCompaction())
+            return dbw.logdb->Compact();
+        return true;
+    }
     bool ret = false;
     CDBEnv *env = dbw.env;
     const std::string& strFile = dbw.strFile;
@@ -691,6 +754,15 @@ bool CWalletDBWrapper::Backup(const std::string& strDest)
     if (IsDummy()) {
         return false;
     }
+    if (logdb) {
+        fs::path pathDest(strDest);
+        if (fs::is_directory(pathDest))
+            pathDest /= strFile;
+        if (!logdb->Backup(pathDest))
+            return false;
+        LogPrintf("copied %s to %s\n", strFile, pathDest.string());
+        return true;
+    }
     while (true)
     {
         {
@@ -729,7 +801,141 @@ bool CWalletDBWrapper::Backup(const std::string& strDest)
 
 void CWalletDBWrapper::Flush(bool shutdown)
 {
+    if (logdb) {
+        if (shutdown) {
+            if (logdb->NeedsCompaction())
+                logdb->Compact();
+            logdb->Close();
+        } else {
+            logdb->Flush();
+        }
+    }
     if (!IsDummy()) {
         env->Flush(shutdown);
     }
 }
+
+bool CDB::ReadLog(const CDataStream& ssKey, CDataStream& ssValue)
+{
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    CSerializeData value;
+    bool fExists;
+    if (fLogTxnActive && logTxn.Lookup(key, fExists, value)) {
+        if (!fExists)
+            return false;
+    } else if (!plog->Read(key, value)) {
+        return false;
+    }
+    ssValue.write(value.data(), value.size());
+    return true;
+}
+
+bool CDB::WriteLog(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite)
+{
+    if (!fOverwrite && ExistsLog(ssKey))
+        return false;
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    CSerializeData value(ssValue.begin(), ssValue.end());
+    if (fLogTxnActive) {
+        logTxn.Write(key, value);
+        return true;
+    }
+    CLogDBBatch batch;
+    batch.Write(key, value);
+    return plog->WriteBatch(batch);
+}
+
+bool CDB::EraseLog(const CDataStream& ssKey)
+{
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    if (fLogTxnActive) {
+        logTxn.Erase(key);
+        return true;
+    }
+    if (!plog->Exists(key))
+        return true;
+    CLogDBBatch batch;
+    batch.Erase(key);
+    return plog->WriteBatch(batch);
+}
+
+bool CDB::ExistsLog(const CDataStream& ssKey)
+{
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    CSerializeData value;
+    bool fExists;
+    if (fLogTxnActive && logTxn.Lookup(key, fExists, value))
+        return fExists;
+    return plog->Exists(key);
+}
+
+std::unique_ptr<CDBCursor> CDB::GetCursor()
+{
+    if (plog)
+        return std::unique_ptr<CDBCursor>(new CDBCursor(nullptr));
+    if (!pdb)
+        return nullptr;
+    Dbc* pcursor = nullptr;
+    int ret = pdb->cursor(nullptr, &pcursor, 0);
+    if (ret != 0)
+        return nullptr;
+    return std::unique_ptr<CDBCursor>(new CDBCursor(pcursor));
+}
+
+int CDB::ReadAtCursor(CDBCursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, bool setRange)
+{
+    if (plog) {
+        CSerializeData key, value;
+        bool fFound;
+        if (setRange) {
+            CSerializeData keyFrom(ssKey.begin(), ssKey.end());
+            fFound = plog->ReadNext(&keyFrom, true, key, value);
+        } else {
+            fFound = plog->ReadNext(pcursor->fStarted ? &pcursor->keyLast : nullptr, false, key, value);
+        }
+        if (!fFound)
+            return DB_NOTFOUND;
+        pcursor->keyLast = key;
+        pcursor->fStarted = true;
+
+        ssKey.SetType(SER_DISK);
+        ssKey.clear();
+        ssKey.write(key.data(), key.size());
+        ssValue.SetType(SER_DISK);
+        ssValue.clear();
+        ssValue.write(value.data(), value.size());
+        return 0;
+    }
+
+    // Read at cursor
+    Dbt datKey;
+    unsigned int fFlags = DB_NEXT;
+    if (setRange) {
+        datKey.set_data(ssKey.data());
+        datKey.set_size(ssKey.size());
+        fFlags = DB_SET_RANGE;
+    }
+    Dbt datValue;
+    datKey.set_flags(DB_DBT_MALLOC);
+    datValue.set_flags(DB_DBT_MALLOC);
+    int ret = pcursor->pcursor->get(&datKey, &datValue, fFlags);
+    if (ret != 0)
+        return ret;
+    else if (datKey.get_data() == nullptr || datValue.get_data() == nullptr)
+        return 99999;
+
+    // Convert to streams
+    ssKey.SetType(SER_DISK);
+    ssKey.clear();
+    ssKey.write((char*)datKey.get_data(), datKey.get_size());
+    ssValue.SetType(SER_DISK);
+    ssValue.clear();
+    ssValue.write((char*)datValue.get_data(), datValue.get_size());
+
+    // Clear and free memory
+    memory_cleanse(datKey.get_data(), datKey.get_size());
+    memory_cleanse(datValue.get_data(), datValue.get_size());
+    free(datKey.get_data());
+    free(datValue.get_data());
+    return 0;
+}
@@ -12,6 +12,7 @@
 #include <streams.h>
 #include <sync.h>
 #include <version.h>
+#include <wallet/logdb.h>
 
 #include <atomic>
 #include <map>
@@ -22,6 +23,7 @@
 
 static const unsigned int DEFAULT_WALLET_DBLOGSIZE = 100;
 static const bool DEFAULT_WALLET_PRIVDB = true;
+static const bool DEFAULT_WALLET_LOGDB = false;
 
 class CDBEnv
 {
@@ -99,11 +101,10 @@ public:
     {
     }
 
-    /** Create DB handle to real database */
-    CWalletDBWrapper(CDBEnv *env_in, const std::string &strFile_in) :
-        nUpdateCounter(0), nLastSeen(0), nLastFlushed(0), nLastWalletUpdate(0), env(env_in), strFile(strFile_in)
-    {
-    }
+    /** Create DB handle to real database. Existing files are opened in their
+     * own format, new ones are created as a CLogDB if -walletlogdb is set.
+     */
+    CWalletDBWrapper(CDBEnv *env_in, const std::string &strFile_in);
 
     /** Rewrite the entire database on disk, with the exception of key pszSkip if non-zero
      */
@@ -133,6 +134,9 @@ private:
     CDBEnv *env;
     std::string strFile;
 
+    /** Set instead of using env for record log databases */
+    std::unique_ptr<CLogDB> logdb;
+
     /** Return whether this database handle is a dummy for testing.
      * Only to be used at a low level, application should ideally not care
      * about this.
@@ -141,7 +145,28 @@ private:
 };
 
 
-/** RAII class that provides access to a Berkeley database */
+/** Cursor over the records of a CDB, in key order */
+class CDBCursor
+{
+public:
+    ~CDBCursor()
+    {
+        if (pcursor)
+            pcursor->close();
+    }
+
+private:
+    friend class CDB;
+    explicit CDBCursor(Dbc* pcursorIn) : pcursor(pcursorIn), fStarted(false) {}
+
+    /** BerkeleyDB specific */
+    Dbc* pcursor;
+    /** Record log specific: key last read */
+    CSerializeData keyLast;
+    bool fStarted;
+};
+
+/** RAII class that provides access to a Berkeley database or a record log */
 class CDB
 {
 protected:
@@ -151,6 +176,15 @@ protected:
     bool fReadOnly;
     bool fFlushOnClose;
     CDBEnv *env;
+    /** Record log and the writes of its active transaction */
+    CLogDB* plog;
+    CLogDBBatch logTxn;
+    bool fLogTxnActive;
+
+    bool ReadLog(const CDataStream& ssKey, CDataStream& ssValue);
+    bool WriteLog(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite);
+    bool EraseLog(const CDataStream& ssKey);
+    bool ExistsLog(const CDataStream& ssKey);
 
 public:
     explicit CDB(CWalletDBWrapper& dbw, const char* pszMode = "r+", bool fFlushOnCloseIn=true);
@@ -175,13 +209,28 @@ public:
     template <typename K, typename T>
     bool Read(const K& key, T& value)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (plog) {
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            bool success = false;
+            if (ReadLog(ssKey, ssValue)) {
+                try {
+                    ssValue >> value;
+                    success = true;
+                } catch (const std::exception&) {
+                    // In this case success remains 'false'
+                }
+            }
+            return success;
+        }
+
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Read
@@ -210,7 +259,7 @@ public:
     template <typename K, typename T>
     bool Write(const K& key, const T& value, bool fOverwrite = true)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return true;
         if (fReadOnly)
             assert(!"Write called on database in read-only mode");
@@ -219,12 +268,16 @@ public:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(ssKey.data(), ssKey.size());
 
         // Value
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
+
+        if (plog)
+            return WriteLog(ssKey, ssValue, fOverwrite);
+
+        Dbt datKey(ssKey.data(), ssKey.size());
         Dbt datValue(ssValue.data(), ssValue.size());
 
         // Write
@@ -239,7 +292,7 @@ public:
     template <typename K>
     bool Erase(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
         if (fReadOnly)
             assert(!"Erase called on database in read-only mode");
@@ -248,6 +301,10 @@ public:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (plog)
+            return EraseLog(ssKey);
+
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Erase
@@ -261,13 +318,17 @@ public:
     template <typename K>
     bool Exists(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (plog)
+            return ExistsLog(ssKey);
+
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Exists
@@ -278,55 +339,21 @@ public:
         return (ret == 0);
     }
 
-    Dbc* GetCursor()
-    {
-        if (!pdb)
-            return nullptr;
-        Dbc* pcursor = nullptr;
-        int ret = pdb->cursor(nullptr, &pcursor, 0);
-        if (ret != 0)
-            return nullptr;
-        return pcursor;
-    }
+    /** Cursors read committed records only, like BerkeleyDB cursors outside a transaction */
+    std::unique_ptr<CDBCursor> GetCursor();
 
-    int ReadAtCursor(Dbc* pcursor, CDataStream& ssKey, CDataStream& ssValue, bool setRange = false)
-    {
-        // Read at cursor
-        Dbt datKey;
-        unsigned int fFlags = DB_NEXT;
-        if (setRange) {
-            datKey.set_data(ssKey.data());
-            datKey.set_size(ssKey.size());
-            fFlags = DB_SET_RANGE;
-        }
-        Dbt datValue;
-        datKey.set_flags(DB_DBT_MALLOC);
-        datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pcursor->get(&datKey, &datValue, fFlags);
-        if (ret != 0)
-            return ret;
-        else if (datKey.get_data() == nullptr || datValue.get_data() == nullptr)
-            return 99999;
-
-        // Convert to streams
-        ssKey.SetType(SER_DISK);
-        ssKey.clear();
-        ssKey.write((char*)datKey.get_data(), datKey.get_size());
-        ssValue.SetType(SER_DISK);
-        ssValue.clear();
-        ssValue.write((char*)datValue.get_data(), datValue.get_size());
-
-        // Clear and free memory
-        memory_cleanse(datKey.get_data(), datKey.get_size());
-        memory_cleanse(datValue.get_data(), datValue.get_size());
-        free(datKey.get_data());
-        free(datValue.get_data());
-        return 0;
-    }
+    /** Read the next record, or the first one at or after ssKey if setRange is set. Returns DB_NOTFOUND at the end. */
+    int ReadAtCursor(CDBCursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, bool setRange = false);
 
 public:
     bool TxnBegin()
     {
+        if (plog) {
+            if (fLogTxnActive)
+                return false;
+            fLogTxnActive = true;
+            return true;
+        }
         if (!pdb || activeTxn)
             return false;
         DbTxn* ptxn = bitdb.TxnBegin();
@@ -338,6 +365,14 @@ public:
 
     bool TxnCommit()
     {
+        if (plog) {
+            if (!fLogTxnActive)
+                return false;
+            bool ret = plog->WriteBatch(logTxn);
+            logTxn.Clear();
+            fLogTxnActive = false;
+            return ret;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->commit(0);
@@ -347,6 +382,13 @@ public:
 
     bool TxnAbort()
     {
+        if (plog) {
+            if (!fLogTxnActive)
+                return false;
+            logTxn.Clear();
+            fLogTxnActive = false;
+            return true;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->abort();
@@ -0,0 +1,461 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/logdb.h>
+
+#include <clientversion.h>
+#include <crypto/common.h>
+#include <hash.h>
+#include <serialize.h>
+#include <util.h>
+#include <utiltime.h>
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+/*
+ * File layout: an 8 byte magic and a 4 byte version, followed by records of
+ * a 4 byte body size, a 4 byte checksum (the start of the double SHA256 of
+ * the body) and the body. A body is a type byte followed by the key for
+ * writes and erases, and the value for writes.
+ */
+static const unsigned char LOGDB_MAGIC[8] = {'w', 'a', 'l', 'l', 'e', 't', 'l', 'g'};
+static const uint32_t LOGDB_VERSION = 1;
+static const size_t LOGDB_HEADER_SIZE = sizeof(LOGDB_MAGIC) + 4;
+static const size_t LOGDB_RECORD_HEADER_SIZE = 8;
+//! Compaction writes the new file in chunks of this size
+static const size_t LOGDB_WRITE_CHUNK_SIZE = 1 << 20;
+
+enum LogRecordType : uint8_t {
+    LOG_RECORD_WRITE = 1,
+    LOG_RECORD_ERASE = 2,
+    //! All records since the previous commit are complete
+    LOG_RECORD_COMMIT = 3,
+};
+
+void CLogDBBatch::Write(const CSerializeData& key, const CSerializeData& value)
+{
+    mapOps[key] = std::make_pair(true, value);
+}
+
+void CLogDBBatch::Erase(const CSerializeData& key)
+{
+    mapOps[key] = std::make_pair(false, CSerializeData());
+}
+
+bool CLogDBBatch::Lookup(const CSerializeData& key, bool& fExists, CSerializeData& value) const
+{
+    auto it = mapOps.find(key);
+    if (it == mapOps.end())
+        return false;
+    fExists = it->second.first;
+    if (fExists)
+        value = it->second.second;
+    return true;
+}
+
+CLogDB::CLogDB(const fs::path& pathIn) : path(pathIn), file(nullptr), nFileSize(0), nLiveSize(0)
+{
+}
+
+CLogDB::~CLogDB()
+{
+    Close();
+}
+
+bool CLogDB::IsLogFile(const fs::path& path)
+{
+    FILE* filein = fsbridge::fopen(path, "rb");
+    if (!filein)
+        return false;
+    unsigned char magic[sizeof(LOGDB_MAGIC)];
+    bool fMatch = fread(magic, 1, sizeof(magic), filein) == sizeof(magic) &&
+                  memcmp(magic, LOGDB_MAGIC, sizeof(magic)) == 0;
+    fclose(filein);
+    return fMatch;
+}
+
+bool CLogDB::Open(bool fCreate)
+{
+    LOCK(cs);
+    if (file)
+        return true;
+
+    bool fExists = fs::exists(path);
+    if (!fExists && !fCreate)
+        return error("%s: %s does not exist", __func__, path.string());
+
+    if (!fExists && !Create())
+        return false;
+
+    file = fsbridge::fopen(path, "rb+");
+    if (!file)
+        return error("%s: failed to open %s", __func__, path.string());
+
+    int64_t nStart = GetTimeMillis();
+    if (!Load()) {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    LogPrint(BCLog::DB, "%s: loaded %u records of %s in %dms\n", __func__, mapIndex.size(), path.string(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CLogDB::Create()
+{
+    // Written next to the log and renamed into place, so a crash never
+    // leaves a log file without its header behind.
+    fs::path pathTmp = path;
+    pathTmp += ".new";
+    FILE* fileNew = fsbridge::fopen(pathTmp, "wb");
+    if (!fileNew)
+        return error("%s: failed to create %s", __func__, pathTmp.string());
+
+    unsigned char header[LOGDB_HEADER_SIZE];
+    memcpy(header, LOGDB_MAGIC, sizeof(LOGDB_MAGIC));
+    WriteLE32(header + sizeof(LOGDB_MAGIC), LOGDB_VERSION);
+    bool fSuccess = fwrite(header, 1, sizeof(header), fileNew) == sizeof(header) && fflush(fileNew) == 0;
+    if (fSuccess)
+        FileCommit(fileNew);
+    fclose(fileNew);
+    if (!fSuccess || !RenameOver(pathTmp, path)) {
+        fs::remove(pathTmp);
+        return error("%s: failed to write header of %s", __func__, path.string());
+    }
+    DirectoryCommit(path.parent_path());
+    return true;
+}
+
+bool CLogDB::IsOpen() const
+{
+    LOCK(cs);
+    return file != nullptr;
+}
+
+void CLogDB::Close()
+{
+    LOCK(cs);
+    if (file) {
+        fflush(file);
+        FileCommit(file);
+        fclose(file);
+        file = nullptr;
+    }
+    mapIndex.clear();
+    nFileSize = 0;
+    nLiveSize = 0;
+}
+
+uint32_t CLogDB::AppendRecord(CDataStream& ss, uint8_t nType, const CSerializeData* pkey, const CSerializeData* pvalue)
+{
+    CDataStream body(SER_DISK, CLIENT_VERSION);
+    body << nType;
+    if (pkey)
+        body << *pkey;
+    if (pvalue) {
+        WriteCompactSize(body, pvalue->size());
+        body.write(pvalue->data(), pvalue->size());
+    }
+
+    unsigned char header[LOGDB_RECORD_HEADER_SIZE];
+    WriteLE32(header, body.size());
+    WriteLE32(header + 4, ReadLE32(Hash(body.begin(), body.end()).begin()));
+
+    ss.write((const char*)header, sizeof(header));
+    ss.write(body.data(), body.size());
+    return LOGDB_RECORD_HEADER_SIZE + body.size();
+}
+
+bool CLogDB::Load()
+{
+    AssertLockHeld(cs);
+    mapIndex.clear();
+    nFileSize = 0;
+    nLiveSize = 0;
+
+    if (fseek(file, 0, SEEK_END))
+        return error("%s: failed to seek to end of %s", __func__, path.string());
+    long nEnd = ftell(file);
+    if (nEnd < 0)
+        return error("%s: failed to get size of %s", __func__, path.string());
+    rewind(file);
+
+    unsigned char header[LOGDB_HEADER_SIZE];
+    if ((size_t)nEnd < sizeof(header) || fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, LOGDB_MAGIC, sizeof(LOGDB_MAGIC)) != 0)
+        return error("%s: %s is not a wallet log file", __func__, path.string());
+    if (ReadLE32(header + sizeof(LOGDB_MAGIC)) > LOGDB_VERSION)
+        return error("%s: %s was written by a newer version", __func__, path.string());
+
+    // Records only take effect once the commit record after them is read.
+    struct PendingOp {
+        CSerializeData key;
+        CSerializeData value;
+        uint32_t nRecordSize;
+        bool fErase;
+    };
+    std::vector<PendingOp> vPending;
+
+    uint64_t nPos = sizeof(header);
+    uint64_t nCommitted = nPos;
+    CSerializeData body;
+    while (nPos + LOGDB_RECORD_HEADER_SIZE <= (uint64_t)nEnd) {
+        unsigned char recordHeader[LOGDB_RECORD_HEADER_SIZE];
+        if (fread(recordHeader, 1, sizeof(recordHeader), file) != sizeof(recordHeader))
+            break;
+        uint32_t nSize = ReadLE32(recordHeader);
+        if (nSize == 0 || nSize > MAX_SIZE || nPos + sizeof(recordHeader) + nSize > (uint64_t)nEnd)
+            break;
+        body.resize(nSize);
+        if (fread(body.data(), 1, nSize, file) != nSize)
+            break;
+        if (ReadLE32(Hash(body.begin(), body.end()).begin()) != ReadLE32(recordHeader + 4))
+            break;
+
+        try {
+            CDataStream ss(body.begin(), body.end(), SER_DISK, CLIENT_VERSION);
+            uint8_t nType;
+            ss >> nType;
+            if (nType == LOG_RECORD_COMMIT) {
+                for (const PendingOp& op : vPending) {
+                    if (op.fErase)
+                        EraseEntry(op.key);
+                    else
+                        SetEntry(op.key, op.value, op.nRecordSize);
+                }
+                vPending.clear();
+                nCommitted = nPos + sizeof(recordHeader) + nSize;
+            } else if (nType == LOG_RECORD_WRITE || nType == LOG_RECORD_ERASE) {
+                PendingOp op;
+                ss >> op.key;
+                op.fErase = nType == LOG_RECORD_ERASE;
+                op.nRecordSize = sizeof(recordHeader) + nSize;
+                if (!op.fErase) {
+                    uint64_t nValueSize = ReadCompactSize(ss);
+                    if (nValueSize != ss.size())
+                        break;
+                    op.value.assign(ss.begin(), ss.end());
+                }
+                vPending.push_back(std::move(op));
+            } else {
+                break;
+            }
+        } catch (const std::exception&) {
+            break;
+        }
+        nPos += sizeof(recordHeader) + nSize;
+    }
+
+    if (nCommitted < (uint64_t)nEnd) {
+        // A write was interrupted, the batch it belonged to never happened.
+        LogPrintf("%s: dropping %u bytes of incomplete records at the end of %s\n", __func__, (uint64_t)nEnd - nCommitted, path.string());
+        if (!TruncateFile(file, nCommitted))
+            return error("%s: failed to truncate %s", __func__, path.string());
+    }
+    nFileSize = nCommitted;
+    return true;
+}
+
+void CLogDB::SetEntry(const CSerializeData& key, const CSerializeData& value, uint32_t nRecordSize)
+{
+    CIndexEntry& entry = mapIndex[key];
+    nLiveSize -= entry.nRecordSize;
+    entry.value = value;
+    entry.nRecordSize = nRecordSize;
+    nLiveSize += nRecordSize;
+}
+
+void CLogDB::EraseEntry(const CSerializeData& key)
+{
+    auto it = mapIndex.find(key);
+    if (it != mapIndex.end()) {
+        nLiveSize -= it->second.nRecordSize;
+        mapIndex.erase(it);
+    }
+}
+
+bool CLogDB::Read(const CSerializeData& key, CSerializeData& value) const
+{
+    LOCK(cs);
+    if (!file)
+        return false;
+    auto it = mapIndex.find(key);
+    if (it == mapIndex.end())
+        return false;
+    value = it->second.value;
+    return true;
+}
+
+bool CLogDB::Exists(const CSerializeData& key) const
+{
+    LOCK(cs);
+    return file && mapIndex.count(key);
+}
+
+bool CLogDB::ReadNext(const CSerializeData* pkeyFrom, bool fInclusive, CSerializeData& key, CSerializeData& value) const
+{
+    LOCK(cs);
+    if (!file)
+        return false;
+    auto it = mapIndex.begin();
+    if (pkeyFrom)
+        it = fInclusive ? mapIndex.lower_bound(*pkeyFrom) : mapIndex.upper_bound(*pkeyFrom);
+    if (it == mapIndex.end())
+        return false;
+    key = it->first;
+    value = it->second.value;
+    return true;
+}
+
+bool CLogDB::WriteBatch(const CLogDBBatch& batch)
+{
+    LOCK(cs);
+    if (!file)
+        return false;
+    if (batch.IsEmpty())
+        return true;
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    std::vector<uint32_t> vRecordSizes;
+    vRecordSizes.reserve(batch.mapOps.size());
+    for (const auto& op : batch.mapOps) {
+        if (op.second.first)
+            vRecordSizes.push_back(AppendRecord(ss, LOG_RECORD_WRITE, &op.first, &op.second.second));
+        else
+            vRecordSizes.push_back(AppendRecord(ss, LOG_RECORD_ERASE, &op.first, nullptr));
+    }
+    AppendRecord(ss, LOG_RECORD_COMMIT, nullptr, nullptr);
+
+    if (fseek(file, nFileSize, SEEK_SET) ||
+        fwrite(ss.data(), 1, ss.size(), file) != ss.size() ||
+        fflush(file) != 0) {
+        // Cut the partial batch off again, so later batches stay readable.
+        TruncateFile(file, nFileSize);
+        return error("%s: failed to append to %s", __func__, path.string());
+    }
+    nFileSize += ss.size();
+
+    size_t i = 0;
+    for (const auto& op : batch.mapOps) {
+        if (op.second.first)
+            SetEntry(op.first, op.second.second, vRecordSizes[i]);
+        else
+            EraseEntry(op.first);
+        ++i;
+    }
+    return true;
+}
+
+bool CLogDB::Flush()
+{
+    LOCK(cs);
+    if (!file)
+        return true;
+    if (fflush(file) != 0)
+        return error("%s: failed to flush %s", __func__, path.string());
+    FileCommit(file);
+    return true;
+}
+
+bool CLogDB::NeedsCompaction() const
+{
+    LOCK(cs);
+    return file && nFileSize >= LOGDB_COMPACT_MIN_SIZE && nFileSize > 2 * nLiveSize;
+}
+
+bool CLogDB::Compact(const char* pszSkip)
+{
+    LOCK(cs);
+    if (!file)
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    uint64_t nOldSize = nFileSize;
+    fs::path pathTmp = path;
+    pathTmp += ".compact";
+    FILE* fileNew = fsbridge::fopen(pathTmp, "wb");
+    if (!fileNew)
+        return error("%s: failed to create %s", __func__, pathTmp.string());
+
+    // Values are rewritten in the same records, only the skipped keys go away
+    std::vector<CSerializeData> vSkipped;
+    uint64_t nNewLiveSize = 0;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    unsigned char header[LOGDB_HEADER_SIZE];
+    memcpy(header, LOGDB_MAGIC, sizeof(LOGDB_MAGIC));
+    WriteLE32(header + sizeof(LOGDB_MAGIC), LOGDB_VERSION);
+    ss.write((const char*)header, sizeof(header));
+
+    uint64_t nPos = 0;
+    bool fSuccess = true;
+    for (const auto& item : mapIndex) {
+        if (pszSkip && strncmp(item.first.data(), pszSkip, std::min(item.first.size(), strlen(pszSkip))) == 0) {
+            vSkipped.push_back(item.first);
+            continue;
+        }
+        nNewLiveSize += AppendRecord(ss, LOG_RECORD_WRITE, &item.first, &item.second.value);
+        if (ss.size() >= LOGDB_WRITE_CHUNK_SIZE) {
+            if (fwrite(ss.data(), 1, ss.size(), fileNew) != ss.size()) {
+                fSuccess = false;
+                break;
+            }
+            nPos += ss.size();
+            ss.clear();
+        }
+    }
+    if (fSuccess) {
+        AppendRecord(ss, LOG_RECORD_COMMIT, nullptr, nullptr);
+        fSuccess = fwrite(ss.data(), 1, ss.size(), fileNew) == ss.size() && fflush(fileNew) == 0;
+        nPos += ss.size();
+    }
+    if (fSuccess)
+        FileCommit(fileNew);
+    fclose(fileNew);
+    if (!fSuccess) {
+        fs::remove(pathTmp);
+        return error("%s: failed to write %s", __func__, pathTmp.string());
+    }
+
+    fclose(file);
+    file = nullptr;
+    fSuccess = RenameOver(pathTmp, path);
+    if (fSuccess) {
+        // Make the rename itself durable before appending to the new file
+        DirectoryCommit(path.parent_path());
+        for (const CSerializeData& key : vSkipped)
+            mapIndex.erase(key);
+        nFileSize = nPos;
+        nLiveSize = nNewLiveSize;
+    }
+    file = fsbridge::fopen(path, "rb+");
+    if (!file) {
+        mapIndex.clear();
+        return error("%s: failed to reopen %s", __func__, path.string());
+    }
+    if (!fSuccess)
+        return error("%s: failed to rename %s over %s", __func__, pathTmp.string(), path.string());
+
+    LogPrint(BCLog::DB, "%s: compacted %s from %u to %u bytes in %dms\n", __func__, path.string(), nOldSize, nFileSize, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CLogDB::Backup(const fs::path& pathDest) const
+{
+    LOCK(cs);
+    if (file) {
+        if (fflush(file) != 0)
+            return error("%s: failed to flush %s", __func__, path.string());
+        FileCommit(file);
+    }
+    try {
+        if (fs::exists(pathDest) && fs::equivalent(path, pathDest))
+            return error("%s: cannot backup to wallet source file %s", __func__, pathDest.string());
+        fs::copy_file(path, pathDest, fs::copy_option::overwrite_if_exists);
+    } catch (const fs::filesystem_error& e) {
+        return error("%s: error copying %s to %s - %s", __func__, path.string(), pathDest.string(), e.what());
+    }
+    return true;
+}
@@ -0,0 +1,114 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_LOGDB_H
+#define BITCOIN_WALLET_LOGDB_H
+
+#include <fs.h>
+#include <streams.h>
+#include <support/allocators/zeroafterfree.h>
+#include <sync.h>
+
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <utility>
+
+/** Files smaller than this are never compacted */
+static const uint64_t LOGDB_COMPACT_MIN_SIZE = 1 << 20;
+
+/** A set of writes and erases that is appended to a CLogDB atomically */
+class CLogDBBatch
+{
+public:
+    void Write(const CSerializeData& key, const CSerializeData& value);
+    void Erase(const CSerializeData& key);
+
+    /** Return whether the batch touches key, and if so whether it leaves a value */
+    bool Lookup(const CSerializeData& key, bool& fExists, CSerializeData& value) const;
+
+    bool IsEmpty() const { return mapOps.empty(); }
+    void Clear() { mapOps.clear(); }
+
+private:
+    friend class CLogDB;
+    //! Pending value per key, or no value for an erase
+    std::map<CSerializeData, std::pair<bool, CSerializeData> > mapOps;
+};
+
+/**
+ * Key/value store kept as an append-only log of checksummed records.
+ *
+ * Every write or erase is appended to the file, followed by a commit record
+ * once the batch it belongs to is complete. Opening the file reads it
+ * sequentially into a map of the live keys and values, dropping a torn or
+ * uncommitted tail. Reads are served from that map without touching the
+ * file. Superseded records are removed by Compact, which rewrites the live
+ * records to a new file and renames it over the old one.
+ */
+class CLogDB
+{
+public:
+    explicit CLogDB(const fs::path& pathIn);
+    ~CLogDB();
+
+    CLogDB(const CLogDB&) = delete;
+    CLogDB& operator=(const CLogDB&) = delete;
+
+    /** Return whether the file at path starts with the log header */
+    static bool IsLogFile(const fs::path& path);
+
+    /** Open and index the file, creating it if it does not exist and fCreate is set */
+    bool Open(bool fCreate);
+    bool IsOpen() const;
+    void Close();
+
+    bool Read(const CSerializeData& key, CSerializeData& value) const;
+    bool Exists(const CSerializeData& key) const;
+    /** Read the first record with a key after pkeyFrom (or at it, if fInclusive), or the first record if pkeyFrom is null */
+    bool ReadNext(const CSerializeData* pkeyFrom, bool fInclusive, CSerializeData& key, CSerializeData& value) const;
+
+    /** Append all records of the batch with a single write */
+    bool WriteBatch(const CLogDBBatch& batch);
+
+    /** Make sure all appended records are on disk */
+    bool Flush();
+
+    /** Return whether superseded records take up most of the file */
+    bool NeedsCompaction() const;
+    /** Rewrite the live records, leaving out keys starting with pszSkip if non-zero */
+    bool Compact(const char* pszSkip = nullptr);
+
+    /** Copy the file to pathDest */
+    bool Backup(const fs::path& pathDest) const;
+
+    const fs::path& GetPath() const { return path; }
+
+private:
+    struct CIndexEntry
+    {
+        CSerializeData value;
+        //! Size of the record the value was last written in
+        uint32_t nRecordSize = 0;
+    };
+
+    mutable CCriticalSection cs;
+    const fs::path path;
+    FILE* file;
+    std::map<CSerializeData, CIndexEntry> mapIndex;
+    //! Bytes in the file, and bytes of the records holding the values in mapIndex
+    uint64_t nFileSize;
+    uint64_t nLiveSize;
+
+    /** Serialize a record into ss, returning its size */
+    static uint32_t AppendRecord(CDataStream& ss, uint8_t nType, const CSerializeData* pkey, const CSerializeData* pvalue);
+
+    /** Write a new file with just the header */
+    bool Create();
+    bool Load();
+    void SetEntry(const CSerializeData& key, const CSerializeData& value, uint32_t nRecordSize);
+    void EraseEntry(const CSerializeData& key);
+};
+
+#endif // BITCOIN_WALLET_LOGDB_H
@@ -0,0 +1,295 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/logdb.h>
+
+#include <test/test_drivenet.h>
+#include <util.h>
+#include <wallet/db.h>
+#include <wallet/wallet.h>
+#include <wallet/walletdb.h>
+#include <wallet/walletutil.h>
+
+#include <memory>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(logdb_tests, TestingSetup)
+
+static CSerializeData Data(const std::string& str)
+{
+    return CSerializeData(str.begin(), str.end());
+}
+
+static std::string Str(const CSerializeData& data)
+{
+    return std::string(data.begin(), data.end());
+}
+
+BOOST_AUTO_TEST_CASE(logdb_write_read_reopen)
+{
+    fs::path path = pathTemp / "logdb_basic.dat";
+    CSerializeData value;
+    {
+        CLogDB db(path);
+        BOOST_CHECK(!db.Open(false));
+        // A header left half written by a crash is replaced
+        fs::path pathNew = path;
+        pathNew += ".new";
+        FILE* fileNew = fsbridge::fopen(pathNew, "wb");
+        BOOST_REQUIRE(fileNew);
+        fclose(fileNew);
+        BOOST_CHECK(db.Open(true));
+        BOOST_CHECK(CLogDB::IsLogFile(path));
+        BOOST_CHECK(!fs::exists(pathNew));
+
+        CLogDBBatch batch;
+        batch.Write(Data("b"), Data("2"));
+        batch.Write(Data("a"), Data("1"));
+        batch.Write(Data("c"), Data("3"));
+        BOOST_CHECK(db.WriteBatch(batch));
+
+        batch.Clear();
+        batch.Erase(Data("c"));
+        batch.Write(Data("a"), Data("one"));
+        batch.Write(Data("d"), CSerializeData());
+        BOOST_CHECK(db.WriteBatch(batch));
+
+        BOOST_CHECK(db.Read(Data("a"), value));
+        BOOST_CHECK_EQUAL(Str(value), "one");
+        BOOST_CHECK(!db.Exists(Data("c")));
+    }
+
+    // Everything committed is indexed again on open
+    CLogDB db(path);
+    BOOST_CHECK(db.Open(false));
+    BOOST_CHECK(db.Read(Data("a"), value));
+    BOOST_CHECK_EQUAL(Str(value), "one");
+    BOOST_CHECK(db.Read(Data("b"), value));
+    BOOST_CHECK_EQUAL(Str(value), "2");
+    BOOST_CHECK(db.Read(Data("d"), value));
+    BOOST_CHECK(value.empty());
+    BOOST_CHECK(!db.Read(Data("c"), value));
+
+    // Records are iterated in key order
+    std::string strKeys;
+    CSerializeData key;
+    for (bool fFound = db.ReadNext(nullptr, false, key, value); fFound; fFound = db.ReadNext(&key, false, key, value)) {
+        strKeys += Str(key);
+    }
+    BOOST_CHECK_EQUAL(strKeys, "abd");
+    CSerializeData keyFrom = Data("b");
+    BOOST_CHECK(db.ReadNext(&keyFrom, false, key, value));
+    BOOST_CHECK_EQUAL(Str(key), "d");
+    keyFrom = Data("c");
+    BOOST_CHECK(db.ReadNext(&keyFrom, true, key, value));
+    BOOST_CHECK_EQUAL(Str(key), "d");
+
+    BOOST_CHECK(!CLogDB::IsLogFile(pathTemp / "missing.dat"));
+}
+
+BOOST_AUTO_TEST_CASE(logdb_torn_tail)
+{
+    fs::path path = pathTemp / "logdb_torn.dat";
+    {
+        CLogDB db(path);
+        BOOST_CHECK(db.Open(true));
+        CLogDBBatch batch;
+        batch.Write(Data("key"), Data("value"));
+        BOOST_CHECK(db.WriteBatch(batch));
+    }
+    uint64_t nCommittedSize = fs::file_size(path);
+
+    // Append the start of a second batch without its commit record
+    {
+        fs::path pathOther = pathTemp / "logdb_other.dat";
+        CLogDB other(pathOther);
+        BOOST_CHECK(other.Open(true));
+        CLogDBBatch batch;
+        batch.Write(Data("lost"), Data("value"));
+        BOOST_CHECK(other.WriteBatch(batch));
+        other.Close();
+
+        std::vector<char> vRecords(fs::file_size(pathOther));
+        FILE* file = fsbridge::fopen(pathOther, "rb");
+        BOOST_CHECK(fread(vRecords.data(), 1, vRecords.size(), file) == vRecords.size());
+        fclose(file);
+
+        // Skip the header, drop the last byte of the commit record
+        file = fsbridge::fopen(path, "ab");
+        fwrite(vRecords.data() + 12, 1, vRecords.size() - 13, file);
+        fclose(file);
+    }
+    BOOST_CHECK(fs::file_size(path) > nCommittedSize);
+
+    CSerializeData value;
+    {
+        CLogDB db(path);
+        BOOST_CHECK(db.Open(false));
+        BOOST_CHECK_EQUAL(fs::file_size(path), nCommittedSize);
+        BOOST_CHECK(db.Read(Data("key"), value));
+        BOOST_CHECK_EQUAL(Str(value), "value");
+        BOOST_CHECK(!db.Exists(Data("lost")));
+
+        // Appending after the truncation point works
+        CLogDBBatch batch;
+        batch.Write(Data("next"), Data("value"));
+        BOOST_CHECK(db.WriteBatch(batch));
+    }
+
+    // A corrupt record ends the log as well
+    {
+        FILE* file = fsbridge::fopen(path, "rb+");
+        fseek(file, -1, SEEK_END);
+        fputc('x', file);
+        fclose(file);
+    }
+    CLogDB db(path);
+    BOOST_CHECK(db.Open(false));
+    BOOST_CHECK(db.Exists(Data("key")));
+    BOOST_CHECK(!db.Exists(Data("next")));
+}
+
+BOOST_AUTO_TEST_CASE(logdb_compact)
+{
+    fs::path path = pathTemp / "logdb_compact.dat";
+    CLogDB db(path);
+    BOOST_CHECK(db.Open(true));
+
+    std::string strLarge(1000, 'x');
+    for (int i = 0; i < 2000; i++) {
+        CLogDBBatch batch;
+        batch.Write(Data("counter"), Data(std::to_string(i) + strLarge));
+        if (i % 100 == 0)
+            batch.Write(Data("\x04pool" + std::to_string(i)), Data("key"));
+        BOOST_CHECK(db.WriteBatch(batch));
+    }
+    BOOST_CHECK(db.NeedsCompaction());
+
+    uint64_t nSize = fs::file_size(path);
+    BOOST_CHECK(db.Compact("\x04pool"));
+    BOOST_CHECK(fs::file_size(path) < nSize / 100);
+    BOOST_CHECK(!db.NeedsCompaction());
+
+    CSerializeData value;
+    BOOST_CHECK(db.Read(Data("counter"), value));
+    BOOST_CHECK_EQUAL(Str(value), "1999" + strLarge);
+    BOOST_CHECK(!db.Exists(Data("\x04pool0")));
+
+    // The compacted file can be appended to and opened again
+    CLogDBBatch batch;
+    batch.Write(Data("after"), Data("compaction"));
+    BOOST_CHECK(db.WriteBatch(batch));
+    db.Close();
+
+    BOOST_CHECK(db.Open(false));
+    BOOST_CHECK(db.Read(Data("counter"), value));
+    BOOST_CHECK_EQUAL(Str(value), "1999" + strLarge);
+    BOOST_CHECK(db.Read(Data("after"), value));
+    BOOST_CHECK_EQUAL(Str(value), "compaction");
+}
+
+BOOST_AUTO_TEST_CASE(logdb_walletdb)
+{
+    // Non-mock environment, so new wallet files are created as record logs
+    gArgs.ForceSetArg("-walletlogdb", "1");
+    CDBEnv env;
+    const std::string strFile = "logdb_wallet.dat";
+
+    CKey key;
+    key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+    const CTxDestination dest = pubkey.GetID();
+
+    // A wallet written through CWalletDB is loaded back from the log
+    {
+        CWallet wallet(std::unique_ptr<CWalletDBWrapper>(new CWalletDBWrapper(&env, strFile)));
+        bool fFirstRun;
+        BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+        BOOST_CHECK(fFirstRun);
+        BOOST_CHECK(CLogDB::IsLogFile(GetWalletDir() / strFile));
+
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.AddKeyPubKey(key, pubkey));
+        BOOST_CHECK(wallet.SetAddressBook(dest, "label", "receive"));
+        CWalletDB walletdb(wallet.GetDBHandle());
+        BOOST_CHECK(walletdb.WritePool(1, CKeyPool(pubkey, false)));
+    }
+    {
+        CWallet wallet(std::unique_ptr<CWalletDBWrapper>(new CWalletDBWrapper(&env, strFile)));
+        bool fFirstRun;
+        BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+        BOOST_CHECK(!fFirstRun);
+
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.HaveKey(pubkey.GetID()));
+        BOOST_CHECK(wallet.mapAddressBook.count(dest));
+        BOOST_CHECK_EQUAL(wallet.mapAddressBook[dest].name, "label");
+        BOOST_CHECK_EQUAL(wallet.mapAddressBook[dest].purpose, "receive");
+        BOOST_CHECK_EQUAL(wallet.KeypoolCountExternalKeys(), 1U);
+    }
+
+    CWalletDBWrapper dbw(&env, strFile);
+    CKeyPool keypool;
+    CAccount account;
+    account.vchPubKey = pubkey;
+    {
+        CWalletDB writer(dbw);
+        CWalletDB reader(dbw);
+
+        // Writes in a transaction are only seen by its own handle until committed
+        BOOST_CHECK(writer.TxnBegin());
+        BOOST_CHECK(!writer.TxnBegin());
+        BOOST_CHECK(writer.WriteAccount("txn", account));
+        BOOST_CHECK(writer.ErasePool(1));
+        BOOST_CHECK(writer.ReadAccount("txn", account));
+        BOOST_CHECK(!writer.ReadPool(1, keypool));
+        BOOST_CHECK(!reader.ReadAccount("txn", account));
+        BOOST_CHECK(reader.ReadPool(1, keypool));
+        BOOST_CHECK(writer.TxnCommit());
+        BOOST_CHECK(!writer.TxnCommit());
+        BOOST_CHECK(reader.ReadAccount("txn", account));
+        BOOST_CHECK(!reader.ReadPool(1, keypool));
+
+        // Aborted writes are dropped
+        BOOST_CHECK(writer.TxnBegin());
+        BOOST_CHECK(writer.WriteAccount("aborted", account));
+        BOOST_CHECK(writer.WritePool(2, CKeyPool(pubkey, false)));
+        BOOST_CHECK(writer.TxnAbort());
+        BOOST_CHECK(!writer.TxnAbort());
+        BOOST_CHECK(!writer.ReadAccount("aborted", account));
+        BOOST_CHECK(!reader.ReadPool(2, keypool));
+
+        BOOST_CHECK(writer.WritePool(3, CKeyPool(pubkey, false)));
+        BOOST_CHECK(reader.ReadPool(3, keypool));
+    }
+
+    // Rewriting leaves out the skipped prefix only
+    BOOST_CHECK(dbw.Rewrite("\x04pool"));
+    {
+        CWalletDB walletdb(dbw);
+        BOOST_CHECK(!walletdb.ReadPool(3, keypool));
+        BOOST_CHECK(walletdb.ReadAccount("txn", account));
+        BOOST_CHECK(account.vchPubKey == pubkey);
+        BOOST_CHECK(walletdb.WritePool(4, CKeyPool(pubkey, false)));
+    }
+
+    // A backup is a log file with the same records, and cannot replace its source
+    BOOST_CHECK(!dbw.Backup((GetWalletDir() / strFile).string()));
+    const std::string strBackup = "logdb_wallet_backup.dat";
+    BOOST_CHECK(dbw.Backup((GetWalletDir() / strBackup).string()));
+    BOOST_CHECK(CLogDB::IsLogFile(GetWalletDir() / strBackup));
+    {
+        CWalletDBWrapper dbwBackup(&env, strBackup);
+        CWalletDB walletdb(dbwBackup);
+        BOOST_CHECK(walletdb.ReadAccount("txn", account));
+        BOOST_CHECK(walletdb.ReadPool(4, keypool));
+        BOOST_CHECK(!walletdb.ReadPool(3, keypool));
+    }
+
+    gArgs.ForceSetArg("-walletlogdb", "0");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
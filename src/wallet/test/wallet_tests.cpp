@@ -9,12 +9,14 @@
 #include <utility>
 #include <vector>
 
+#include <blockfilterindex.h>
 #include <consensus/validation.h>
 #include <rpc/server.h>
 #include <test/test_drivenet.h>
 #include <validation.h>
 #include <wallet/coincontrol.h>
 #include <wallet/test/wallet_test_fixture.h>
+#include <workerpool.h>
 
 #include <boost/test/unit_test.hpp>
 #include <univalue.h>
@@ -362,6 +364,91 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     empty_wallet();
 }
 
+static void add_bnb_coin(std::vector<CInputCoin>& utxo_pool, const CAmount& nValue, const CAmount& effective_value)
+{
+    CInputCoin coin(COutPoint(uint256S(strprintf("%x", utxo_pool.size() + 1)), 0), CTxOut(nValue, CScript()));
+    coin.effective_value = effective_value;
+    utxo_pool.push_back(coin);
+}
+
+static CAmount sum_values(const CoinSet& set)
+{
+    CAmount nTotal = 0;
+    for (const CInputCoin& coin : set)
+        nTotal += coin.txout.nValue;
+    return nTotal;
+}
+
+// Pairs of inputs 2^(n+i) and 2^(n+i) + 2^(n-1-i), summing the former to the
+// target. Searching largest first, every branch through the larger inputs
+// is tried before the solution, taking exponentially many steps in n.
+static CAmount make_hard_case(int n, std::vector<CInputCoin>& utxo_pool)
+{
+    utxo_pool.clear();
+    CAmount nTarget = 0;
+    for (int i = 0; i < n; ++i) {
+        nTarget += (CAmount)1 << (n + i);
+        add_bnb_coin(utxo_pool, (CAmount)1 << (n + i), (CAmount)1 << (n + i));
+        add_bnb_coin(utxo_pool, ((CAmount)1 << (n + i)) + ((CAmount)1 << (n - 1 - i)), ((CAmount)1 << (n + i)) + ((CAmount)1 << (n - 1 - i)));
+    }
+    return nTarget;
+}
+
+BOOST_AUTO_TEST_CASE(bnb_search_test)
+{
+    std::vector<CInputCoin> utxo_pool;
+    CoinSet selection;
+    CAmount nValueRet = 0;
+
+    for (CAmount nValue : {1 * CENT, 2 * CENT, 3 * CENT, 4 * CENT})
+        add_bnb_coin(utxo_pool, nValue, nValue);
+
+    // Exact matches, using one or several inputs
+    BOOST_CHECK(SelectCoinsBnB(utxo_pool, 1 * CENT, 0, selection, nValueRet, 0));
+    BOOST_CHECK_EQUAL(nValueRet, 1 * CENT);
+    BOOST_CHECK_EQUAL(selection.size(), 1U);
+    BOOST_CHECK(SelectCoinsBnB(utxo_pool, 5 * CENT, 0, selection, nValueRet, 0));
+    BOOST_CHECK_EQUAL(nValueRet, 5 * CENT);
+    BOOST_CHECK_EQUAL(sum_values(selection), 5 * CENT);
+    BOOST_CHECK(SelectCoinsBnB(utxo_pool, 10 * CENT, 0, selection, nValueRet, 0));
+    BOOST_CHECK_EQUAL(selection.size(), 4U);
+
+    // Not enough funds, or no subset within the cost of change
+    BOOST_CHECK(!SelectCoinsBnB(utxo_pool, 11 * CENT, 0, selection, nValueRet, 0));
+    BOOST_CHECK(!SelectCoinsBnB(utxo_pool, CENT / 2, CENT / 4, selection, nValueRet, 0));
+
+    // Overshooting the target by less than the cost of change is acceptable
+    BOOST_CHECK(SelectCoinsBnB(utxo_pool, CENT / 2, CENT / 2, selection, nValueRet, 0));
+    BOOST_CHECK_EQUAL(nValueRet, 1 * CENT);
+
+    // Fees of the non-input parts raise the target
+    BOOST_CHECK(SelectCoinsBnB(utxo_pool, 9 * CENT, 0, selection, nValueRet, 1 * CENT));
+    BOOST_CHECK_EQUAL(selection.size(), 4U);
+
+    // Effective values decide, the returned value is the full input value
+    utxo_pool.clear();
+    add_bnb_coin(utxo_pool, 3 * CENT, 1 * CENT);
+    add_bnb_coin(utxo_pool, 2 * CENT, 2 * CENT);
+    BOOST_CHECK(SelectCoinsBnB(utxo_pool, 1 * CENT, 0, selection, nValueRet, 0));
+    BOOST_CHECK_EQUAL(nValueRet, 3 * CENT);
+
+    // A target below every input fails quickly, as each input overshoots it
+    utxo_pool.clear();
+    for (int i = 0; i < 50; ++i)
+        add_bnb_coin(utxo_pool, 2 * CENT + i, 2 * CENT + i);
+    BOOST_CHECK(!SelectCoinsBnB(utxo_pool, 1 * CENT, 0, selection, nValueRet, 0));
+    BOOST_CHECK(selection.empty());
+
+    // The hard case has an exact solution that is only found late, so a
+    // failure means the search gave up after MAX_BNB_TRIES
+    CAmount nTarget = make_hard_case(17, utxo_pool);
+    BOOST_CHECK(!SelectCoinsBnB(utxo_pool, nTarget, 0, selection, nValueRet, 0));
+    BOOST_CHECK(selection.empty());
+    nTarget = make_hard_case(14, utxo_pool);
+    BOOST_CHECK(SelectCoinsBnB(utxo_pool, nTarget, 0, selection, nValueRet, 0));
+    BOOST_CHECK_EQUAL(nValueRet, nTarget);
+}
+
 static void AddKey(CWallet& wallet, const CKey& key)
 {
     LOCK(wallet.cs_wallet);
@@ -445,6 +532,40 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
     }
 }
 
+// Rescans with -blockfilterindex skip blocks whose filters match none of
+// the wallet's scripts, and still find everything paying the wallet.
+BOOST_FIXTURE_TEST_CASE(rescan_block_filters, TestChain100Setup)
+{
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    CreateAndProcessBlock({}, GetScriptForDestination(otherKey.GetPubKey().GetID()));
+
+    g_blockfilterindex.reset(new CBlockFilterIndex(1 << 20, true));
+    BOOST_CHECK(g_blockfilterindex->Sync());
+
+    LOCK(cs_main);
+    CBlockIndex* const nullBlock = nullptr;
+    {
+        CWallet wallet;
+        AddKey(wallet, coinbaseKey);
+        WalletRescanReserver reserver(&wallet);
+        reserver.reserve();
+        BOOST_CHECK_EQUAL(nullBlock, wallet.ScanForWalletTransactions(chainActive.Genesis(), nullptr, reserver));
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 100U);
+    }
+    {
+        CWallet wallet;
+        AddKey(wallet, otherKey);
+        WalletRescanReserver reserver(&wallet);
+        reserver.reserve();
+        BOOST_CHECK_EQUAL(nullBlock, wallet.ScanForWalletTransactions(chainActive.Genesis(), nullptr, reserver));
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 1U);
+        BOOST_CHECK(wallet.mapWallet.begin()->second.hashBlock == chainActive.Tip()->GetBlockHash());
+    }
+
+    g_blockfilterindex.reset();
+}
+
 // Verify importwallet RPC starts rescan at earliest block with timestamp
 // greater or equal than key birthday. Previously there was a bug where
 // importwallet RPC would start the scan at the latest block with timestamp less
@@ -530,6 +651,107 @@ BOOST_FIXTURE_TEST_CASE(coin_mark_dirty_immature_credit, TestChain100Setup)
     BOOST_CHECK_EQUAL(wtx.GetImmatureCredit(), 50*COIN);
 }
 
+// Keys, scripts and watch-only scripts added after the first IsMine() call
+// must still be recognized, and bare multisig bypasses the script set.
+BOOST_AUTO_TEST_CASE(ismine_script_set)
+{
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+
+    CKey key;
+    key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+    const CScript p2pkh = GetScriptForDestination(pubkey.GetID());
+    const CScript p2wpkh = GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID()));
+    const CScript p2sh_p2wpkh = GetScriptForDestination(CScriptID(p2wpkh));
+    BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(1, p2pkh)), ISMINE_NO);
+
+    BOOST_CHECK(wallet.AddKeyPubKey(key, pubkey));
+    BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(1, p2pkh)), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(1, GetScriptForRawPubKey(pubkey))), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(1, p2wpkh)), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(1, p2sh_p2wpkh)), ISMINE_SPENDABLE);
+
+    CKey other;
+    other.MakeNewKey(true);
+    const CScript multisig = GetScriptForMultisig(1, {pubkey, other.GetPubKey()});
+    BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(1, multisig)), ISMINE_NO);
+    BOOST_CHECK(wallet.AddKeyPubKey(other, other.GetPubKey()));
+    BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(1, multisig)), ISMINE_SPENDABLE);
+
+    const CScript p2sh_multisig = GetScriptForDestination(CScriptID(multisig));
+    BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(1, p2sh_multisig)), ISMINE_NO);
+    BOOST_CHECK(wallet.AddCScript(multisig));
+    BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(1, p2sh_multisig)), ISMINE_SPENDABLE);
+
+    const CScript watched = CScript() << OP_1 << OP_ADD << OP_2 << OP_EQUAL;
+    BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(1, watched)), ISMINE_NO);
+    BOOST_CHECK(wallet.AddWatchOnly(watched, 0));
+    BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(1, watched)), ISMINE_WATCH_UNSOLVABLE);
+
+    // Spending an owned output makes a transaction IsFromMe
+    CMutableTransaction funding;
+    funding.vout.emplace_back(10 * COIN, p2pkh);
+    funding.vout.emplace_back(10 * COIN, CScript() << OP_RETURN);
+    CWalletTx wtx(&wallet, MakeTransactionRef(funding));
+    BOOST_CHECK(wallet.AddToWallet(wtx));
+
+    CMutableTransaction spend;
+    spend.vin.emplace_back(COutPoint(funding.GetHash(), 1));
+    BOOST_CHECK(!wallet.IsFromMe(spend));
+    spend.vin.emplace_back(COutPoint(funding.GetHash(), 0));
+    BOOST_CHECK(wallet.IsFromMe(spend));
+    BOOST_CHECK_EQUAL(wallet.GetDebit(spend, ISMINE_ALL), 10 * COIN);
+}
+
+// Deriving a batch of HD keys in parallel gives the same keys, key paths and
+// chain counter as deriving them one by one, including skipped known keys.
+BOOST_AUTO_TEST_CASE(generate_new_keys_batch)
+{
+    CKey seed;
+    seed.MakeNewKey(true);
+
+    // The key at m/0'/0'/3' is already known to both wallets
+    const uint32_t nHardened = 0x80000000;
+    CExtKey masterKey, accountKey, chainKey, knownKey;
+    masterKey.SetMaster(seed.begin(), seed.size());
+    masterKey.Derive(accountKey, nHardened);
+    accountKey.Derive(chainKey, nHardened);
+    chainKey.Derive(knownKey, 3 | nHardened);
+
+    CWallet sequential, batched;
+    for (CWallet* wallet : {&sequential, &batched}) {
+        LOCK(wallet->cs_wallet);
+        BOOST_CHECK(wallet->AddKeyPubKey(seed, seed.GetPubKey()));
+        BOOST_CHECK(wallet->SetHDMasterKey(seed.GetPubKey()));
+        BOOST_CHECK(wallet->AddKeyPubKey(knownKey.key, knownKey.key.GetPubKey()));
+    }
+
+    const unsigned int nKeys = 16 * MIN_ITEMS_PER_WORKER;
+    std::vector<CPubKey> expected;
+    {
+        LOCK(sequential.cs_wallet);
+        CWalletDB walletdb(sequential.GetDBHandle());
+        for (unsigned int i = 0; i < nKeys; i++)
+            expected.push_back(sequential.GenerateNewKey(walletdb));
+    }
+    std::vector<CPubKey> pubkeys;
+    {
+        LOCK(batched.cs_wallet);
+        CWalletDB walletdb(batched.GetDBHandle());
+        pubkeys = batched.GenerateNewKeys(walletdb, nKeys);
+    }
+
+    BOOST_CHECK(pubkeys == expected);
+    BOOST_CHECK_EQUAL(batched.GetHDChain().nExternalChainCounter, nKeys + 1);
+    BOOST_CHECK_EQUAL(batched.GetHDChain().nExternalChainCounter, sequential.GetHDChain().nExternalChainCounter);
+    for (const CPubKey& pubkey : pubkeys) {
+        BOOST_CHECK(batched.HaveKey(pubkey.GetID()));
+        BOOST_CHECK_EQUAL(batched.mapKeyMetadata[pubkey.GetID()].hdKeypath, sequential.mapKeyMetadata[pubkey.GetID()].hdKeypath);
+    }
+    BOOST_CHECK(std::find(pubkeys.begin(), pubkeys.end(), knownKey.key.GetPubKey()) == pubkeys.end());
+}
+
 static int64_t AddTx(CWallet& wallet, uint32_t lockTime, int64_t mockTime, int64_t blockTime)
 {
     CMutableTransaction tx;
@@ -702,4 +924,68 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2);
 }
 
+// Balance totals are kept incrementally, so check they follow maturity as the
+// tip moves and spend state as transactions are created and abandoned.
+BOOST_FIXTURE_TEST_CASE(BalanceTotals, ListCoinsTestingSetup)
+{
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), 50 * COIN);
+    BOOST_CHECK_EQUAL(wallet->GetImmatureBalance(), 100 * 50 * COIN);
+
+    // A block paying someone else matures one more of our coinbases.
+    CreateAndProcessBlock({}, GetScriptForRawPubKey(CPubKey()));
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), 100 * COIN);
+    BOOST_CHECK_EQUAL(wallet->GetImmatureBalance(), 99 * 50 * COIN);
+    BOOST_CHECK_EQUAL(wallet->GetUnconfirmedBalance(), 0);
+
+    CWalletTx wtx;
+    CReserveKey reservekey(wallet.get());
+    CAmount fee;
+    int changePos = -1;
+    std::string error;
+    CCoinControl dummy;
+    BOOST_CHECK(wallet->CreateTransaction({CRecipient{GetScriptForRawPubKey({}), 60 * COIN, false}}, wtx, reservekey, fee, changePos, error, dummy));
+    CValidationState state;
+    BOOST_CHECK(wallet->CommitTransaction(wtx, reservekey, nullptr, state));
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), 0);
+
+    BOOST_CHECK(wallet->AbandonTransaction(wtx.GetHash()));
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), 100 * COIN);
+
+    // A full recount agrees with the incremental totals.
+    wallet->MarkDirty();
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), 100 * COIN);
+    BOOST_CHECK_EQUAL(wallet->GetImmatureBalance(), 99 * 50 * COIN);
+}
+
+// Spending and abandoning a transaction must keep the unspent output index
+// used by AvailableCoins in sync with IsSpent.
+BOOST_FIXTURE_TEST_CASE(AvailableCoinsAbandon, ListCoinsTestingSetup)
+{
+    BOOST_CHECK_EQUAL(50 * COIN, wallet->GetAvailableBalance());
+
+    CWalletTx wtx;
+    CReserveKey reservekey(wallet.get());
+    CAmount fee;
+    int changePos = -1;
+    std::string error;
+    CCoinControl dummy;
+    BOOST_CHECK(wallet->CreateTransaction({CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false}}, wtx, reservekey, fee, changePos, error, dummy));
+    CValidationState state;
+    BOOST_CHECK(wallet->CommitTransaction(wtx, reservekey, nullptr, state));
+    // The wallet doesn't broadcast here, so the change isn't in the mempool
+    // and the spent coinbase output no longer counts.
+    BOOST_CHECK_EQUAL(0, wallet->GetAvailableBalance());
+
+    // Abandoning the spend makes the coinbase output available again.
+    BOOST_CHECK(wallet->AbandonTransaction(wtx.GetHash()));
+    BOOST_CHECK_EQUAL(50 * COIN, wallet->GetAvailableBalance());
+    {
+        LOCK2(cs_main, wallet->cs_wallet);
+        std::vector<COutput> available;
+        wallet->AvailableCoins(available);
+        BOOST_CHECK_EQUAL(available.size(), 1);
+        BOOST_CHECK(available[0].tx->IsCoinBase());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,8 @@
 #include <wallet/wallet.h>
 
 #include <base58.h>
+#include <blockfilemap.h>
+#include <blockfilterindex.h>
 #include <checkpoints.h>
 #include <chain.h>
 #include <wallet/coincontrol.h>
@@ -31,8 +33,10 @@
 #include <util.h>
 #include <utilmoneystr.h>
 #include <wallet/fees.h>
+#include <workerpool.h>
 
 #include <assert.h>
+#include <deque>
 #include <future>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -183,14 +187,47 @@ CPubKey CWallet::GenerateNewKey(CWalletDB &walletdb, bool internal)
     return pubkey;
 }
 
-void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal)
+std::vector<CPubKey> CWallet::GenerateNewKeys(CWalletDB &walletdb, unsigned int nKeys, bool internal)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+    std::vector<CPubKey> pubkeys;
+    pubkeys.reserve(nKeys);
+
+    if (!IsHDEnabled()) {
+        for (unsigned int i = 0; i < nKeys; i++)
+            pubkeys.push_back(GenerateNewKey(walletdb, internal));
+        return pubkeys;
+    }
+
+    std::vector<std::pair<CKey, CPubKey>> keys;
+    std::vector<CKeyMetadata> metadata;
+    DeriveNewChildKeys(walletdb, nKeys, CanSupportFeature(FEATURE_HD_SPLIT) ? internal : false, keys, metadata);
+
+    // HD keys are always compressed
+    if (CanSupportFeature(FEATURE_COMPRPUBKEY)) {
+        SetMinVersion(FEATURE_COMPRPUBKEY);
+    }
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        const CPubKey& pubkey = keys[i].second;
+        mapKeyMetadata[pubkey.GetID()] = metadata[i];
+        UpdateTimeFirstKey(metadata[i].nCreateTime);
+
+        if (!AddKeyPubKeyWithDB(walletdb, keys[i].first, pubkey)) {
+            throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+        }
+        pubkeys.push_back(pubkey);
+    }
+    return pubkeys;
+}
+
+CExtKey CWallet::GetHDChainKey(bool internal) const
 {
     // for now we use a fixed keypath scheme of m/0'/0'/k
     CKey key;                      //master key seed (256bit)
     CExtKey masterKey;             //hd master key
     CExtKey accountKey;            //key at m/0'
     CExtKey chainChildKey;         //key at m/0'/0' (external) or m/0'/1' (internal)
-    CExtKey childKey;              //key at m/0'/0'/<n>'
 
     // try to get the master key
     if (!GetKey(hdChain.masterKeyID, key))
@@ -205,6 +242,56 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKe
     // derive m/0'/0' (external chain) OR m/0'/1' (internal chain)
     assert(internal ? CanSupportFeature(FEATURE_HD_SPLIT) : true);
     accountKey.Derive(chainChildKey, BIP32_HARDENED_KEY_LIMIT+(internal ? 1 : 0));
+    return chainChildKey;
+}
+
+void CWallet::DeriveNewChildKeys(CWalletDB &walletdb, unsigned int nKeys, bool internal, std::vector<std::pair<CKey, CPubKey>>& keysOut, std::vector<CKeyMetadata>& metadataOut)
+{
+    const CExtKey chainChildKey = GetHDChainKey(internal);
+    uint32_t& nCounter = internal ? hdChain.nInternalChainCounter : hdChain.nExternalChainCounter;
+    const int64_t nCreationTime = GetTime();
+
+    keysOut.clear();
+    keysOut.reserve(nKeys);
+    metadataOut.clear();
+    metadataOut.reserve(nKeys);
+    while (keysOut.size() < nKeys) {
+        const uint32_t nStart = nCounter;
+        const unsigned int nCount = nKeys - keysOut.size();
+        std::vector<std::pair<CKey, CPubKey>> children(nCount);
+
+        // Derivation and public key computation are pure CPU work, child i
+        // depends only on the chain key.
+        GetWorkerPool().ForEach(nCount, MIN_ITEMS_PER_WORKER, [&](size_t i) {
+            CExtKey childKey;
+            chainChildKey.Derive(childKey, (nStart + i) | BIP32_HARDENED_KEY_LIMIT);
+            CPubKey pubkey = childKey.key.GetPubKey();
+            assert(childKey.key.VerifyPubKey(pubkey));
+            children[i] = std::make_pair(childKey.key, pubkey);
+        });
+
+        // skip keys already known to the wallet, as DeriveNewChildKey does
+        for (unsigned int i = 0; i < nCount; i++) {
+            nCounter++;
+            if (HaveKey(children[i].second.GetID()))
+                continue;
+            CKeyMetadata metadata(nCreationTime);
+            metadata.hdKeypath = (internal ? "m/0'/1'/" : "m/0'/0'/") + std::to_string(nStart + i) + "'";
+            metadata.hdMasterKeyID = hdChain.masterKeyID;
+            keysOut.push_back(children[i]);
+            metadataOut.push_back(metadata);
+        }
+    }
+
+    // update the chain model in the database
+    if (!walletdb.WriteHDChain(hdChain))
+        throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
+}
+
+void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal)
+{
+    const CExtKey chainChildKey = GetHDChainKey(internal);
+    CExtKey childKey;              //key at m/0'/0'/<n>'
 
     // derive child key at next index, skip keys already known to the wallet
     do {
@@ -229,10 +316,51 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKe
         throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
 }
 
+// The scriptPubKeys paying to a key, see GetScriptPubKeys()
+static std::vector<CScript> GetScriptPubKeysForKey(const CPubKey& pubkey)
+{
+    const CKeyID keyid = pubkey.GetID();
+    std::vector<CScript> scripts{GetScriptForDestination(keyid), GetScriptForRawPubKey(pubkey)};
+    if (pubkey.IsCompressed()) {
+        CScript witness = GetScriptForDestination(WitnessV0KeyHash(keyid));
+        scripts.push_back(GetScriptForDestination(CScriptID(witness)));
+        scripts.push_back(witness);
+    }
+    return scripts;
+}
+
+// The scriptPubKeys paying to a known script, see GetScriptPubKeys()
+static std::vector<CScript> GetScriptPubKeysForScript(const CScript& script)
+{
+    WitnessV0ScriptHash witnessid;
+    CSHA256().Write(script.data(), script.size()).Finalize(witnessid.begin());
+    return {GetScriptForDestination(CScriptID(script)), GetScriptForDestination(witnessid), script};
+}
+
+uint64_t CWallet::GetScriptHash(const CScript& script) const
+{
+    return CSipHasher(nScriptHashK0, nScriptHashK1).Write(script.data(), script.size()).Finalize();
+}
+
+void CWallet::AddScriptHashes(const std::vector<CScript>& scripts)
+{
+    LOCK(cs_KeyStore);
+    filterElements.reset();
+    if (!fScriptHashesBuilt)
+        return; // Everything is hashed on first use
+    for (const CScript& script : scripts)
+        setScriptHashes.insert(GetScriptHash(script));
+}
+
 bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey& secret, const CPubKey &pubkey)
 {
     AssertLockHeld(cs_wallet); // mapKeyMetadata
 
+    // Outputs already in the wallet may pay to the new key, whether it was
+    // imported or derived for the keypool.
+    fUnspentOutputsDirty = true;
+    AddScriptHashes(GetScriptPubKeysForKey(pubkey));
+
     // CCryptoKeyStore has no concept of wallet databases, but calls AddCryptedKey
     // which is overridden below.  To avoid flushes, the database handle is
     // tunneled through to it.
@@ -271,6 +399,12 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey)
     return CWallet::AddKeyPubKeyWithDB(walletdb, secret, pubkey);
 }
 
+bool CWallet::LoadKey(const CKey& key, const CPubKey &pubkey)
+{
+    AddScriptHashes(GetScriptPubKeysForKey(pubkey));
+    return CCryptoKeyStore::AddKeyPubKey(key, pubkey);
+}
+
 bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
                             const std::vector<unsigned char> &vchCryptedSecret)
 {
@@ -307,6 +441,7 @@ bool CWallet::LoadScriptMetadata(const CScriptID& script_id, const CKeyMetadata
 
 bool CWallet::LoadCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret)
 {
+    AddScriptHashes(GetScriptPubKeysForKey(vchPubKey));
     return CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret);
 }
 
@@ -328,6 +463,11 @@ void CWallet::UpdateTimeFirstKey(int64_t nCreateTime)
 
 bool CWallet::AddCScript(const CScript& redeemScript)
 {
+    // Scripts implicitly known for our keys (see LearnRelatedScripts) can't
+    // change which outputs are ours.
+    if (!HaveCScript(CScriptID(redeemScript)))
+        fUnspentOutputsDirty = true;
+    AddScriptHashes(GetScriptPubKeysForScript(redeemScript));
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
     return CWalletDB(*dbw).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -346,13 +486,16 @@ bool CWallet::LoadCScript(const CScript& redeemScript)
         return true;
     }
 
+    AddScriptHashes(GetScriptPubKeysForScript(redeemScript));
     return CCryptoKeyStore::AddCScript(redeemScript);
 }
 
 bool CWallet::AddWatchOnly(const CScript& dest)
 {
+    AddScriptHashes({dest});
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    fUnspentOutputsDirty = true;
     const CKeyMetadata& meta = m_script_metadata[CScriptID(dest)];
     UpdateTimeFirstKey(meta.nCreateTime);
     NotifyWatchonlyChanged(true);
@@ -370,6 +513,7 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
+    fUnspentOutputsDirty = true;
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
     if (!CWalletDB(*dbw).EraseWatchOnly(dest))
@@ -380,6 +524,7 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
 
 bool CWallet::LoadWatchOnly(const CScript &dest)
 {
+    AddScriptHashes({dest});
     return CCryptoKeyStore::AddWatchOnly(dest);
 }
 
@@ -611,6 +756,59 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+void CWallet::UpdateUnspentOutput(const COutPoint& outpoint) const
+{
+    AssertLockHeld(cs_wallet);
+    if (fUnspentOutputsDirty)
+        return; // Rebuilt from scratch on next use
+
+    auto it = mapWallet.find(outpoint.hash);
+    if (it == mapWallet.end() || outpoint.n >= it->second.tx->vout.size()) {
+        setUnspentOutputs.erase(outpoint);
+        return;
+    }
+    const CTxOut& txout = it->second.tx->vout[outpoint.n];
+    const bool fMine = IsMine(txout) != ISMINE_NO;
+    if (fMine && txout.nValue > 0)
+        setOwnedOutputs.insert(outpoint);
+    if (fMine && !IsSpent(outpoint.hash, outpoint.n)) {
+        setUnspentOutputs.insert(outpoint);
+    } else {
+        setUnspentOutputs.erase(outpoint);
+    }
+}
+
+void CWallet::UpdateUnspentOutputs(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++)
+        UpdateUnspentOutput(COutPoint(hash, i));
+    if (!wtx.IsCoinBase()) {
+        for (const CTxIn& txin : wtx.tx->vin)
+            UpdateUnspentOutput(txin.prevout);
+    }
+}
+
+void CWallet::RebuildUnspentOutputs() const
+{
+    AssertLockHeld(cs_wallet);
+    setUnspentOutputs.clear();
+    setOwnedOutputs.clear();
+    for (const auto& entry : mapWallet) {
+        const CWalletTx& wtx = entry.second;
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+            if (IsMine(wtx.tx->vout[i]) == ISMINE_NO)
+                continue;
+            if (wtx.tx->vout[i].nValue > 0)
+                setOwnedOutputs.emplace(entry.first, i);
+            if (!IsSpent(entry.first, i))
+                setUnspentOutputs.emplace_hint(setUnspentOutputs.end(), entry.first, i);
+        }
+    }
+    fUnspentOutputsDirty = false;
+}
+
 bool CWallet::EncryptWallet(const SecureString& strWalletPassphrase)
 {
     if (IsCrypted())
@@ -869,6 +1067,7 @@ void CWallet::MarkDirty()
 {
     {
         LOCK(cs_wallet);
+        fBalanceRecount = true;
         for (std::pair<const uint256, CWalletTx>& item : mapWallet)
             item.second.MarkDirty();
     }
@@ -923,6 +1122,13 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, nullptr)));
         wtx.nTimeSmart = ComputeTimeSmart(wtx);
         AddToSpends(hash);
+
+        // Children that arrived first may become trusted now (see IsTrusted)
+        TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(hash, 0));
+        while (iter != mapTxSpends.end() && iter->first.hash == hash) {
+            MarkBalanceDirty(iter->second);
+            iter++;
+        }
     }
 
     bool fUpdated = false;
@@ -971,6 +1177,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
 
     // Break debit/credit balance caches:
     wtx.MarkDirty();
+    MarkBalanceDirty(hash);
+    UpdateUnspentOutputs(wtx);
 
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -994,6 +1202,8 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
     wtx.BindWallet(this);
     wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, nullptr)));
     AddToSpends(hash);
+    fUnspentOutputsDirty = true;
+    fBalanceRecount = true;
     for (const CTxIn& txin : wtx.tx->vin) {
         auto it = mapWallet.find(txin.prevout.hash);
         if (it != mapWallet.end()) {
@@ -1122,6 +1332,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.setAbandoned();
             wtx.MarkDirty();
+            MarkBalanceDirty(now);
             walletdb.WriteTx(wtx);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
@@ -1139,6 +1350,8 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
                 auto it = mapWallet.find(txin.prevout.hash);
                 if (it != mapWallet.end()) {
                     it->second.MarkDirty();
+                    MarkBalanceDirty(it->first);
+                    UpdateUnspentOutput(txin.prevout);
                 }
             }
         }
@@ -1187,6 +1400,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
+            MarkBalanceDirty(now);
             walletdb.WriteTx(wtx);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
@@ -1202,6 +1416,8 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
                 auto it = mapWallet.find(txin.prevout.hash);
                 if (it != mapWallet.end()) {
                     it->second.MarkDirty();
+                    MarkBalanceDirty(it->first);
+                    UpdateUnspentOutput(txin.prevout);
                 }
             }
         }
@@ -1221,6 +1437,8 @@ void CWallet::SyncTransaction(const CTransactionRef& ptx, const CBlockIndex *pin
         auto it = mapWallet.find(txin.prevout.hash);
         if (it != mapWallet.end()) {
             it->second.MarkDirty();
+            MarkBalanceDirty(it->first);
+            UpdateUnspentOutput(txin.prevout);
         }
     }
 }
@@ -1232,6 +1450,7 @@ void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx) {
     auto it = mapWallet.find(ptx->GetHash());
     if (it != mapWallet.end()) {
         it->second.fInMempool = true;
+        MarkBalanceDirty(it->first);
     }
 }
 
@@ -1240,6 +1459,7 @@ void CWallet::TransactionRemovedFromMempool(const CTransactionRef &ptx) {
     auto it = mapWallet.find(ptx->GetHash());
     if (it != mapWallet.end()) {
         it->second.fInMempool = false;
+        MarkBalanceDirty(it->first);
     }
 }
 
@@ -1293,10 +1513,10 @@ void CWallet::BlockUntilSyncedToCurrentChain() {
         }
     }
 
-    // ...otherwise put a callback in the validation interface queue and wait
-    // for the queue to drain enough to execute it (indicating we are caught up
-    // at least with the time we entered this function).
-    SyncWithValidationInterfaceQueue();
+    // ...otherwise put a callback in this wallet's validation interface queue
+    // and wait for the queue to drain enough to execute it (indicating we are
+    // caught up at least with the time we entered this function).
+    SyncWithValidationInterfaceQueue(this);
 }
 
 
@@ -1335,7 +1555,20 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
 
 isminetype CWallet::IsMine(const CTxOut& txout) const
 {
-    return ::IsMine(*this, txout.scriptPubKey);
+    const CScript& script = txout.scriptPubKey;
+    // Bare multisig is ours when we hold all of its keys, which the set
+    // does not track.
+    if (script.empty() || script.back() != OP_CHECKMULTISIG) {
+        LOCK(cs_KeyStore);
+        if (!fScriptHashesBuilt) {
+            for (const CScript& owned : GetScriptPubKeys())
+                setScriptHashes.insert(GetScriptHash(owned));
+            fScriptHashesBuilt = true;
+        }
+        if (!setScriptHashes.count(GetScriptHash(script)))
+            return ISMINE_NO;
+    }
+    return ::IsMine(*this, script);
 }
 
 CAmount CWallet::GetCredit(const CTxOut& txout, const isminefilter& filter) const
@@ -1354,7 +1587,7 @@ bool CWallet::IsChange(const CTxOut& txout) const
     // a better way of identifying which outputs are 'the send' and which are
     // 'the change' will need to be implemented (maybe extend CWalletTx to remember
     // which output, if any, was change).
-    if (::IsMine(*this, txout.scriptPubKey))
+    if (IsMine(txout))
     {
         CTxDestination address;
         if (!ExtractDestination(txout.scriptPubKey, address))
@@ -1382,9 +1615,57 @@ bool CWallet::IsMine(const CTransaction& tx) const
     return false;
 }
 
+std::set<CScript> CWallet::GetScriptPubKeys() const
+{
+    std::set<CScript> scripts;
+
+    for (const CKeyID& keyid : GetKeys()) {
+        CPubKey pubkey;
+        if (!GetPubKey(keyid, pubkey))
+            continue;
+        for (CScript& script : GetScriptPubKeysForKey(pubkey))
+            scripts.insert(std::move(script));
+    }
+
+    for (const CScriptID& scriptid : GetCScripts()) {
+        CScript script;
+        if (!GetCScript(scriptid, script))
+            continue;
+        for (CScript& wrapped : GetScriptPubKeysForScript(script))
+            scripts.insert(std::move(wrapped));
+    }
+
+    {
+        LOCK(cs_KeyStore);
+        scripts.insert(setWatchOnly.begin(), setWatchOnly.end());
+    }
+
+    return scripts;
+}
+
+std::shared_ptr<const GCSFilter::ElementSet> CWallet::GetFilterElements() const
+{
+    LOCK(cs_KeyStore);
+    if (!filterElements) {
+        GCSFilter::ElementSet elements;
+        for (const CScript& script : GetScriptPubKeys())
+            elements.emplace(script.begin(), script.end());
+        filterElements = std::make_shared<const GCSFilter::ElementSet>(std::move(elements));
+    }
+    return filterElements;
+}
+
 bool CWallet::IsFromMe(const CTransaction& tx) const
 {
-    return (GetDebit(tx, ISMINE_ALL) > 0);
+    // Same as GetDebit(tx, ISMINE_ALL) > 0
+    LOCK(cs_wallet);
+    if (fUnspentOutputsDirty)
+        RebuildUnspentOutputs();
+    for (const CTxIn& txin : tx.vin) {
+        if (setOwnedOutputs.count(txin.prevout))
+            return true;
+    }
+    return false;
 }
 
 CAmount CWallet::GetDebit(const CTransaction& tx, const isminefilter& filter) const
@@ -1649,6 +1930,27 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
  * the main chain after to the addition of any new keys you want to detect
  * transactions for.
  */
+namespace {
+
+/** A block read and pre-matched ahead of a rescan */
+struct RescanBlock
+{
+    CBlockIndex* pindex = nullptr;
+    bool fRead = false;
+    CBlock block;
+    //! Per transaction, whether any output was IsMine when matched
+    std::vector<bool> vOutputMatch;
+    //! Wallet key epoch the outputs were matched against
+    int nEpoch = 0;
+    //! Not read because its block filter matched none of the wallet's scripts
+    bool fFilteredOut = false;
+    BlockFilter filter;
+    //! Wallet scripts the filter was tested against
+    std::shared_ptr<const GCSFilter::ElementSet> filterElements;
+};
+
+} // namespace
+
 CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, const WalletRescanReserver &reserver, bool fUpdate)
 {
     int64_t nNow = GetTime();
@@ -1662,6 +1964,8 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
     CBlockIndex* pindex = pindexStart;
     CBlockIndex* ret = nullptr;
     {
+        // Blocks are read in chain order, let the kernel read ahead
+        CBlockFileSequentialScan sequentialScan(g_blockfile_maps);
         fAbortRescan = false;
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         CBlockIndex* tip = nullptr;
@@ -1673,6 +1977,62 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindex);
             dProgressTip = GuessVerificationProgress(chainParams.TxData(), tip);
         }
+
+        // Blocks are read and their outputs matched against the keystore by
+        // a few reader threads, ahead of this one. Only transactions that can
+        // involve the wallet are then applied here, in chain order. Adding
+        // a transaction may top up the keypool, so it bumps the epoch and
+        // outputs matched before that are matched again when applied.
+        // With -blockfilterindex, blocks whose filter matches none of the
+        // wallet's scripts are not read at all.
+        std::atomic<int> nEpoch(0);
+        std::atomic<bool> fStopReads(false);
+        CWorkerPool readers(std::max(1, std::min(GetNumCores(), MAX_RESCAN_READERS)), "rescan");
+        std::deque<std::future<std::unique_ptr<RescanBlock>>> reads;
+        CBlockIndex* pindexNextRead = pindex;
+        std::shared_ptr<const GCSFilter::ElementSet> filterElements;
+
+        auto scheduleReads = [&]() {
+            if (g_blockfilterindex)
+                filterElements = GetFilterElements();
+            while (pindexNextRead && !fAbortRescan && (int)reads.size() < MAX_RESCAN_READ_AHEAD) {
+                CBlockIndex* pindexRead = pindexNextRead;
+                const int nReadEpoch = nEpoch.load();
+                std::shared_ptr<const GCSFilter::ElementSet> elements = filterElements;
+                reads.push_back(readers.Submit([this, pindexRead, nReadEpoch, elements, &chainParams, &fStopReads]() {
+                    std::unique_ptr<RescanBlock> read(new RescanBlock());
+                    read->pindex = pindexRead;
+                    read->nEpoch = nReadEpoch;
+                    if (fStopReads)
+                        return read;
+                    if (elements && g_blockfilterindex->LookupFilter(pindexRead, read->filter) &&
+                        !read->filter.GetFilter().MatchAny(*elements)) {
+                        read->fFilteredOut = true;
+                        read->filterElements = elements;
+                        read->fRead = true;
+                        return read;
+                    }
+                    read->fRead = ReadBlockFromDisk(read->block, pindexRead, chainParams.GetConsensus());
+                    read->vOutputMatch.resize(read->block.vtx.size());
+                    for (size_t i = 0; i < read->block.vtx.size(); i++) {
+                        for (const CTxOut& txout : read->block.vtx[i]->vout) {
+                            if (IsMine(txout) != ISMINE_NO) {
+                                read->vOutputMatch[i] = true;
+                                break;
+                            }
+                        }
+                    }
+                    return read;
+                }));
+                if (pindexRead == pindexStop) {
+                    pindexNextRead = nullptr;
+                } else {
+                    LOCK(cs_main);
+                    pindexNextRead = chainActive.Next(pindexRead);
+                }
+            }
+        };
+
         while (pindex && !fAbortRescan)
         {
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
@@ -1689,8 +2049,32 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
             }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            std::unique_ptr<RescanBlock> read;
+            while (!read) {
+                scheduleReads();
+                if (reads.empty())
+                    break; // Aborted
+                read = reads.front().get();
+                reads.pop_front();
+                if (read->pindex != pindex) {
+                    // The active chain changed under the read-ahead, restart it here
+                    reads.clear();
+                    pindexNextRead = pindex;
+                    read.reset();
+                }
+            }
+            if (!read)
+                break;
+            scheduleReads();
+
+            if (read->fFilteredOut && read->filterElements != filterElements &&
+                read->filter.GetFilter().MatchAny(*filterElements)) {
+                // Scripts were added since the filter was tested and now match
+                read->fFilteredOut = false;
+                read->fRead = ReadBlockFromDisk(read->block, pindex, chainParams.GetConsensus());
+            }
+
+            if (read->fRead) {
                 LOCK2(cs_main, cs_wallet);
                 if (pindex && !chainActive.Contains(pindex)) {
                     // Abort scan if current block is no longer active, to prevent
@@ -1698,8 +2082,21 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
                     ret = pindex;
                     break;
                 }
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+                const bool fMatchCurrent = read->nEpoch == nEpoch.load();
+                for (size_t posInBlock = 0; posInBlock < read->block.vtx.size(); ++posInBlock) {
+                    const CTransactionRef& ptx = read->block.vtx[posInBlock];
+                    bool fRelevant = fMatchCurrent ? read->vOutputMatch[posInBlock] : IsMine(*ptx);
+                    if (!fRelevant) {
+                        // Known, spending from the wallet, or conflicting with it
+                        fRelevant = mapWallet.count(ptx->GetHash()) > 0;
+                        for (size_t i = 0; i < ptx->vin.size() && !fRelevant; i++) {
+                            const COutPoint& prevout = ptx->vin[i].prevout;
+                            fRelevant = mapWallet.count(prevout.hash) > 0 || mapTxSpends.count(prevout) > 0;
+                        }
+                    }
+                    if (fRelevant && AddToWalletIfInvolvingMe(ptx, pindex, posInBlock, fUpdate)) {
+                        nEpoch++;
+                    }
                 }
             } else {
                 ret = pindex;
@@ -1717,6 +2114,9 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
                 }
             }
         }
+        // Skip the blocks still queued, the readers are joined on leaving this scope
+        fStopReads = true;
+        reads.clear();
         if (pindex && fAbortRescan) {
             LogPrintf("Rescan aborted at block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
         }
@@ -1789,6 +2189,19 @@ std::set<uint256> CWalletTx::GetConflicts() const
     return result;
 }
 
+void CWalletTx::MarkDirty()
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fImmatureCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+}
+
 CAmount CWalletTx::GetDebit(const isminefilter& filter) const
 {
     if (tx->vin.empty())
@@ -2057,17 +2470,82 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
+void CWallet::MarkBalanceDirty(const uint256& hash) const
+{
+    AssertLockHeld(cs_wallet);
+    if (!fBalanceRecount)
+        setBalanceDirty.insert(hash);
+}
+
+void CWallet::CountBalance(const CWalletTx& wtx) const
+{
+    const uint256& hash = wtx.GetHash();
+    auto it = mapBalanceCounted.find(hash);
+    if (it != mapBalanceCounted.end()) {
+        balanceTotals -= it->second;
+        mapBalanceCounted.erase(it);
+    }
+    setBalanceTipSensitive.erase(hash);
+
+    CWalletBalance balance;
+    const int nDepth = wtx.GetDepthInMainChain();
+    const bool fTrusted = wtx.IsTrusted();
+    if (fTrusted) {
+        balance.nTrusted = wtx.GetAvailableCredit();
+        balance.nWatchOnlyTrusted = wtx.GetAvailableWatchOnlyCredit();
+    } else if (nDepth == 0 && wtx.InMempool()) {
+        balance.nUntrustedPending = wtx.GetAvailableCredit();
+        balance.nWatchOnlyUntrustedPending = wtx.GetAvailableWatchOnlyCredit();
+    }
+    balance.nImmature = wtx.GetImmatureCredit();
+    balance.nWatchOnlyImmature = wtx.GetImmatureWatchOnlyCredit();
+
+    if (nDepth <= 0 || wtx.GetBlocksToMaturity() > 0 || !CheckFinalTx(*wtx.tx))
+        setBalanceTipSensitive.insert(hash);
+
+    if (balance.nTrusted || balance.nUntrustedPending || balance.nImmature ||
+        balance.nWatchOnlyTrusted || balance.nWatchOnlyUntrustedPending || balance.nWatchOnlyImmature) {
+        balanceTotals += balance;
+        mapBalanceCounted.emplace(hash, balance);
+    }
+}
+
+const CWalletBalance& CWallet::UpdateBalances() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (fBalanceRecount) {
+        balanceTotals = CWalletBalance();
+        mapBalanceCounted.clear();
+        setBalanceTipSensitive.clear();
+        setBalanceDirty.clear();
+        for (const auto& entry : mapWallet)
+            CountBalance(entry.second);
+        pindexBalanceTip = chainActive.Tip();
+        fBalanceRecount = false;
+        return balanceTotals;
+    }
+
+    if (pindexBalanceTip != chainActive.Tip()) {
+        setBalanceDirty.insert(setBalanceTipSensitive.begin(), setBalanceTipSensitive.end());
+        pindexBalanceTip = chainActive.Tip();
+    }
+    for (const uint256& hash : setBalanceDirty) {
+        auto it = mapWallet.find(hash);
+        if (it != mapWallet.end())
+            CountBalance(it->second);
+    }
+    setBalanceDirty.clear();
+    return balanceTotals;
+}
+
 CAmount CWallet::GetBalance() const
 {
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
-        }
+        nTotal = UpdateBalances().nTrusted;
         // Also count loaded coins
         for (const LoadedCoin& c : vLoadedCoinCache) {
             if (!IsSpent(c.out.hash, c.out.n)) {
@@ -2081,76 +2559,32 @@ CAmount CWallet::GetBalance() const
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return UpdateBalances().nUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return UpdateBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return UpdateBalances().nWatchOnlyTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return UpdateBalances().nWatchOnlyUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return UpdateBalances().nWatchOnlyImmature;
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -2224,10 +2658,23 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
     vCoins.clear();
     CAmount nTotal = 0;
 
-    for (const auto& entry : mapWallet)
+    if (fUnspentOutputsDirty)
+        RebuildUnspentOutputs();
+
+    // Candidates are ordered by txid, so the per-transaction checks below run
+    // once for each group of outputs from the same transaction.
+    auto itUnspent = setUnspentOutputs.begin();
+    while (itUnspent != setUnspentOutputs.end())
     {
-        const uint256& wtxid = entry.first;
-        const CWalletTx* pcoin = &entry.second;
+        const uint256 wtxid = itUnspent->hash;
+        const auto itGroup = itUnspent;
+        while (itUnspent != setUnspentOutputs.end() && itUnspent->hash == wtxid)
+            ++itUnspent;
+
+        auto mi = mapWallet.find(wtxid);
+        if (mi == mapWallet.end())
+            continue;
+        const CWalletTx* pcoin = &mi->second;
 
         if (!CheckFinalTx(*pcoin->tx))
             continue;
@@ -2287,14 +2734,15 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
         if (nDepth < nMinDepth || nDepth > nMaxDepth)
             continue;
 
-        for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
+        for (auto itOut = itGroup; itOut != itUnspent; ++itOut) {
+            const unsigned int i = itOut->n;
             if (pcoin->tx->vout[i].nValue < nMinimumAmount || pcoin->tx->vout[i].nValue > nMaximumAmount)
                 continue;
 
-            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(entry.first, i)))
+            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(wtxid, i)))
                 continue;
 
-            if (IsLockedCoin(entry.first, i))
+            if (IsLockedCoin(wtxid, i))
                 continue;
 
             if (IsSpent(wtxid, i))
@@ -2437,12 +2885,62 @@ static void ApproximateBestSubset(const std::vector<CInputCoin>& vValue, const C
     }
 }
 
+// Virtual size of an input spending txout, measured by dummy signing it
+static int CalculateMaximumSignedInputSize(const CTxOut& txout, const CWallet* pwallet)
+{
+    CMutableTransaction txn;
+    txn.vin.push_back(CTxIn(COutPoint()));
+    if (!pwallet->DummySignTx(txn, std::vector<CInputCoin>{CInputCoin(COutPoint(), txout)})) {
+        return -1;
+    }
+    const CTxIn& txin = txn.vin[0];
+    int64_t nWeight = ::GetSerializeSize(txin, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) * WITNESS_SCALE_FACTOR +
+                      ::GetSerializeSize(txin.scriptWitness.stack, SER_NETWORK, PROTOCOL_VERSION);
+    return GetVirtualTransactionSize(nWeight, 0);
+}
+
+bool CWallet::OutputEligibleForSpending(const COutput& output, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors) const
+{
+    if (!output.fSpendable)
+        return false;
+
+    if (output.nDepth < (output.tx->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
+        return false;
+
+    if (!mempool.TransactionWithinChainLimit(output.tx->GetHash(), nMaxAncestors))
+        return false;
+
+    return true;
+}
+
 bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, std::vector<COutput> vCoins,
-                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const
+                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams* coin_selection_params) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
 
+    if (coin_selection_params && coin_selection_params->use_bnb) {
+        const CFeeRate& effective_fee = coin_selection_params->effective_fee;
+        std::vector<CInputCoin> utxo_pool;
+        for (const COutput& output : vCoins) {
+            if (!OutputEligibleForSpending(output, nConfMine, nConfTheirs, nMaxAncestors))
+                continue;
+
+            CInputCoin coin(output.tx, output.i);
+            coin.effective_value = coin.txout.nValue - (output.nInputBytes < 0 ? 0 : effective_fee.GetFee(output.nInputBytes));
+            // Inputs costing more to spend than they are worth are never picked
+            if (coin.effective_value > 0)
+                utxo_pool.push_back(coin);
+        }
+
+        // Dropping the excess to fees is fine while it is below what a change
+        // output would cost to create now and to spend later.
+        const CAmount cost_of_change = GetDiscardRate(::feeEstimator).GetFee(coin_selection_params->change_spend_size) +
+                                       effective_fee.GetFee(coin_selection_params->change_output_size);
+        const CAmount not_input_fees = effective_fee.GetFee(coin_selection_params->tx_noinputs_size);
+        return SelectCoinsBnB(utxo_pool, nTargetValue, cost_of_change, setCoinsRet, nValueRet, not_input_fees);
+    }
+
     // List of values less than target
     boost::optional<CInputCoin> coinLowestLarger;
     std::vector<CInputCoin> vValue;
@@ -2452,20 +2950,10 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
 
     for (const COutput &output : vCoins)
     {
-        if (!output.fSpendable)
-            continue;
-
-        const CWalletTx *pcoin = output.tx;
-
-        if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
-            continue;
-
-        if (!mempool.TransactionWithinChainLimit(pcoin->GetHash(), nMaxAncestors))
+        if (!OutputEligibleForSpending(output, nConfMine, nConfTheirs, nMaxAncestors))
             continue;
 
-        int i = output.i;
-
-        CInputCoin coin = CInputCoin(pcoin, i);
+        CInputCoin coin = CInputCoin(output.tx, output.i);
 
         if (coin.txout.nValue == nTargetValue)
         {
@@ -2543,9 +3031,12 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
     return true;
 }
 
-bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl) const
+bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl,
+                          const CoinSelectionParams* coin_selection_params, bool* bnb_used) const
 {
     std::vector<COutput> vCoins(vAvailableCoins);
+    if (bnb_used)
+        *bnb_used = false;
     std::vector<LoadedCoin> vLoadedCoin;
     vLoadedCoin = GetMyLoadedCoins();
 
@@ -2600,17 +3091,25 @@ bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAm
             ++it;
     }
 
+    // Branch and bound only knows the fees of the inputs it picks itself
+    const CoinSelectionParams* params = nullptr;
+    if (coin_selection_params && coin_selection_params->use_bnb && setPresetCoins.empty()) {
+        params = coin_selection_params;
+        if (bnb_used)
+            *bnb_used = true;
+    }
+
     size_t nMaxChainLength = std::min(gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT), gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT));
     bool fRejectLongChains = gArgs.GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS);
 
     bool res = nTargetValue <= nValueFromPresetInputs ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet) ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet));
+        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet, params) ||
+        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet, params) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet, params)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet, params)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet, params)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet, params)) ||
+        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet, params));
 
     // because SelectCoinsMinConf clears the setCoinsRet, we now add the possible inputs to the coinset
     setCoinsRet.insert(setPresetCoins.begin(), setPresetCoins.end());
@@ -2626,22 +3125,35 @@ bool CWallet::SignTransaction(CMutableTransaction &tx)
     AssertLockHeld(cs_wallet); // mapWallet
 
     // sign the new tx
-    CTransaction txNewConst(tx);
-    int nIn = 0;
+    std::vector<CTxOut> vSpent;
+    vSpent.reserve(tx.vin.size());
     for (const auto& input : tx.vin) {
         std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(input.prevout.hash);
         if(mi == mapWallet.end() || input.prevout.n >= mi->second.tx->vout.size()) {
             return false;
         }
-        const CScript& scriptPubKey = mi->second.tx->vout[input.prevout.n].scriptPubKey;
-        const CAmount& amount = mi->second.tx->vout[input.prevout.n].nValue;
-        SignatureData sigdata;
-        if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, amount, SIGHASH_ALL), scriptPubKey, sigdata)) {
-            return false;
-        }
-        UpdateTransaction(tx, nIn, sigdata);
-        nIn++;
+        vSpent.push_back(mi->second.tx->vout[input.prevout.n]);
     }
+    return SignInputs(tx, vSpent);
+}
+
+bool CWallet::SignInputs(CMutableTransaction& tx, const std::vector<CTxOut>& vSpent) const
+{
+    assert(vSpent.size() <= tx.vin.size());
+    const CTransaction txConst(tx);
+    const PrecomputedTransactionData txdata(txConst);
+
+    std::vector<SignatureData> vSigData(vSpent.size());
+    std::atomic<bool> fSigned(true);
+    ForEachInputParallel(vSpent.size(), [&](unsigned int nIn) {
+        if (!ProduceSignature(TransactionSignatureCreator(this, &txConst, nIn, vSpent[nIn].nValue, SIGHASH_ALL, &txdata), vSpent[nIn].scriptPubKey, vSigData[nIn]))
+            fSigned = false;
+    });
+    if (!fSigned)
+        return false;
+
+    for (unsigned int nIn = 0; nIn < vSpent.size(); nIn++)
+        UpdateTransaction(tx, nIn, vSigData[nIn]);
     return true;
 }
 
@@ -2803,6 +3315,22 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
             std::vector<COutput> vAvailableCoins;
             AvailableCoins(vAvailableCoins, true, &coin_control);
 
+            // Branch and bound needs the size of each input. Dummy signing is
+            // costly, so it runs once per script here and not on every pass
+            // of the fee loop below.
+            if (nSubtractFeeFromAmount == 0) {
+                std::map<CScript, int> mapInputBytes;
+                for (COutput& output : vAvailableCoins) {
+                    if (!output.fSpendable)
+                        continue;
+                    const CTxOut& txout = output.tx->tx->vout[output.i];
+                    auto it = mapInputBytes.find(txout.scriptPubKey);
+                    if (it == mapInputBytes.end())
+                        it = mapInputBytes.emplace(txout.scriptPubKey, CalculateMaximumSignedInputSize(txout, this)).first;
+                    output.nInputBytes = it->second;
+                }
+            }
+
             // Create change script that will be used if we need change
             // TODO: pass in scriptChange instead of reservekey so
             // change transaction isn't always pay-to-bitcoin-address
@@ -2837,6 +3365,17 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
             CTxOut change_prototype_txout(0, scriptChange);
             size_t change_prototype_size = GetSerializeSize(change_prototype_txout, SER_DISK, 0);
 
+            // First try to pick inputs that need no change output, fees
+            // included, and fall back to the knapsack solver. A changeless
+            // selection usually settles the fee in a single pass.
+            CoinSelectionParams coin_selection_params;
+            coin_selection_params.use_bnb = nSubtractFeeFromAmount == 0;
+            coin_selection_params.change_output_size = change_prototype_size;
+            int change_spend_size = CalculateMaximumSignedInputSize(change_prototype_txout, this);
+            coin_selection_params.change_spend_size = change_spend_size < 0 ? DUMMY_P2PKH_INPUT_SIZE : change_spend_size;
+            coin_selection_params.effective_fee = CFeeRate(GetMinimumFee(1000, coin_control, ::mempool, ::feeEstimator, nullptr));
+            bool bnb_used = false;
+
             CFeeRate discard_rate = GetDiscardRate(::feeEstimator);
             nFeeRet = 0;
             bool pick_new_inputs = true;
@@ -2890,11 +3429,20 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
                 if (pick_new_inputs) {
                     nValueIn = 0;
                     setCoins.clear();
-                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, &coin_control))
+                    coin_selection_params.tx_noinputs_size = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, &coin_control, &coin_selection_params, &bnb_used))
                     {
+                        if (bnb_used) {
+                            // No changeless solution, retry with the knapsack solver
+                            coin_selection_params.use_bnb = false;
+                            continue;
+                        }
                         strFailReason = _("Insufficient funds");
                         return false;
                     }
+                } else {
+                    // Reusing the inputs to add a change output
+                    bnb_used = false;
                 }
 
                 const CAmount nChange = nValueIn - nValueToSelect;
@@ -2905,8 +3453,9 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
                     CTxOut newTxOut(nChange, scriptChange);
 
                     // Never create dust outputs; if we would, just
-                    // add the dust to the fee.
-                    if (IsDust(newTxOut, discard_rate))
+                    // add the dust to the fee. A branch and bound selection
+                    // leaves less excess than a change output would cost.
+                    if (IsDust(newTxOut, discard_rate) || bnb_used)
                     {
                         nChangePosInOut = -1;
                         nFeeRet += nChange;
@@ -3030,6 +3579,7 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
 
                 // Include more fee and try again.
                 nFeeRet = nFeeNeeded;
+                coin_selection_params.use_bnb = false;
                 continue;
             }
         }
@@ -3038,22 +3588,14 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
 
         if (sign)
         {
-            CTransaction txNewConst(txNew);
-            int nIn = 0;
+            std::vector<CTxOut> vSpent;
             for (const auto& coin : setCoins)
-            {
-                const CScript& scriptPubKey = coin.txout.scriptPubKey;
-                SignatureData sigdata;
+                vSpent.push_back(coin.txout);
 
-                if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, coin.txout.nValue, SIGHASH_ALL), scriptPubKey, sigdata))
-                {
-                    strFailReason = _("Signing transaction failed");
-                    return false;
-                } else {
-                    UpdateTransaction(txNew, nIn, sigdata);
-                }
-
-                nIn++;
+            if (!SignInputs(txNew, vSpent))
+            {
+                strFailReason = _("Signing transaction failed");
+                return false;
             }
         }
 
@@ -3253,21 +3795,14 @@ bool CWallet::CreateSidechainDeposit(CTransactionRef& tx, std::string& strFail,
     }
 
     // Sign the non sidechain inputs
-    const CTransaction txToSign = mtx;
-    int nIn = 0;
-    for (const auto& coin : setCoins) {
-        const CScript& scriptPubKey = coin.txout.scriptPubKey;
-        SignatureData sigdata;
+    std::vector<CTxOut> vSpent;
+    for (const auto& coin : setCoins)
+        vSpent.push_back(coin.txout);
 
-        if (!ProduceSignature(TransactionSignatureCreator(this, &txToSign, nIn, coin.txout.nValue, SIGHASH_ALL), scriptPubKey, sigdata))
-        {
-            strFail = "Signing non-sidechain inputs failed!\n";
-            return false;
-        } else {
-            UpdateTransaction(mtx, nIn, sigdata);
-        }
-
-        nIn++;
+    if (!SignInputs(mtx, vSpent))
+    {
+        strFail = "Signing non-sidechain inputs failed!\n";
+        return false;
     }
 
     // Broadcast transaction
@@ -3316,6 +3851,7 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, CCon
 
                 CWalletTx &coin = mapWallet[txin.prevout.hash];
                 coin.BindWallet(this);
+                MarkBalanceDirty(coin.GetHash());
                 NotifyTransactionChanged(this, coin.GetHash(), CT_UPDATED);
             }
         }
@@ -3416,6 +3952,8 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
     DBErrors nZapSelectTxRet = CWalletDB(*dbw,"cr+").ZapSelectTx(vHashIn, vHashOut);
     for (uint256 hash : vHashOut)
         mapWallet.erase(hash);
+    fUnspentOutputsDirty = true;
+    fBalanceRecount = true;
 
     if (nZapSelectTxRet == DB_NEED_REWRITE)
     {
@@ -3596,28 +4134,50 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
             // don't create extra internal keys
             missingInternal = 0;
         }
-        bool internal = false;
+        // Keys are generated in batches, each written in a single database
+        // transaction instead of one small transaction per record. An
+        // exception leaves the open transaction to be aborted by CDB.
         CWalletDB walletdb(*dbw);
-        for (int64_t i = missingInternal + missingExternal; i--;)
-        {
-            if (i < missingInternal) {
-                internal = true;
-            }
-
-            assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
-            int64_t index = ++m_max_keypool_index;
+        for (bool internal : {false, true}) {
+            std::set<int64_t>& setKeyPool = internal ? setInternalKeyPool : setExternalKeyPool;
+            for (int64_t nMissing = internal ? missingInternal : missingExternal; nMissing > 0;) {
+                const int64_t nBatch = std::min(nMissing, KEYPOOL_TOPUP_BATCH_SIZE);
+                // Dummy databases have no transactions, the writes then go
+                // through one by one.
+                const bool fTxn = walletdb.TxnBegin();
+
+                // The pool entries are only handed out once the batch is on
+                // disk. If it is not, the chain counters go back too. The new
+                // keys stay in the keystore, unused, until the next restart.
+                const CHDChain hdChainOld = hdChain;
+                const int64_t nMaxIndexOld = m_max_keypool_index;
+                std::vector<std::pair<int64_t, CKeyID>> vAdded;
+                try {
+                    for (const CPubKey& pubkey : GenerateNewKeys(walletdb, nBatch, internal)) {
+                        assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
+                        int64_t index = ++m_max_keypool_index;
+
+                        if (!walletdb.WritePool(index, CKeyPool(pubkey, internal))) {
+                            throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
+                        }
+                        vAdded.emplace_back(index, pubkey.GetID());
+                    }
 
-            CPubKey pubkey(GenerateNewKey(walletdb, internal));
-            if (!walletdb.WritePool(index, CKeyPool(pubkey, internal))) {
-                throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
-            }
+                    if (fTxn && !walletdb.TxnCommit()) {
+                        throw std::runtime_error(std::string(__func__) + ": committing generated keys failed");
+                    }
+                } catch (...) {
+                    hdChain = hdChainOld;
+                    m_max_keypool_index = nMaxIndexOld;
+                    throw;
+                }
 
-            if (internal) {
-                setInternalKeyPool.insert(index);
-            } else {
-                setExternalKeyPool.insert(index);
+                for (const std::pair<int64_t, CKeyID>& added : vAdded) {
+                    setKeyPool.insert(added.first);
+                    m_pool_key_to_index[added.second] = added.first;
+                }
+                nMissing -= nBatch;
             }
-            m_pool_key_to_index[pubkey.GetID()] = index;
         }
         if (missingInternal + missingExternal > 0) {
             LogPrintf("keypool added %d keys (%d internal), size=%u (%u internal)\n", missingInternal + missingExternal, missingInternal, setInternalKeyPool.size() + setExternalKeyPool.size(), setInternalKeyPool.size());
@@ -4281,7 +4841,7 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
     }
 
     walletInstance->m_last_block_processed = chainActive.Tip();
-    RegisterValidationInterface(walletInstance);
+    RegisterValidationInterface(walletInstance, "wallet " + walletInstance->GetName());
 
     if (chainActive.Tip() && chainActive.Tip() != pindexRescan)
     {
@@ -7,7 +7,10 @@
 #define BITCOIN_WALLET_WALLET_H
 
 #include <amount.h>
+#include <blockfilter.h>
+#include <coins.h>
 #include <policy/feerate.h>
+#include <random.h>
 #include <streams.h>
 #include <tinyformat.h>
 #include <ui_interface.h>
@@ -15,6 +18,7 @@
 #include <validationinterface.h>
 #include <script/ismine.h>
 #include <script/sign.h>
+#include <wallet/coinselection.h>
 #include <wallet/crypter.h>
 #include <wallet/walletdb.h>
 #include <wallet/rpcwallet.h>
@@ -22,10 +26,12 @@
 #include <algorithm>
 #include <atomic>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -41,6 +47,8 @@ extern bool bSpendZeroConfChange;
 extern bool fWalletRbf;
 
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 1000;
+//! Keypool keys generated and written per database transaction on top-up
+static const int64_t KEYPOOL_TOPUP_BATCH_SIZE = 1000;
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = 0;
 //! -fallbackfee default
@@ -55,6 +63,8 @@ static const CAmount WALLET_INCREMENTAL_RELAY_FEE = 5000;
 static const CAmount MIN_CHANGE = CENT;
 //! final minimum change amount after paying for fees
 static const CAmount MIN_FINAL_CHANGE = MIN_CHANGE/2;
+//! assumed size of an input spending change the wallet cannot dummy sign for
+static const size_t DUMMY_P2PKH_INPUT_SIZE = 148;
 //! Default for -spendzeroconfchange
 static const bool DEFAULT_SPEND_ZEROCONF_CHANGE = true;
 //! Default for -walletrejectlongchains
@@ -64,6 +74,10 @@ static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 6;
 //! -walletrbf default
 static const bool DEFAULT_WALLET_RBF = false;
 static const bool DEFAULT_WALLETBROADCAST = true;
+//! Maximum number of blocks read and matched ahead of a rescan
+static const int MAX_RESCAN_READ_AHEAD = 16;
+//! Maximum number of threads reading blocks for a rescan
+static const int MAX_RESCAN_READERS = 4;
 static const bool DEFAULT_DISABLE_WALLET = false;
 
 extern const char * DEFAULT_WALLET_DAT;
@@ -199,6 +213,39 @@ struct COutputEntry
     int vout;
 };
 
+/** Wallet balance split by the categories reported by GetBalance() and friends. */
+struct CWalletBalance
+{
+    CAmount nTrusted = 0;
+    CAmount nUntrustedPending = 0;
+    CAmount nImmature = 0;
+    CAmount nWatchOnlyTrusted = 0;
+    CAmount nWatchOnlyUntrustedPending = 0;
+    CAmount nWatchOnlyImmature = 0;
+
+    CWalletBalance& operator+=(const CWalletBalance& b)
+    {
+        nTrusted += b.nTrusted;
+        nUntrustedPending += b.nUntrustedPending;
+        nImmature += b.nImmature;
+        nWatchOnlyTrusted += b.nWatchOnlyTrusted;
+        nWatchOnlyUntrustedPending += b.nWatchOnlyUntrustedPending;
+        nWatchOnlyImmature += b.nWatchOnlyImmature;
+        return *this;
+    }
+
+    CWalletBalance& operator-=(const CWalletBalance& b)
+    {
+        nTrusted -= b.nTrusted;
+        nUntrustedPending -= b.nUntrustedPending;
+        nImmature -= b.nImmature;
+        nWatchOnlyTrusted -= b.nWatchOnlyTrusted;
+        nWatchOnlyUntrustedPending -= b.nWatchOnlyUntrustedPending;
+        nWatchOnlyImmature -= b.nWatchOnlyImmature;
+        return *this;
+    }
+};
+
 /** A transaction with a merkle branch linking it to the block chain. */
 class CMerkleTx
 {
@@ -437,18 +484,7 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fImmatureCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -492,41 +528,6 @@ public:
 };
 
 
-class CInputCoin {
-public:
-    CInputCoin(const CWalletTx* walletTx, unsigned int i)
-    {
-        if (!walletTx)
-            throw std::invalid_argument("walletTx should not be null");
-        if (i >= walletTx->tx->vout.size())
-            throw std::out_of_range("The output index is out of range");
-
-        outpoint = COutPoint(walletTx->GetHash(), i);
-        txout = walletTx->tx->vout[i];
-    }
-
-    CInputCoin(const COutPoint& outpointIn, const CTxOut& txoutIn)
-    {
-        outpoint = outpointIn;
-        txout = txoutIn;
-    }
-
-    COutPoint outpoint;
-    CTxOut txout;
-
-    bool operator<(const CInputCoin& rhs) const {
-        return outpoint < rhs.outpoint;
-    }
-
-    bool operator!=(const CInputCoin& rhs) const {
-        return outpoint != rhs.outpoint;
-    }
-
-    bool operator==(const CInputCoin& rhs) const {
-        return outpoint == rhs.outpoint;
-    }
-};
-
 class COutput
 {
 public:
@@ -547,14 +548,31 @@ public:
      */
     bool fSafe;
 
+    /** Virtual size of an input spending this output, -1 if not known */
+    int nInputBytes;
+
     COutput(const CWalletTx *txIn, int iIn, int nDepthIn, bool fSpendableIn, bool fSolvableIn, bool fSafeIn)
     {
-        tx = txIn; i = iIn; nDepth = nDepthIn; fSpendable = fSpendableIn; fSolvable = fSolvableIn; fSafe = fSafeIn;
+        tx = txIn; i = iIn; nDepth = nDepthIn; fSpendable = fSpendableIn; fSolvable = fSolvableIn; fSafe = fSafeIn; nInputBytes = -1;
     }
 
     std::string ToString() const;
 };
 
+/** Parameters for selecting inputs by their effective value */
+struct CoinSelectionParams
+{
+    //! Try a changeless branch and bound selection before the knapsack solver
+    bool use_bnb = true;
+    //! Size of the change output, and of an input spending it later
+    size_t change_output_size = 0;
+    size_t change_spend_size = 0;
+    //! Feerate the transaction is being built for
+    CFeeRate effective_fee = CFeeRate(0);
+    //! Size of the transaction without any inputs
+    size_t tx_noinputs_size = 0;
+};
+
 
 
 
@@ -685,9 +703,12 @@ private:
     /**
      * Select a set of coins such that nValueRet >= nTargetValue and at least
      * all coins from coinControl are selected; Never select unconfirmed coins
-     * if they are not ours
+     * if they are not ours. Branch and bound uses the nInputBytes of the
+     * coins, which the caller fills in.
      */
-    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr) const;
+    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr,
+                     const CoinSelectionParams* coin_selection_params = nullptr, bool* bnb_used = nullptr) const;
+    bool OutputEligibleForSpending(const COutput& output, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors) const;
 
     CWalletDB *pwalletdbEncryption;
 
@@ -716,6 +737,61 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Outputs paying to this wallet that were unspent when last examined.
+     * AvailableCoins only visits these candidates instead of every output in
+     * mapWallet. Rebuilt lazily after key imports and wallet-wide changes.
+     */
+    mutable std::set<COutPoint> setUnspentOutputs;
+    mutable bool fUnspentOutputsDirty = true;
+    void UpdateUnspentOutput(const COutPoint& outpoint) const;
+    void UpdateUnspentOutputs(const CWalletTx& wtx) const;
+    void RebuildUnspentOutputs() const;
+
+    /**
+     * Outputs in mapWallet with a nonzero value that pay to this wallet,
+     * spent or not. IsFromMe() probes it for each input instead of looking
+     * up and re-matching every previous output. Rebuilt together with
+     * setUnspentOutputs, which is invalidated by the same changes.
+     */
+    mutable std::unordered_set<COutPoint, SaltedOutpointHasher> setOwnedOutputs;
+
+    /**
+     * Salted hashes of all GetScriptPubKeys() scripts, including keypool
+     * keys. IsMine(const CTxOut&) rejects a script missing from the set with
+     * a single probe and only runs ::IsMine() on hits. Built on first use,
+     * then extended before new keys and scripts enter the keystore, so an
+     * owned script is never missed. Guarded by cs_KeyStore.
+     */
+    mutable std::unordered_set<uint64_t> setScriptHashes;
+    mutable bool fScriptHashesBuilt = false;
+    const uint64_t nScriptHashK0 = GetRand(std::numeric_limits<uint64_t>::max());
+    const uint64_t nScriptHashK1 = GetRand(std::numeric_limits<uint64_t>::max());
+    uint64_t GetScriptHash(const CScript& script) const;
+    void AddScriptHashes(const std::vector<CScript>& scripts);
+
+    /**
+     * GetScriptPubKeys() as block filter elements, shared with rescan
+     * readers. Dropped by AddScriptHashes and built again on next use.
+     * Guarded by cs_KeyStore.
+     */
+    mutable std::shared_ptr<const GCSFilter::ElementSet> filterElements;
+
+    /**
+     * Running balance totals and the per-transaction amounts they are made
+     * of. Transactions are recounted when marked dirty; those whose category
+     * depends on the chain tip (unconfirmed, conflicted, immature or
+     * non-final) are also recounted whenever the tip moves.
+     */
+    mutable CWalletBalance balanceTotals;
+    mutable std::map<uint256, CWalletBalance> mapBalanceCounted;
+    mutable std::set<uint256> setBalanceDirty;
+    mutable std::set<uint256> setBalanceTipSensitive;
+    mutable const CBlockIndex* pindexBalanceTip = nullptr;
+    mutable bool fBalanceRecount = true;
+    void CountBalance(const CWalletTx& wtx) const;
+    const CWalletBalance& UpdateBalances() const;
+
     /* Used by TransactionAddedToMemorypool/BlockConnected/Disconnected.
      * Should be called with pindexBlock and posInBlock if this is for a transaction that is included in a block. */
     void SyncTransaction(const CTransactionRef& tx, const CBlockIndex *pindex = nullptr, int posInBlock = 0);
@@ -725,6 +801,10 @@ private:
 
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal = false);
+    /* HD derive nKeys new child keys in parallel, updating the chain counter once */
+    void DeriveNewChildKeys(CWalletDB &walletdb, unsigned int nKeys, bool internal, std::vector<std::pair<CKey, CPubKey>>& keysOut, std::vector<CKeyMetadata>& metadataOut);
+    /* Extended key of the external (m/0'/0') or internal (m/0'/1') chain */
+    CExtKey GetHDChainKey(bool internal) const;
 
     std::set<int64_t> setInternalKeyPool;
     std::set<int64_t> setExternalKeyPool;
@@ -876,9 +956,11 @@ public:
      * Shuffle and select coins until nTargetValue is reached while avoiding
      * small change; This method is stochastic for some inputs and upon
      * completion the coin set and corresponding actual target value is
-     * assembled
+     * assembled. With coin_selection_params.use_bnb, only a changeless
+     * branch and bound selection over effective values is tried.
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet,
+                            const CoinSelectionParams* coin_selection_params = nullptr) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
 
@@ -900,11 +982,13 @@ public:
      * Generate a new key
      */
     CPubKey GenerateNewKey(CWalletDB& walletdb, bool internal = false);
+    //! Generate nKeys new keys, deriving HD keys in parallel
+    std::vector<CPubKey> GenerateNewKeys(CWalletDB& walletdb, unsigned int nKeys, bool internal = false);
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey) override;
     bool AddKeyPubKeyWithDB(CWalletDB &walletdb,const CKey& key, const CPubKey &pubkey);
     //! Adds a key to the store, without saving it to disk (used by LoadWallet)
-    bool LoadKey(const CKey& key, const CPubKey &pubkey) { return CCryptoKeyStore::AddKeyPubKey(key, pubkey); }
+    bool LoadKey(const CKey& key, const CPubKey &pubkey);
     //! Load metadata (used by LoadWallet)
     bool LoadKeyMetadata(const CKeyID& keyID, const CKeyMetadata &metadata);
     bool LoadScriptMetadata(const CScriptID& script_id, const CKeyMetadata &metadata);
@@ -975,6 +1059,8 @@ public:
     CAmount GetWatchOnlyBalance() const;
     CAmount GetUnconfirmedWatchOnlyBalance() const;
     CAmount GetImmatureWatchOnlyBalance() const;
+    //! Flag a transaction so that its contribution to the balance totals is recounted
+    void MarkBalanceDirty(const uint256& hash) const;
     CAmount GetLegacyBalance(const isminefilter& filter, int minDepth, const std::string* account) const;
     CAmount GetAvailableBalance(const CCoinControl* coinControl = nullptr) const;
 
@@ -986,6 +1072,12 @@ public:
      */
     bool FundTransaction(CMutableTransaction& tx, CAmount& nFeeRet, int& nChangePosInOut, std::string& strFailReason, bool lockUnspents, const std::set<int>& setSubtractFeeFromOutputs, CCoinControl);
     bool SignTransaction(CMutableTransaction& tx);
+    /**
+     * Sign the first vSpent.size() inputs of tx with SIGHASH_ALL, where
+     * vSpent[i] is the output input i spends. The inputs share precomputed
+     * sighash data and are signed in parallel. tx is left untouched on failure.
+     */
+    bool SignInputs(CMutableTransaction& tx, const std::vector<CTxOut>& vSpent) const;
 
     /**
      * Create a new transaction paying the recipients with a set of coins
@@ -1041,6 +1133,14 @@ public:
     bool IsChange(const CTxOut& txout) const;
     CAmount GetChange(const CTxOut& txout) const;
     bool IsMine(const CTransaction& tx) const;
+    /**
+     * The scriptPubKeys the wallet can recognize outputs by: the standard
+     * scripts for each key, each script, its P2SH and P2WSH wrappings, and
+     * watch-only scripts. Used to test block filters.
+     */
+    std::set<CScript> GetScriptPubKeys() const;
+    /** GetScriptPubKeys() as block filter elements, only rebuilt after scripts were added */
+    std::shared_ptr<const GCSFilter::ElementSet> GetFilterElements() const;
     /** should probably be renamed to IsRelevantToMe */
     bool IsFromMe(const CTransaction& tx) const;
     CAmount GetDebit(const CTransaction& tx, const isminefilter& filter) const;
@@ -0,0 +1,126 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <workerpool.h>
+
+#include <util.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+CWorkerPool::CWorkerPool(int nThreads, const std::string& strName) : fStop(false)
+{
+    const std::string strThreadName = "drivenet-" + strName;
+    for (int i = 0; i < nThreads; i++) {
+        vThreads.emplace_back([this, strThreadName]() {
+            RenameThread(strThreadName.c_str());
+            Run();
+        });
+    }
+}
+
+CWorkerPool::~CWorkerPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fStop = true;
+    }
+    cond.notify_all();
+    for (std::thread& thread : vThreads)
+        thread.join();
+}
+
+void CWorkerPool::Post(std::function<void()> task)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        queue.push_back(std::move(task));
+    }
+    cond.notify_one();
+}
+
+void CWorkerPool::Run()
+{
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this]() { return fStop || !queue.empty(); });
+            if (queue.empty())
+                return;
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+        task();
+    }
+}
+
+namespace {
+/** Items of a ForEach call, shared with the pool tasks helping with it */
+struct ForEachState
+{
+    const std::function<void(size_t)>* pfn;
+    size_t nItems;
+    std::atomic<size_t> nNext;
+    std::atomic<bool> fFailed;
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t nDone;
+    std::exception_ptr error;
+
+    ForEachState(const std::function<void(size_t)>& fn, size_t nItemsIn) : pfn(&fn), nItems(nItemsIn), nNext(0), fFailed(false), nDone(0) {}
+
+    /** Run items until none are left. Helpers starting after the caller returned find none, and never touch fn. */
+    void Work()
+    {
+        size_t nRun = 0;
+        for (size_t i = nNext++; i < nItems; i = nNext++) {
+            if (!fFailed) {
+                try {
+                    (*pfn)(i);
+                } catch (...) {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    if (!error)
+                        error = std::current_exception();
+                    fFailed = true;
+                }
+            }
+            nRun++;
+        }
+        if (nRun > 0) {
+            std::unique_lock<std::mutex> lock(mutex);
+            nDone += nRun;
+            if (nDone == nItems)
+                cond.notify_all();
+        }
+    }
+};
+} // namespace
+
+void CWorkerPool::ForEach(size_t nItems, size_t nMinPerWorker, const std::function<void(size_t)>& fn)
+{
+    const size_t nWorkers = std::min<size_t>(vThreads.size() + 1, nItems / std::max<size_t>(1, nMinPerWorker));
+    if (nWorkers <= 1) {
+        for (size_t i = 0; i < nItems; i++)
+            fn(i);
+        return;
+    }
+
+    std::shared_ptr<ForEachState> state = std::make_shared<ForEachState>(fn, nItems);
+    for (size_t i = 1; i < nWorkers; i++)
+        Post([state]() { state->Work(); });
+    state->Work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cond.wait(lock, [&state]() { return state->nDone == state->nItems; });
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
+
+CWorkerPool& GetWorkerPool()
+{
+    static CWorkerPool pool(std::max(0, GetNumCores() - 1), "worker");
+    return pool;
+}
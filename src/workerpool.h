@@ -0,0 +1,73 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WORKERPOOL_H
+#define BITCOIN_WORKERPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/** Minimum number of CPU bound items (signatures, key derivations) worth handing to another worker */
+static const size_t MIN_ITEMS_PER_WORKER = 8;
+
+/**
+ * A fixed set of threads running tasks from a shared queue.
+ *
+ * Threads are started by the constructor and joined by the destructor, after
+ * running any tasks still queued.
+ */
+class CWorkerPool
+{
+public:
+    CWorkerPool(int nThreads, const std::string& strName);
+    ~CWorkerPool();
+
+    CWorkerPool(const CWorkerPool&) = delete;
+    CWorkerPool& operator=(const CWorkerPool&) = delete;
+
+    int GetThreadCount() const { return vThreads.size(); }
+
+    /** Queue fn, returning a future for its result or exception */
+    template <typename Callable>
+    std::future<typename std::result_of<Callable()>::type> Submit(Callable fn)
+    {
+        typedef typename std::result_of<Callable()>::type Result;
+        std::shared_ptr<std::packaged_task<Result()>> task = std::make_shared<std::packaged_task<Result()>>(std::move(fn));
+        std::future<Result> result = task->get_future();
+        Post([task]() { (*task)(); });
+        return result;
+    }
+
+    /**
+     * Call fn(i) for each i below nItems, on the calling thread and on up to
+     * one pool thread per nMinPerWorker items. Returns once every call has
+     * finished. Items are not handed out once a call has thrown; the first
+     * exception is rethrown. The calling thread takes part, so ForEach may
+     * be used from within a pool task.
+     */
+    void ForEach(size_t nItems, size_t nMinPerWorker, const std::function<void(size_t)>& fn);
+
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::function<void()>> queue;
+    bool fStop;
+    std::vector<std::thread> vThreads;
+
+    void Post(std::function<void()> task);
+    void Run();
+};
+
+/** Pool shared by CPU bound work, with one thread per core besides the caller */
+CWorkerPool& GetWorkerPool();
+
+#endif // BITCOIN_WORKERPOOL_H